@@ -0,0 +1,362 @@
+// bench1541 - measures how many emulated 1MHz cycles the 1541 core sustains on the host.
+//
+// Runs the Emulate1541() inner loop from main.cpp without the 1us wall clock sync, first as is
+// (to get cycles/sec and ns/cycle) and then again with every phase timestamped (CPU step, drive update,
+// VIA execute, IEC bus) to see where the time goes.
+// Anything above 1000ns/cycle on the target means Emulate1541 would hit its "lost a cycle" case.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#include "host.h"
+#include "../../src/Pi1541.h"
+#include "../../src/DiskImage.h"
+#include "../../src/ImageHash.h"
+#include "../../src/ROMs.h"
+#include "../../src/options.h"
+#include "../../src/InputMappings.h"
+
+#define FAST_BOOT_CYCLES 1003061
+#define SNOOP_CD_CBM 0xEA2D
+
+extern u8 read6502(u16 address);
+extern void write6502(u16 address, const u8 value);
+extern u32 HashBuffer(const void* pBuffer, u32 length);
+
+// Globals main.cpp normally provides to the core
+Options options;
+ROMs roms;
+u8 s_u8Memory[0xc000];
+Pi1541 pi1541;
+u8 InputMappings::INPUT_BUTTON_ENTER = 0;
+u8 InputMappings::INPUT_BUTTON_UP = 1;
+u8 InputMappings::INPUT_BUTTON_DOWN = 2;
+u8 InputMappings::INPUT_BUTTON_BACK = 3;
+u8 InputMappings::INPUT_BUTTON_INSERT = 4;
+
+// Used when no DOS ROM is given: switch the motor on, enable byte ready on SO and keep reading $1c01.
+// It keeps the drive mechanics and VIA2 busy much like the DOS idle/read loop but it never talks on the bus.
+static const u8 spinROM[] =
+{
+	0x78,				// c000 SEI
+	0xa9, 0x6f,			//      LDA #$6f
+	0x8d, 0x02, 0x1c,	//      STA $1c02	; DDRB: stepper, motor, LED, density out
+	0xa9, 0x00,			//      LDA #$00
+	0x8d, 0x03, 0x1c,	//      STA $1c03	; DDRA: read the GCR data
+	0xa9, 0x0c,			//      LDA #$0c
+	0x8d, 0x00, 0x1c,	//      STA $1c00	; motor + LED on
+	0xa9, 0xee,			//      LDA #$ee
+	0x8d, 0x0c, 0x1c,	//      STA $1c0c	; PCR: byte ready on SO, read mode
+	0x50, 0xfe,			// c016 BVC c016
+	0xb8,				//      CLV
+	0xad, 0x01, 0x1c,	//      LDA $1c01
+	0x4c, 0x16, 0xc0,	//      JMP c016
+};
+
+static inline u64 Timestamp()
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#elif defined(__aarch64__)
+	u64 value;
+	asm volatile ("mrs %0, cntvct_el0" : "=r" (value));
+	return value;
+#else
+	return host_nanoseconds();
+#endif
+}
+
+static bool LoadROM(const char* ROMName)
+{
+	FIL fp;
+	u32 bytesRead = 0;
+
+	memset(roms.ROMImages[0], 0, ROMs::ROM_SIZE);
+	if (ROMName == 0)
+	{
+		memcpy(roms.ROMImages[0], spinROM, sizeof(spinROM));
+		roms.ROMImages[0][0x3ffc] = 0x00;	// RESET -> $c000
+		roms.ROMImages[0][0x3ffd] = 0xc0;
+		strcpy(roms.ROMNames[0], "built-in spin loop");
+	}
+	else
+	{
+		if (f_open(&fp, ROMName, FA_READ) != FR_OK)
+		{
+			printf("Could not open ROM %s\n", ROMName);
+			return false;
+		}
+		f_read(&fp, roms.ROMImages[0], ROMs::ROM_SIZE, &bytesRead);
+		f_close(&fp);
+		if (bytesRead != ROMs::ROM_SIZE)
+		{
+			printf("ROM %s is %d bytes, expected %d\n", ROMName, bytesRead, ROMs::ROM_SIZE);
+			return false;
+		}
+		strncpy(roms.ROMNames[0], ROMName, 255);
+	}
+	roms.ROMHash[0] = HashBuffer(roms.ROMImages[0], ROMs::ROM_SIZE);
+	roms.ROMValid[0] = true;
+	roms.currentROMIndex = 0;
+	return true;
+}
+
+static bool MountImage(DiskImage* diskImage, const char* filename, FILINFO* fileInfo)
+{
+	FIL fp;
+	u32 bytesRead = 0;
+	bool success = false;
+
+	if (f_stat(filename, fileInfo) != FR_OK || f_open(&fp, filename, FA_READ) != FR_OK)
+	{
+		printf("Could not open image %s\n", filename);
+		return false;
+	}
+	memset(DiskImage::readBuffer, 0xff, READBUFFER_SIZE);
+	f_read(&fp, DiskImage::readBuffer, READBUFFER_SIZE, &bytesRead);
+	f_close(&fp);
+
+	switch (DiskImage::GetDiskImageTypeViaExtention(filename))
+	{
+		case DiskImage::D64:
+			success = diskImage->OpenD64(fileInfo, DiskImage::readBuffer, bytesRead);
+			break;
+		case DiskImage::G64:
+			success = diskImage->OpenG64(fileInfo, DiskImage::readBuffer, bytesRead);
+			break;
+		case DiskImage::NIB:
+			success = diskImage->OpenNIB(fileInfo, DiskImage::readBuffer, bytesRead);
+			break;
+		case DiskImage::NBZ:
+			success = diskImage->OpenNBZ(fileInfo, DiskImage::readBuffer, bytesRead);
+			break;
+		default:
+			printf("%s is not a D64/G64/NIB/NBZ image\n", filename);
+			return false;
+	}
+	if (success)
+	{
+		diskImage->SetReadOnly(true);	// never write the benchmark image back
+		diskImage->SetHash(ImageHash::Hash(DiskImage::readBuffer, bytesRead));
+	}
+	else
+		printf("Could not decode image %s\n", filename);
+	return success;
+}
+
+static void BeginEmulating()
+{
+	pi1541.ConfigureDataBus();
+	pi1541.m6502.SetBusFunctions(read6502, write6502);
+	IEC_Bus::VIA = &pi1541.VIA[0];
+	IEC_Bus::port = pi1541.VIA[0].GetPortB();
+	pi1541.Reset();
+	IEC_Bus::LetSRQBePulledHigh();
+}
+
+// The realtime part of Emulate1541() minus the 1MHz sync, user input and sound.
+static void RunCycles(u64 cycles, bool refreshOutsAfterCPUStep)
+{
+	bool oldLED = false;
+	u16 snoopPC = 0;
+
+	while (cycles--)
+	{
+		if (refreshOutsAfterCPUStep)
+			IEC_Bus::ReadEmulationMode1541();
+
+		if (pi1541.m6502.SYNC())
+		{
+			u16 pc = pi1541.m6502.GetPC();
+			if (pc == SNOOP_CD_CBM)
+				snoopPC = pc;
+		}
+
+		pi1541.m6502.Step();
+
+		if (refreshOutsAfterCPUStep)
+			IEC_Bus::RefreshOuts1541();
+		IEC_Bus::OutputLED = pi1541.drive.IsLEDOn();
+		if (IEC_Bus::OutputLED ^ oldLED)
+		{
+			SetACTLed(IEC_Bus::OutputLED);
+			oldLED = IEC_Bus::OutputLED;
+			IEC_Bus::RefreshOutLED();
+		}
+		IEC_Bus::ReadGPIOUserInput(true);
+
+		pi1541.Update();
+
+		if (!refreshOutsAfterCPUStep)
+		{
+			IEC_Bus::ReadEmulationMode1541();
+			IEC_Bus::RefreshOuts1541();
+		}
+	}
+	if (snoopPC)
+		DEBUG_LOG("CD:_ snoop point reached\n");
+}
+
+enum Phase
+{
+	PHASE_CPU,
+	PHASE_DRIVE,
+	PHASE_VIA,
+	PHASE_IEC,
+	PHASE_COUNT
+};
+
+static const char* phaseNames[PHASE_COUNT] = { "CPU step", "drive update", "VIA execute", "IEC bus + loop" };
+
+// Same as RunCycles() with Pi1541::Update() unrolled so every phase can be timestamped.
+static void RunCyclesProfiled(u64 cycles, u64* ticks)
+{
+	bool oldLED = false;
+
+	while (cycles--)
+	{
+		u64 t0 = Timestamp();
+		IEC_Bus::ReadEmulationMode1541();
+		pi1541.m6502.SYNC();
+		u64 t1 = Timestamp();
+		pi1541.m6502.Step();
+		u64 t2 = Timestamp();
+		IEC_Bus::RefreshOuts1541();
+		IEC_Bus::OutputLED = pi1541.drive.IsLEDOn();
+		if (IEC_Bus::OutputLED ^ oldLED)
+		{
+			oldLED = IEC_Bus::OutputLED;
+			IEC_Bus::RefreshOutLED();
+		}
+		IEC_Bus::ReadGPIOUserInput(true);
+		u64 t3 = Timestamp();
+		if (pi1541.drive.Update())
+			pi1541.m6502.SO();
+		u64 t4 = Timestamp();
+		pi1541.VIA[1].Execute();
+		pi1541.VIA[0].Execute();
+		u64 t5 = Timestamp();
+
+		ticks[PHASE_IEC] += (t1 - t0) + (t3 - t2);
+		ticks[PHASE_CPU] += t2 - t1;
+		ticks[PHASE_DRIVE] += t4 - t3;
+		ticks[PHASE_VIA] += t5 - t4;
+	}
+}
+
+static void Usage(const char* name)
+{
+	printf("Usage: %s [-r dos1541.rom] [-c million_cycles] [-e] [-b] [-n] image.d64|g64|nib|nbz\n", name);
+	printf("  -r  DOS ROM to boot (default: a built-in loop that just spins the disk)\n");
+	printf("  -c  number of cycles to run in millions (default 20)\n");
+	printf("  -e  map extra RAM (options.txt extraRAM = 1)\n");
+	printf("  -b  treat the image as one of the G64 quirk titles (outputs refreshed after Update)\n");
+	printf("  -n  skip the per-phase breakdown\n");
+}
+
+int main(int argc, char** argv)
+{
+	const char* ROMName = 0;
+	double millions = 20.0;
+	bool refreshOutsAfterCPUStep = true;
+	bool profile = true;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "r:c:ebnh")) != -1)
+	{
+		switch (opt)
+		{
+			case 'r': ROMName = optarg; break;
+			case 'c': millions = atof(optarg); break;
+			case 'e':
+			{
+				static char extraRAMOption[] = "extraRAM = 1";
+				options.Process(extraRAMOption);
+				break;
+			}
+			case 'b': refreshOutsAfterCPUStep = false; break;
+			case 'n': profile = false; break;
+			default: Usage(argv[0]); return 1;
+		}
+	}
+	if (optind >= argc || millions <= 0)
+	{
+		Usage(argv[0]);
+		return 1;
+	}
+
+	static DiskImage diskImage;
+	static FILINFO fileInfo;
+	if (!LoadROM(ROMName) || !MountImage(&diskImage, argv[optind], &fileInfo))
+		return 1;
+
+	u64 cycles = (u64)(millions * 1000000.0);
+	printf("image %s (hash %016llx), ROM %s (hash %08x)\n", argv[optind], (unsigned long long)diskImage.GetHash(), roms.GetSelectedROMName(), roms.GetHash());
+
+	IEC_Bus::Initialise();
+	pi1541.Initialise();
+	pi1541.SetDeviceID(8);
+	pi1541.drive.SetVIA(&pi1541.VIA[1]);
+	pi1541.VIA[0].GetPortB()->SetPortOut(0, IEC_Bus::PortB_OnPortOut);
+	pi1541.drive.Insert(&diskImage);
+	BeginEmulating();
+
+	u64 start = host_nanoseconds();
+	for (int cycle = 0; cycle < FAST_BOOT_CYCLES; ++cycle)
+	{
+		IEC_Bus::ReadEmulationMode1541();
+		pi1541.m6502.SYNC();
+		pi1541.m6502.Step();
+		pi1541.Update();
+	}
+	u64 elapsed = host_nanoseconds() - start;
+	printf("fast boot : %d cycles in %.1f ms\n", FAST_BOOT_CYCLES, elapsed / 1e6);
+
+	// Remount the way Emulate1541() does on every later entry.
+	// Like Emulate1541() the boot state is only kept if the self test left the motor off.
+	if (!pi1541.drive.IsMotorOn())
+	{
+		pi1541.SaveBootState(roms.GetHash());
+		start = host_nanoseconds();
+		pi1541.drive.Insert(&diskImage);
+		BeginEmulating();
+		bool restored = pi1541.RestoreBootState(roms.GetHash());
+		elapsed = host_nanoseconds() - start;
+		printf("remount   : boot state %s in %.1f us\n", restored ? "restored" : "NOT restored", elapsed / 1e3);
+	}
+	else
+	{
+		printf("remount   : motor on after the fast boot, boot state not kept\n");
+	}
+
+	start = host_nanoseconds();
+	RunCycles(cycles, refreshOutsAfterCPUStep);
+	elapsed = host_nanoseconds() - start;
+	double nsPerCycle = (double)elapsed / cycles;
+	printf("realtime  : %llu cycles in %.1f ms, %.2f Mcycles/s, %.1f ns/cycle (%.1fx realtime)\n",
+		(unsigned long long)cycles, elapsed / 1e6, cycles / (elapsed / 1e3), nsPerCycle, 1000.0 / nsPerCycle);
+
+	if (profile)
+	{
+		u64 ticks[PHASE_COUNT] = { 0 };
+		u64 ticksStart = Timestamp();
+		start = host_nanoseconds();
+		RunCyclesProfiled(cycles, ticks);
+		elapsed = host_nanoseconds() - start;
+		double nsPerTick = (double)elapsed / (double)(Timestamp() - ticksStart);
+		u64 total = 0;
+		for (int phase = 0; phase < PHASE_COUNT; ++phase)
+			total += ticks[phase];
+		printf("profiled  : %.1f ns/cycle including timestamp overhead\n", (double)elapsed / cycles);
+		for (int phase = 0; phase < PHASE_COUNT; ++phase)
+		{
+			printf("  %-15s %6.1f ns/cycle %5.1f%%\n", phaseNames[phase],
+				ticks[phase] * nsPerTick / cycles, total ? 100.0 * ticks[phase] / total : 0.0);
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,413 @@
+// benchgcr - checks and times the GCR kernels in gcr.cpp against the nibble at a time code they replaced.
+//
+// Every sector of the given D64 images (or of a pseudo random disk without any) is
+//	encode   : converted to a GCR data block (convert_4bytes_to_GCR)
+//	decode   : converted back (convert_4bytes_from_GCR)
+//	unaligned: converted back from 1-7 bits into a byte (convert_GCR_bits_to_bytes, as DiskImage::DecodeBlock uses it)
+// with the old and new code, which must give identical bytes (and return codes for invalid GCR).
+// Last each image is mounted and every sector read back through DiskImage::GetDecodedSector() against the file.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "host.h"
+#include "../../src/DiskImage.h"
+#include "../../src/gcr.h"
+
+#define SECTOR_LENGTH 256
+#define GCR_GROUPS 65					// 0x07, 256 bytes, checksum and 2 fillers
+#define GCR_BLOCK_LENGTH (GCR_GROUPS * 5)
+
+// The code as it was before the lookup tables.
+static const BYTE refConvData[16] =
+{
+	0x0a, 0x0b, 0x12, 0x13, 0x0e, 0x0f, 0x16, 0x17, 0x09, 0x19, 0x1a, 0x1b, 0x0d, 0x1d, 0x1e, 0x15
+};
+static const BYTE refDecodeHigh[32] =
+{
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x80, 0x00, 0x10, 0xff, 0xc0, 0x40, 0x50,
+	0xff, 0xff, 0x20, 0x30, 0xff, 0xf0, 0x60, 0x70, 0xff, 0x90, 0xa0, 0xb0, 0xff, 0xd0, 0xe0, 0xff
+};
+static const BYTE refDecodeLow[32] =
+{
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x08, 0x00, 0x01, 0xff, 0x0c, 0x04, 0x05,
+	0xff, 0xff, 0x02, 0x03, 0xff, 0x0f, 0x06, 0x07, 0xff, 0x09, 0x0a, 0x0b, 0xff, 0x0d, 0x0e, 0xff
+};
+
+static void RefTo4GCR(const BYTE* buffer, BYTE* ptr)
+{
+	*ptr = refConvData[(*buffer) >> 4] << 3;
+	*ptr |= refConvData[(*buffer) & 0x0f] >> 2;
+	ptr++;
+	*ptr = refConvData[(*buffer) & 0x0f] << 6;
+	buffer++;
+	*ptr |= refConvData[(*buffer) >> 4] << 1;
+	*ptr |= refConvData[(*buffer) & 0x0f] >> 4;
+	ptr++;
+	*ptr = refConvData[(*buffer) & 0x0f] << 4;
+	buffer++;
+	*ptr |= refConvData[(*buffer) >> 4] >> 1;
+	ptr++;
+	*ptr = refConvData[(*buffer) >> 4] << 7;
+	*ptr |= refConvData[(*buffer) & 0x0f] << 2;
+	buffer++;
+	*ptr |= refConvData[(*buffer) >> 4] >> 3;
+	ptr++;
+	*ptr = refConvData[(*buffer) >> 4] << 5;
+	*ptr |= refConvData[(*buffer) & 0x0f];
+}
+
+static int RefFrom4GCR(const BYTE* gcr, BYTE* plain)
+{
+	BYTE hnibble, lnibble;
+	int badGCR = 0;
+
+	hnibble = refDecodeHigh[gcr[0] >> 3];
+	lnibble = refDecodeLow[((gcr[0] << 2) | (gcr[1] >> 6)) & 0x1f];
+	if ((hnibble == 0xff || lnibble == 0xff) && !badGCR)
+		badGCR = 1;
+	*plain++ = hnibble | lnibble;
+	hnibble = refDecodeHigh[(gcr[1] >> 1) & 0x1f];
+	lnibble = refDecodeLow[((gcr[1] << 4) | (gcr[2] >> 4)) & 0x1f];
+	if ((hnibble == 0xff || lnibble == 0xff) && !badGCR)
+		badGCR = 2;
+	*plain++ = hnibble | lnibble;
+	hnibble = refDecodeHigh[((gcr[2] << 1) | (gcr[3] >> 7)) & 0x1f];
+	lnibble = refDecodeLow[(gcr[3] >> 2) & 0x1f];
+	if ((hnibble == 0xff || lnibble == 0xff) && !badGCR)
+		badGCR = 3;
+	*plain++ = hnibble | lnibble;
+	hnibble = refDecodeHigh[((gcr[3] << 3) | (gcr[4] >> 5)) & 0x1f];
+	lnibble = refDecodeLow[gcr[4] & 0x1f];
+	if ((hnibble == 0xff || lnibble == 0xff) && !badGCR)
+		badGCR = 4;
+	*plain++ = hnibble | lnibble;
+	return (badGCR == 0) ? 4 : (badGCR - 1);
+}
+
+// DiskImage::DecodeBlock() as it was (without the wrap around the end of the track).
+static void RefDecodeBits(const BYTE* offset, int shift, BYTE* buf, int num)
+{
+	BYTE gcr[5];
+	BYTE byte = offset[0] << shift;
+
+	for (int i = 0; i < num; i++, buf += 4)
+	{
+		for (int j = 0; j < 5; j++)
+		{
+			offset++;
+			if (shift)
+			{
+				gcr[j] = byte | ((offset[0] << shift) >> 8);
+				byte = offset[0] << shift;
+			}
+			else
+			{
+				gcr[j] = byte;
+				byte = offset[0];
+			}
+		}
+		RefFrom4GCR(gcr, buf);
+	}
+}
+
+struct Sectors
+{
+	const char* name;
+	unsigned count;
+	BYTE* data;		// count * SECTOR_LENGTH
+	BYTE* blocks;	// count * 4 * GCR_GROUPS, each as convert_sector_to_GCR() lays out the data block
+};
+
+static void MakeBlocks(Sectors& sectors)
+{
+	sectors.blocks = new BYTE[sectors.count * 4 * GCR_GROUPS];
+	for (unsigned index = 0; index < sectors.count; ++index)
+	{
+		const BYTE* data = sectors.data + index * SECTOR_LENGTH;
+		BYTE* block = sectors.blocks + index * 4 * GCR_GROUPS;
+		BYTE checkSum = 0;
+
+		block[0] = 0x07;
+		for (unsigned byte = 0; byte < SECTOR_LENGTH; ++byte)
+		{
+			block[byte + 1] = data[byte];
+			checkSum ^= data[byte];
+		}
+		block[257] = checkSum;
+		block[258] = block[259] = 0;
+	}
+}
+
+static double Rate(unsigned count, u64 ns)
+{
+	return ns ? count * 1e9 / ns : 0.0;
+}
+
+static int failures = 0;
+
+static void Fail(const char* test, const char* name, unsigned index)
+{
+	if (failures++ < 10)
+		printf("MISMATCH %s %s sector %u\n", test, name, index);
+}
+
+static void BenchEncode(const Sectors& sectors, BYTE* refGCR, BYTE* newGCR)
+{
+	u64 start = host_nanoseconds();
+	for (unsigned index = 0; index < sectors.count; ++index)
+	{
+		for (unsigned group = 0; group < GCR_GROUPS; ++group)
+			RefTo4GCR(sectors.blocks + index * 4 * GCR_GROUPS + group * 4, refGCR + index * GCR_BLOCK_LENGTH + group * 5);
+	}
+	u64 refTime = host_nanoseconds() - start;
+
+	start = host_nanoseconds();
+	for (unsigned index = 0; index < sectors.count; ++index)
+	{
+		for (unsigned group = 0; group < GCR_GROUPS; ++group)
+			convert_4bytes_to_GCR(sectors.blocks + index * 4 * GCR_GROUPS + group * 4, newGCR + index * GCR_BLOCK_LENGTH + group * 5);
+	}
+	u64 newTime = host_nanoseconds() - start;
+
+	for (unsigned index = 0; index < sectors.count; ++index)
+	{
+		if (memcmp(refGCR + index * GCR_BLOCK_LENGTH, newGCR + index * GCR_BLOCK_LENGTH, GCR_BLOCK_LENGTH))
+			Fail("encode", sectors.name, index);
+	}
+	printf("  encode    : %10.0f sectors/s old %10.0f sectors/s new (%.1fx)\n", Rate(sectors.count, refTime), Rate(sectors.count, newTime), refTime / (double)(newTime ? newTime : 1));
+}
+
+static void BenchDecode(const Sectors& sectors, const BYTE* gcr)
+{
+	BYTE* refPlain = new BYTE[sectors.count * 4 * GCR_GROUPS];
+	BYTE* newPlain = new BYTE[sectors.count * 4 * GCR_GROUPS];
+	unsigned refConverted = 0;
+	unsigned newConverted = 0;
+
+	u64 start = host_nanoseconds();
+	for (unsigned group = 0; group < sectors.count * GCR_GROUPS; ++group)
+		refConverted += RefFrom4GCR(gcr + group * 5, refPlain + group * 4);
+	u64 refTime = host_nanoseconds() - start;
+
+	start = host_nanoseconds();
+	for (unsigned group = 0; group < sectors.count * GCR_GROUPS; ++group)
+		newConverted += convert_4bytes_from_GCR((BYTE*)gcr + group * 5, newPlain + group * 4);
+	u64 newTime = host_nanoseconds() - start;
+
+	for (unsigned index = 0; index < sectors.count; ++index)
+	{
+		if (memcmp(refPlain + index * 4 * GCR_GROUPS, newPlain + index * 4 * GCR_GROUPS, 4 * GCR_GROUPS)
+			|| memcmp(refPlain + index * 4 * GCR_GROUPS, sectors.blocks + index * 4 * GCR_GROUPS, 4 * GCR_GROUPS))
+			Fail("decode", sectors.name, index);
+	}
+	if (refConverted != newConverted)
+		Fail("decode (bytes converted)", sectors.name, 0);
+	printf("  decode    : %10.0f sectors/s old %10.0f sectors/s new (%.1fx)\n", Rate(sectors.count, refTime), Rate(sectors.count, newTime), refTime / (double)(newTime ? newTime : 1));
+
+	delete[] refPlain;
+	delete[] newPlain;
+}
+
+// Each data block shifted 1-7 bits into a byte (and 0) with random bits around it.
+static void BenchUnaligned(const Sectors& sectors, const BYTE* gcr)
+{
+	const unsigned stride = GCR_BLOCK_LENGTH + 2;
+	BYTE* shifted = new BYTE[sectors.count * stride];
+	BYTE refPlain[4 * GCR_GROUPS];
+	BYTE newPlain[4 * GCR_GROUPS];
+	u64 refTime = 0;
+	u64 newTime = 0;
+
+	for (unsigned index = 0; index < sectors.count; ++index)
+	{
+		unsigned shift = index & 7;
+		const BYTE* source = gcr + index * GCR_BLOCK_LENGTH;
+		BYTE* dest = shifted + index * stride;
+
+		dest[0] = (BYTE)rand();
+		for (unsigned byte = 1; byte < stride; ++byte)
+			dest[byte] = (BYTE)rand();
+		for (unsigned bit = 0; bit < GCR_BLOCK_LENGTH * 8; ++bit)
+		{
+			unsigned to = bit + shift;
+			if ((source[bit >> 3] >> (7 - (bit & 7))) & 1)
+				dest[to >> 3] |= 0x80 >> (to & 7);
+			else
+				dest[to >> 3] &= ~(0x80 >> (to & 7));
+		}
+	}
+
+	for (unsigned index = 0; index < sectors.count; ++index)
+	{
+		BYTE* block = shifted + index * stride;
+		unsigned shift = index & 7;
+
+		u64 start = host_nanoseconds();
+		RefDecodeBits(block, shift, refPlain, GCR_GROUPS);
+		u64 middle = host_nanoseconds();
+		convert_GCR_bits_to_bytes(block, shift, newPlain, GCR_GROUPS);
+		newTime += host_nanoseconds() - middle;
+		refTime += middle - start;
+
+		if (memcmp(refPlain, newPlain, sizeof(refPlain)) || memcmp(refPlain, sectors.blocks + index * 4 * GCR_GROUPS, sizeof(refPlain)))
+			Fail("unaligned", sectors.name, index);
+	}
+	printf("  unaligned : %10.0f sectors/s old %10.0f sectors/s new (%.1fx)\n", Rate(sectors.count, refTime), Rate(sectors.count, newTime), refTime / (double)(newTime ? newTime : 1));
+
+	delete[] shifted;
+}
+
+// Every 5 byte pattern that starts with each of the 1024 10 bit values, the rest random, so invalid GCR is covered too.
+static void CheckInvalid()
+{
+	BYTE gcr[5];
+	BYTE refPlain[4];
+	BYTE newPlain[4];
+
+	for (unsigned pattern = 0; pattern < 1024 * 256; ++pattern)
+	{
+		unsigned position = (pattern >> 10) & 3;		// Which of the 4 bytes gets the pattern
+		u64 value = ((u64)rand() << 31 | rand()) & 0xffffffffffull;
+		value &= ~(0x3ffull << (30 - position * 10));
+		value |= (u64)(pattern & 0x3ff) << (30 - position * 10);
+		for (int byte = 0; byte < 5; ++byte)
+			gcr[byte] = (BYTE)(value >> (32 - byte * 8));
+
+		int refConverted = RefFrom4GCR(gcr, refPlain);
+		int newConverted = convert_4bytes_from_GCR(gcr, newPlain);
+		if (refConverted != newConverted || memcmp(refPlain, newPlain, 4))
+			Fail("invalid GCR", "patterns", pattern);
+	}
+}
+
+static bool LoadD64(const char* path, Sectors& sectors, BYTE*& file, unsigned& size)
+{
+	FILE* fp = fopen(path, "rb");
+	if (!fp)
+	{
+		printf("Cannot open %s\n", path);
+		return false;
+	}
+	file = new BYTE[READBUFFER_SIZE];
+	memset(file, 0xff, READBUFFER_SIZE);
+	size = (unsigned)fread(file, 1, READBUFFER_SIZE, fp);
+	fclose(fp);
+
+	sectors.name = path;
+	switch (size)
+	{
+		case BLOCKSONDISK * (SECTOR_LENGTH + 1):		// With error info
+			sectors.count = BLOCKSONDISK;
+			break;
+		case MAXBLOCKSONDISK * (SECTOR_LENGTH + 1):
+			sectors.count = MAXBLOCKSONDISK;
+			break;
+		default:
+			sectors.count = size / SECTOR_LENGTH;
+			break;
+	}
+	sectors.data = file;
+	return sectors.count != 0;
+}
+
+// Mounts the image and reads every sector back through DiskImage (D64 images only).
+static void CheckImage(const char* path, const BYTE* file, unsigned size, unsigned count)
+{
+	static DiskImage diskImage;
+	static FILINFO fileInfo;
+	BYTE sector[SECTOR_LENGTH];
+	const BYTE* errors = (size == count * (SECTOR_LENGTH + 1)) ? file + count * SECTOR_LENGTH : 0;
+
+	memset(&fileInfo, 0, sizeof(fileInfo));
+	strncpy(fileInfo.fname, path, sizeof(fileInfo.fname) - 1);
+	memcpy(DiskImage::readBuffer, file, size);
+
+	u64 start = host_nanoseconds();
+	if (!diskImage.OpenD64(&fileInfo, DiskImage::readBuffer, size))
+	{
+		Fail("mount", path, 0);
+		return;
+	}
+	diskImage.SetReadOnly(true);
+	diskImage.EncodeAllTracks();
+	u64 mountTime = host_nanoseconds() - start;
+
+	unsigned index = 0;
+	unsigned checked = 0;
+	start = host_nanoseconds();
+	for (unsigned track = 1; track <= MAX_TRACK_D64 && index < count; ++track)
+	{
+		unsigned sectors = DiskImage::SectorsPerTrackD64(track - 1);
+		for (unsigned sectorNo = 0; sectorNo < sectors && index < count; ++sectorNo, ++index)
+		{
+			bool ok = diskImage.GetDecodedSector(track, sectorNo, sector);
+			if (errors && errors[index] != 1 && errors[index] != 0)
+				continue;	// Deliberately unreadable
+			checked++;
+			if (!ok || memcmp(sector, file + index * SECTOR_LENGTH, SECTOR_LENGTH))
+				Fail("read back", path, index);
+		}
+	}
+	u64 readTime = host_nanoseconds() - start;
+	diskImage.Close();
+
+	printf("  image     : mounted and encoded in %.2f ms, %u sectors read back at %.0f sectors/s\n", mountTime / 1e6, checked, Rate(index, readTime));
+}
+
+static void Run(Sectors& sectors)
+{
+	BYTE* refGCR = new BYTE[sectors.count * GCR_BLOCK_LENGTH];
+	BYTE* newGCR = new BYTE[sectors.count * GCR_BLOCK_LENGTH];
+
+	MakeBlocks(sectors);
+	printf("%s: %u sectors\n", sectors.name, sectors.count);
+	BenchEncode(sectors, refGCR, newGCR);
+	BenchDecode(sectors, refGCR);
+	BenchUnaligned(sectors, refGCR);
+
+	delete[] refGCR;
+	delete[] newGCR;
+	delete[] sectors.blocks;
+}
+
+int main(int argc, char** argv)
+{
+	srand(1541);
+	CheckInvalid();
+
+	if (argc < 2)
+	{
+		static BYTE data[MAXBLOCKSONDISK * SECTOR_LENGTH];
+		for (unsigned byte = 0; byte < sizeof(data); ++byte)
+			data[byte] = (BYTE)rand();
+
+		Sectors sectors = { "random", MAXBLOCKSONDISK, data, 0 };
+		for (int pass = 0; pass < 10; ++pass)
+			Run(sectors);
+	}
+
+	for (int arg = 1; arg < argc; ++arg)
+	{
+		Sectors sectors;
+		BYTE* file;
+		unsigned size;
+
+		if (!LoadD64(argv[arg], sectors, file, size))
+		{
+			failures++;
+			continue;
+		}
+		Run(sectors);
+		CheckImage(argv[arg], file, size, sectors.count);
+		delete[] file;
+	}
+
+	if (failures)
+	{
+		printf("%d mismatches\n", failures);
+		return 1;
+	}
+	printf("all identical\n");
+	return 0;
+}
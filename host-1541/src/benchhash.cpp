@@ -0,0 +1,163 @@
+// benchhash - checks and times ImageHash (XXH64) against the FNV-1a HashBuffer() it replaced for disk images.
+//
+// ImageHash is checked against the published XXH64 test values and fed a pseudo random buffer in uneven pieces,
+// which must give the same hash as all at once. Both hashes are then timed over a READBUFFER_SIZE buffer.
+// For each file given it prints both hashes, as DiskCaddy::Insert() computes the new one, for the image table in main.cpp.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "host.h"
+#include "../../src/DiskImage.h"
+#include "../../src/ImageHash.h"
+
+extern u32 HashBuffer(const void* pBuffer, u32 length);
+
+static const unsigned READ_CHUNK_SIZE = 64 * 1024;	// As DiskCaddy::Insert() reads
+
+static const struct
+{
+	const char* text;
+	u64 hash;
+} vectors[] =
+{
+	{ "", 0xef46db3751d8e999ULL },
+	{ "a", 0xd24ec4f1a98c6e5bULL },
+	{ "abc", 0x44bc2cf5ad770999ULL },
+	{ "Nobody inspects the spammish repetition", 0xfbcea83c8a378bf1ULL },
+};
+
+static unsigned char buffer[READBUFFER_SIZE];
+
+static unsigned Random()
+{
+	static unsigned seed = 0x1541;
+	seed = seed * 1103515245 + 12345;
+	return seed >> 8;
+}
+
+static bool CheckVectors()
+{
+	bool ok = true;
+	for (unsigned index = 0; index < sizeof(vectors) / sizeof(vectors[0]); ++index)
+	{
+		u64 hash = ImageHash::Hash(vectors[index].text, strlen(vectors[index].text));
+		if (hash != vectors[index].hash)
+		{
+			printf("XXH64(\"%s\") = %016llx, expected %016llx\n", vectors[index].text, (unsigned long long)hash, (unsigned long long)vectors[index].hash);
+			ok = false;
+		}
+	}
+	return ok;
+}
+
+// Lengths either side of the 32 byte stripe and the 8/4/1 byte tails, split at every point and in random pieces.
+static bool CheckIncremental()
+{
+	bool ok = true;
+	unsigned length;
+
+	for (length = 0; length < 200 && ok; ++length)
+	{
+		u64 expected = ImageHash::Hash(buffer + 3, length);
+		for (unsigned split = 0; split <= length; ++split)
+		{
+			ImageHash imageHash;
+			imageHash.Update(buffer + 3, split);
+			imageHash.Update(buffer + 3 + split, length - split);
+			if (imageHash.Final() != expected)
+			{
+				printf("length %u split at %u differs\n", length, split);
+				ok = false;
+				break;
+			}
+		}
+	}
+
+	u64 expected = ImageHash::Hash(buffer, sizeof(buffer));
+	for (unsigned pass = 0; pass < 100 && ok; ++pass)
+	{
+		ImageHash imageHash;
+		unsigned offset = 0;
+		while (offset < sizeof(buffer))
+		{
+			unsigned piece = Random() % (pass < 50 ? 100 : 100000);
+			if (piece > sizeof(buffer) - offset)
+				piece = sizeof(buffer) - offset;
+			imageHash.Update(buffer + offset, piece);
+			offset += piece;
+		}
+		if (imageHash.Final() != expected)
+		{
+			printf("random pieces (pass %u) differ\n", pass);
+			ok = false;
+		}
+	}
+	return ok;
+}
+
+static void Time(unsigned repeats)
+{
+	volatile u64 sink = 0;
+	u64 start;
+	double fnv, xxh;
+
+	start = host_nanoseconds();
+	for (unsigned repeat = 0; repeat < repeats; ++repeat)
+		sink += HashBuffer(buffer, sizeof(buffer));
+	fnv = (host_nanoseconds() - start) / 1e6 / repeats;
+
+	start = host_nanoseconds();
+	for (unsigned repeat = 0; repeat < repeats; ++repeat)
+		sink += ImageHash::Hash(buffer, sizeof(buffer));
+	xxh = (host_nanoseconds() - start) / 1e6 / repeats;
+
+	printf("%u KB: FNV-1a %.3fms (%.0f MB/s), ImageHash %.3fms (%.0f MB/s), %.1fx\n", (unsigned)(sizeof(buffer) >> 10),
+		fnv, sizeof(buffer) / fnv / 1e3, xxh, sizeof(buffer) / xxh / 1e3, fnv / xxh);
+}
+
+static bool HashFile(const char* name)
+{
+	FILE* fp = fopen(name, "rb");
+	if (!fp)
+	{
+		printf("%s: cannot open\n", name);
+		return false;
+	}
+
+	ImageHash imageHash;
+	unsigned size = 0;
+	size_t chunkRead;
+	do
+	{
+		unsigned chunkSize = sizeof(buffer) - size < READ_CHUNK_SIZE ? sizeof(buffer) - size : READ_CHUNK_SIZE;
+		chunkRead = fread(buffer + size, 1, chunkSize, fp);
+		imageHash.Update(buffer + size, chunkRead);
+		size += chunkRead;
+	}
+	while (chunkRead == READ_CHUNK_SIZE && size < sizeof(buffer));
+	fclose(fp);
+
+	u64 hash = imageHash.Final();
+	printf("{ 0x%016llxULL, 0x%08x, \"%s\" },	// %u bytes\n", (unsigned long long)hash, HashBuffer(buffer, size), name, size);
+	return hash == ImageHash::Hash(buffer, size);
+}
+
+int main(int argc, char** argv)
+{
+	bool ok;
+	unsigned index;
+
+	for (index = 0; index < sizeof(buffer); ++index)
+		buffer[index] = Random();
+
+	ok = CheckVectors();
+	ok = CheckIncremental() && ok;
+	Time(20);
+
+	for (int arg = 1; arg < argc; ++arg)
+		ok = HashFile(argv[arg]) && ok;
+
+	printf(ok ? "all identical\n" : "MISMATCH\n");
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,66 @@
+// benchzip - extracts the disk images from .zip archives with ZipArchive, as the web server does after an upload.
+//
+// Each archive is extracted into the given folder (or the current one), printing what happened to every member,
+// followed by the time taken and the rate at which the images were written.
+//
+//	benchzip [-d folder] some.zip other.zip
+
+#include <stdio.h>
+#include <string.h>
+#include "host.h"
+#include "../../src/ZipArchive.h"
+
+struct Totals
+{
+	unsigned members;
+	unsigned failed;
+	u64 bytes;
+};
+
+static void Progress(void* context, const char* name, u32 size, ZipArchive::Result result)
+{
+	Totals* totals = (Totals*)context;
+	totals->members++;
+	if (result == ZipArchive::EXTRACTED)
+		totals->bytes += size;
+	else if (result != ZipArchive::SKIPPED)
+		totals->failed++;
+	printf("  %-32s %8u %s\n", name, size, ZipArchive::ResultText(result));
+}
+
+int main(int argc, char** argv)
+{
+	const char* folder = ".";
+	bool ok = true;
+	int arg = 1;
+
+	if (arg + 1 < argc && strcmp(argv[arg], "-d") == 0)
+	{
+		folder = argv[arg + 1];
+		arg += 2;
+	}
+	if (arg == argc)
+	{
+		printf("usage: benchzip [-d folder] archive.zip ...\n");
+		return 1;
+	}
+
+	for (; arg < argc; ++arg)
+	{
+		Totals totals = { 0, 0, 0 };
+		printf("%s\n", argv[arg]);
+		u64 start = host_nanoseconds();
+		int extracted = ZipArchive::Extract(argv[arg], folder, Progress, &totals);
+		double ms = (host_nanoseconds() - start) / 1e6;
+		if (extracted < 0)
+		{
+			printf("  cannot read the archive\n");
+			ok = false;
+			continue;
+		}
+		printf("  %d of %u members extracted, %llu bytes in %.1fms (%.0f MB/s)\n", extracted, totals.members,
+			(unsigned long long)totals.bytes, ms, ms > 0 ? totals.bytes / ms / 1e3 : 0.0);
+		ok = ok && totals.failed == 0;
+	}
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,74 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "host.h"
+#include "../../src/iec_bus.h"
+
+// All lines released (pulled up) and no buttons pressed
+u32 host_gplev0 = 0xffffffff;
+
+void IEC_Bus::RefreshOuts1541(void)
+{
+    // There is no bus to drive; the output state stays in DataSetToOut/ClockSetToOut
+}
+
+void IEC_Bus::RefreshOutSound(void)
+{
+}
+
+void IEC_Bus::RefreshOutLED(void)
+{
+}
+
+u32 HashBuffer(const void* pBuffer, u32 length)
+{
+    u8* pu8Buffer = (u8*)pBuffer;
+    u32 hash = 0x811c9dc5U;
+
+    while (length)
+    {
+        hash ^= *pu8Buffer++;
+        hash *= 16777619U;
+        --length;
+    }
+    return hash;
+}
+
+u64 host_nanoseconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u64)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+u32 get_ticks(void)
+{
+    return (u32)(host_nanoseconds() / 1000);
+}
+
+extern "C" void SetACTLed(int v)
+{
+}
+
+extern "C" void usDelay(unsigned nMicroSeconds)
+{
+    struct timespec ts;
+    ts.tv_sec = nMicroSeconds / 1000000;
+    ts.tv_nsec = (nMicroSeconds % 1000000) * 1000;
+    nanosleep(&ts, 0);
+}
+
+void reboot_now(void)
+{
+    exit(0);
+}
+
+void Reboot_Pi(void)
+{
+    exit(0);
+}
+
+void not_implemented(const char *fn)
+{
+    printf("%s: not implemented on the host build\n", fn);
+}
@@ -0,0 +1,270 @@
+// FatFs API on top of stdio/dirent, so the core can load and save images from the host file system.
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <utime.h>
+#include <sys/stat.h>
+#include <time.h>
+#define HOST_FF_NO_DIR_ALIAS
+#include "ff.h"
+
+static FRESULT errno_to_fresult(void)
+{
+	switch (errno)
+	{
+		case ENOENT: return FR_NO_FILE;
+		case ENOTDIR: return FR_NO_PATH;
+		case EEXIST: return FR_EXIST;
+		case EACCES:
+		case EPERM: return FR_DENIED;
+		case EROFS: return FR_WRITE_PROTECTED;
+		case ENAMETOOLONG:
+		case EINVAL: return FR_INVALID_NAME;
+		case EMFILE:
+		case ENFILE: return FR_TOO_MANY_OPEN_FILES;
+		default: return FR_DISK_ERR;
+	}
+}
+
+static void stat_to_filinfo(const struct stat* st, const char* name, FILINFO* fno)
+{
+	struct tm tm;
+	localtime_r(&st->st_mtime, &tm);
+	fno->fsize = st->st_size;
+	fno->fdate = (WORD)(((tm.tm_year - 80) << 9) | ((tm.tm_mon + 1) << 5) | tm.tm_mday);
+	fno->ftime = (WORD)((tm.tm_hour << 11) | (tm.tm_min << 5) | (tm.tm_sec / 2));
+	fno->fattrib = 0;
+	if (S_ISDIR(st->st_mode))
+		fno->fattrib |= AM_DIR;
+	if ((st->st_mode & S_IWUSR) == 0)
+		fno->fattrib |= AM_RDO;
+	strncpy(fno->fname, name, _MAX_LFN);
+	fno->fname[_MAX_LFN] = 0;
+	strncpy(fno->altname, name, 12);
+	fno->altname[12] = 0;
+}
+
+FRESULT f_open(FIL* fp, const TCHAR* path, BYTE mode)
+{
+	const char* fmode;
+	struct stat st;
+	bool exists = stat(path, &st) == 0;
+
+	fp->fp = 0;
+	if ((mode & FA_CREATE_NEW) && exists)
+		return FR_EXIST;
+	if (!(mode & (FA_CREATE_NEW | FA_CREATE_ALWAYS | FA_OPEN_ALWAYS)) && !exists)
+		return FR_NO_FILE;
+	if (exists && S_ISDIR(st.st_mode))
+		return FR_DENIED;
+
+	if (mode & FA_CREATE_ALWAYS)
+		fmode = (mode & FA_READ) ? "w+b" : "wb";
+	else if (mode & FA_WRITE)
+		fmode = exists ? "r+b" : "w+b";
+	else
+		fmode = "rb";
+
+	FILE* f = fopen(path, fmode);
+	if (f == 0)
+		return errno_to_fresult();
+	fp->fp = f;
+	fp->flag = mode;
+	fp->err = 0;
+	fp->fptr = 0;
+	fp->objsize = (exists && !(mode & FA_CREATE_ALWAYS)) ? st.st_size : 0;
+	if ((mode & FA_OPEN_APPEND) == FA_OPEN_APPEND)
+		return f_lseek(fp, fp->objsize);
+	return FR_OK;
+}
+
+FRESULT f_close(FIL* fp)
+{
+	if (fp->fp == 0)
+		return FR_INVALID_OBJECT;
+	int res = fclose((FILE*)fp->fp);
+	fp->fp = 0;
+	return res == 0 ? FR_OK : FR_DISK_ERR;
+}
+
+FRESULT f_read(FIL* fp, void* buff, UINT btr, UINT* br)
+{
+	if (fp->fp == 0)
+		return FR_INVALID_OBJECT;
+	size_t n = fread(buff, 1, btr, (FILE*)fp->fp);
+	*br = (UINT)n;
+	fp->fptr += n;
+	if (n < btr && ferror((FILE*)fp->fp))
+		return FR_DISK_ERR;
+	return FR_OK;
+}
+
+FRESULT f_write(FIL* fp, const void* buff, UINT btw, UINT* bw)
+{
+	if (fp->fp == 0)
+		return FR_INVALID_OBJECT;
+	size_t n = fwrite(buff, 1, btw, (FILE*)fp->fp);
+	*bw = (UINT)n;
+	fp->fptr += n;
+	if (fp->fptr > fp->objsize)
+		fp->objsize = fp->fptr;
+	return n == btw ? FR_OK : FR_DISK_ERR;
+}
+
+FRESULT f_lseek(FIL* fp, FSIZE_t ofs)
+{
+	if (fp->fp == 0)
+		return FR_INVALID_OBJECT;
+	if (fseeko((FILE*)fp->fp, (off_t)ofs, SEEK_SET) != 0)
+		return FR_DISK_ERR;
+	fp->fptr = ofs;
+	if (ofs > fp->objsize && (fp->flag & FA_WRITE))
+		fp->objsize = ofs;
+	return FR_OK;
+}
+
+FRESULT f_sync(FIL* fp)
+{
+	if (fp->fp == 0)
+		return FR_INVALID_OBJECT;
+	return fflush((FILE*)fp->fp) == 0 ? FR_OK : FR_DISK_ERR;
+}
+
+FRESULT f_opendir(FF_DIR* dp, const TCHAR* path)
+{
+	dp->dp = opendir((path && *path) ? path : ".");
+	if (dp->dp == 0)
+		return errno == ENOENT ? FR_NO_PATH : errno_to_fresult();
+	strncpy(dp->path, (path && *path) ? path : ".", _MAX_LFN);
+	dp->path[_MAX_LFN] = 0;
+	return FR_OK;
+}
+
+FRESULT f_closedir(FF_DIR* dp)
+{
+	if (dp->dp == 0)
+		return FR_INVALID_OBJECT;
+	closedir((DIR*)dp->dp);
+	dp->dp = 0;
+	return FR_OK;
+}
+
+FRESULT f_readdir(FF_DIR* dp, FILINFO* fno)
+{
+	struct dirent* de;
+	char full[2 * (_MAX_LFN + 1)];
+	struct stat st;
+
+	if (dp->dp == 0)
+		return FR_INVALID_OBJECT;
+	if (fno == 0)
+	{
+		rewinddir((DIR*)dp->dp);
+		return FR_OK;
+	}
+	do
+	{
+		de = readdir((DIR*)dp->dp);
+	}
+	while (de && (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0));
+
+	if (de == 0)
+	{
+		fno->fname[0] = 0;	// end of directory
+		return FR_OK;
+	}
+	snprintf(full, sizeof(full), "%s/%s", dp->path, de->d_name);
+	if (stat(full, &st) != 0)
+		memset(&st, 0, sizeof(st));
+	stat_to_filinfo(&st, de->d_name, fno);
+	return FR_OK;
+}
+
+FRESULT f_mkdir(const TCHAR* path)
+{
+	return mkdir(path, 0777) == 0 ? FR_OK : errno_to_fresult();
+}
+
+FRESULT f_unlink(const TCHAR* path)
+{
+	struct stat st;
+	if (stat(path, &st) != 0)
+		return FR_NO_FILE;
+	if (S_ISDIR(st.st_mode))
+		return rmdir(path) == 0 ? FR_OK : FR_DENIED;
+	return unlink(path) == 0 ? FR_OK : errno_to_fresult();
+}
+
+FRESULT f_rename(const TCHAR* path_old, const TCHAR* path_new)
+{
+	struct stat st;
+	if (stat(path_new, &st) == 0)
+		return FR_EXIST;
+	return rename(path_old, path_new) == 0 ? FR_OK : errno_to_fresult();
+}
+
+FRESULT f_stat(const TCHAR* path, FILINFO* fno)
+{
+	struct stat st;
+	if (stat(path, &st) != 0)
+		return errno_to_fresult();
+	if (fno)
+	{
+		const char* name = strrchr(path, '/');
+		stat_to_filinfo(&st, name ? name + 1 : path, fno);
+	}
+	return FR_OK;
+}
+
+FRESULT f_chmod(const TCHAR* path, BYTE attr, BYTE mask)
+{
+	struct stat st;
+	if (stat(path, &st) != 0)
+		return errno_to_fresult();
+	if (mask & AM_RDO)
+	{
+		mode_t mode = st.st_mode & 0777;
+		mode = (attr & AM_RDO) ? (mode & ~0222) : (mode | S_IWUSR);
+		if (chmod(path, mode) != 0)
+			return errno_to_fresult();
+	}
+	return FR_OK;
+}
+
+FRESULT f_utime(const TCHAR* path, const FILINFO* fno)
+{
+	struct tm tm;
+	struct utimbuf ut;
+
+	memset(&tm, 0, sizeof(tm));
+	tm.tm_year = (fno->fdate >> 9) + 80;
+	tm.tm_mon = ((fno->fdate >> 5) & 15) - 1;
+	tm.tm_mday = fno->fdate & 31;
+	tm.tm_hour = fno->ftime >> 11;
+	tm.tm_min = (fno->ftime >> 5) & 63;
+	tm.tm_sec = (fno->ftime & 31) * 2;
+	tm.tm_isdst = -1;
+	ut.actime = ut.modtime = mktime(&tm);
+	return utime(path, &ut) == 0 ? FR_OK : errno_to_fresult();
+}
+
+FRESULT f_chdir(const TCHAR* path)
+{
+	return chdir(path) == 0 ? FR_OK : FR_NO_PATH;
+}
+
+FRESULT f_getcwd(TCHAR* buff, UINT len)
+{
+	return getcwd(buff, len) ? FR_OK : FR_NOT_ENOUGH_CORE;
+}
+
+FRESULT f_getlabel(const TCHAR* path, TCHAR* label, DWORD* vsn)
+{
+	if (label)
+		strcpy(label, "HOST");
+	if (vsn)
+		*vsn = 0;
+	return FR_OK;
+}
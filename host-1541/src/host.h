@@ -0,0 +1,28 @@
+#ifndef __HOST_H__
+#define __HOST_H__
+#include <stdint.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include "ff.h"
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int64_t s64;
+#define HAS_40PINS
+
+extern "C" {
+    void SetACTLed(int v);
+    void usDelay(unsigned nMicroSeconds);
+}
+void reboot_now(void);
+void Reboot_Pi(void);
+void not_implemented(const char *fn);
+u32 get_ticks(void);
+u64 host_nanoseconds(void);
+// Emulated level of all IEC/button lines as the 1541 would read them from GPLEV0
+extern u32 host_gplev0;
+
+#define __not_in_flash_func(a) a
+#endif /* __HOST_H__ */
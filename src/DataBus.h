@@ -0,0 +1,113 @@
+// Pi1541 - A Commodore 1541 disk drive emulator
+// Copyright(C) 2018 Stephen White
+//
+// This file is part of Pi1541.
+//
+// Pi1541 is free software : you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Pi1541 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Pi1541. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef DATABUS_H
+#define DATABUS_H
+
+#include "types.h"
+
+typedef u8(*DataBusPageReadFn)(u16 address);
+typedef void(*DataBusPageWriteFn)(u16 address, const u8 value);
+
+// A 6502 address space decoded in 256 byte pages.
+// Pages of RAM or ROM are accessed directly through a pointer.
+// Pages without one (chip selects, open bus, writes to ROM) go through a function instead.
+// The decoding the address logic of a drive does is worked out once when the pages are mapped rather than on every access.
+class DataBus
+{
+public:
+	DataBus()
+	{
+		MapOpenBus(0x0000, 0xffff);
+	}
+
+	inline u8 Read(u16 address)
+	{
+		const u8* memory = readPages[address >> 8];
+		if (memory) return memory[address & 0xff];
+		return readFns[address >> 8](address);
+	}
+
+	inline void Write(u16 address, const u8 value)
+	{
+		u8* memory = writePages[address >> 8];
+		if (memory) memory[address & 0xff] = value;
+		else writeFns[address >> 8](address, value);
+	}
+
+	// Pages from first to last (inclusive) read memory[address & mask].
+	// mask must keep the low 8 address bits.
+	void MapRead(u16 first, u16 last, const u8* memory, u16 mask)
+	{
+		for (unsigned page = first >> 8; page <= (unsigned)(last >> 8); ++page)
+			readPages[page] = memory + ((page << 8) & mask);
+	}
+
+	void MapWrite(u16 first, u16 last, u8* memory, u16 mask)
+	{
+		for (unsigned page = first >> 8; page <= (unsigned)(last >> 8); ++page)
+			writePages[page] = memory + ((page << 8) & mask);
+	}
+
+	void MapMemory(u16 first, u16 last, u8* memory, u16 mask)
+	{
+		MapRead(first, last, memory, mask);
+		MapWrite(first, last, memory, mask);
+	}
+
+	void MapROM(u16 first, u16 last, const u8* memory, u16 mask)
+	{
+		MapRead(first, last, memory, mask);
+		MapDevice(first, last, 0, IgnoreWrite);
+	}
+
+	// A null function leaves that direction as it is.
+	void MapDevice(u16 first, u16 last, DataBusPageReadFn readFn, DataBusPageWriteFn writeFn)
+	{
+		for (unsigned page = first >> 8; page <= (unsigned)(last >> 8); ++page)
+		{
+			if (readFn)
+			{
+				readPages[page] = 0;
+				readFns[page] = readFn;
+			}
+			if (writeFn)
+			{
+				writePages[page] = 0;
+				writeFns[page] = writeFn;
+			}
+		}
+	}
+
+	// Nothing is selected so the data bus floats and reads back the high byte of the address (the last byte fetched for an absolute address).
+	void MapOpenBus(u16 first, u16 last)
+	{
+		MapDevice(first, last, OpenBusRead, IgnoreWrite);
+	}
+
+	static u8 OpenBusRead(u16 address) { return address >> 8; }
+	static void IgnoreWrite(u16, const u8) {}
+
+private:
+	const u8* readPages[256];
+	u8* writePages[256];
+	DataBusPageReadFn readFns[256];
+	DataBusPageWriteFn writeFns[256];
+};
+
+#endif
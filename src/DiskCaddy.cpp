@@ -20,6 +20,7 @@
 #include <stdlib.h>
 #include "defs.h"
 #include "DiskCaddy.h"
+#include "ImageHash.h"
 #include "debug.h"
 #if !defined(__CIRCLE__)
 #if defined(__PICO2__) || defined(ESP32)
@@ -31,12 +32,32 @@ extern "C"
 {
 #include "rpi-gpio.h"	// For SetACTLed
 }
+#if !defined(__PICO2__) && !defined(ESP32)
+#include "rpiHardware.h"
+#endif
+#else
+#include <circle/timer.h>
 #endif
 
 extern u8 deviceID;
 
 static const u32 screenPosXCaddySelections = 240;
 static const u32 screenPosYCaddySelections = 280;
+static const UINT READ_CHUNK_SIZE = 64 * 1024;
+
+// For the mount timing in the log
+static inline u32 Microseconds()
+{
+#if defined(__CIRCLE__)
+	return CTimer::GetClockTicks();
+#elif defined(__PICO2__)
+	return time_us_32();
+#elif defined(ESP32)
+	return get_ticks();
+#else
+	return read32(ARM_SYSTIMER_CLO);
+#endif
+}
 static char buffer[256] = { 0 };
 static u32 white = RGBA(0xff, 0xff, 0xff, 0xff);
 static u32 red = RGBA(0xff, 0, 0, 0xff);
@@ -59,6 +80,10 @@ bool DiskCaddy::Empty()
 
 	for (index = 0; index < (int)disks.size(); ++index)
 	{
+#if defined(__CIRCLE__)
+		if (DiskImage::QueueWriteBack(disks[index]))
+			continue;
+#endif
 		if (disks[index]->IsDirty())
 		{
 			anyDirty = true;
@@ -124,6 +149,9 @@ bool DiskCaddy::Empty()
 	}
 
 	disks.clear();
+	DiskImage::FreeSpareTracks();
+	lastUsed.clear();
+	useCount = 0;
 	selectedIndex = 0;
 	oldCaddyIndex = 0;
 	return anyDirty;
@@ -135,6 +163,9 @@ bool DiskCaddy::Insert(const FILINFO* fileInfo, bool readOnly)
 	int y;
 	bool success;
 	FIL fp;
+#if defined(__CIRCLE__)
+	DiskImage::FlushWriteBacks();	// The image may be one that is still being saved
+#endif
 	FRESULT res = f_open(&fp, fileInfo->fname, FA_READ);
 	if (res == FR_OK)
 	{
@@ -167,14 +198,33 @@ bool DiskCaddy::Insert(const FILINFO* fileInfo, bool readOnly)
 			screenLCD->SwapBuffers();
 		}
 #endif
-		UINT bytesRead;
+		DiskImage::DiskType diskType = DiskImage::GetDiskImageTypeViaExtention(fileInfo->fname);
+		UINT size = f_size(&fp) < READBUFFER_SIZE ? (UINT)f_size(&fp) : READBUFFER_SIZE;
+		UINT bytesRead = 0;
+		UINT chunkRead;
+		ImageHash imageHash;
+		u32 start = Microseconds();
 		SetACTLed(true);
-		memset(DiskImage::readBuffer, 0xff, READBUFFER_SIZE);
-		f_read(&fp, DiskImage::readBuffer, READBUFFER_SIZE, &bytesRead);
+		// Each chunk is hashed while it is still in the cache
+		while (bytesRead < size)
+		{
+			UINT chunkSize = size - bytesRead < READ_CHUNK_SIZE ? size - bytesRead : READ_CHUNK_SIZE;
+			if (f_read(&fp, DiskImage::readBuffer + bytesRead, chunkSize, &chunkRead) != FR_OK || chunkRead == 0)
+				break;
+			imageHash.Update(DiskImage::readBuffer + bytesRead, chunkRead);
+			bytesRead += chunkRead;
+		}
 		SetACTLed(false);
 		f_close(&fp);
 
-		DiskImage::DiskType diskType = DiskImage::GetDiskImageTypeViaExtention(fileInfo->fname);
+		// Only as far as the parser for the type reads past the end of a short file
+		UINT parsedLength = DiskImage::ParsedLength(diskType);
+		if (parsedLength > READBUFFER_SIZE)
+			parsedLength = READBUFFER_SIZE;
+		if (bytesRead < parsedLength)
+			memset(DiskImage::readBuffer + bytesRead, 0xff, parsedLength - bytesRead);
+		u32 read = Microseconds();
+
 		switch (diskType)
 		{
 			case DiskImage::D64:
@@ -206,7 +256,13 @@ bool DiskCaddy::Insert(const FILINFO* fileInfo, bool readOnly)
 		}
 		if (success)
 		{
-			DEBUG_LOG("Mounted into caddy %s - %d\r\n", fileInfo->fname, bytesRead);
+			u64 hash = imageHash.Final();
+			u32 decoded = Microseconds();
+			disks.back()->SetHash(hash);
+			DEBUG_LOG("Mounted into caddy %s - %d %08x%08x, read %dms, decode %dms\r\n", fileInfo->fname, bytesRead,
+				(unsigned)(hash >> 32), (unsigned)hash, (read - start) / 1000, (decoded - read) / 1000);
+			if (imagesExpanded && disks.size() > imagesExpanded)
+				disks.back()->Pack();
 		}
 	}
 	else
@@ -321,6 +377,53 @@ bool DiskCaddy::InsertPRG(const FILINFO* fileInfo, unsigned char* diskImageData,
 	return false;
 }
 
+unsigned DiskCaddy::swaps = 0;
+unsigned DiskCaddy::swapMicroseconds = 0;
+unsigned DiskCaddy::maxSwapMicroseconds = 0;
+
+// Packs the images that are no longer among the imagesExpanded used most recently and gets the selected one ready.
+// Its tracks are only expanded as the drive reaches them.
+// This runs in the emulator loop when disks are swapped, so on Circle the packing is left to the idle core.
+void DiskCaddy::Activate()
+{
+	if (lastUsed.size() != disks.size())
+		lastUsed.resize(disks.size(), 0);
+	if (useCount && lastUsed[selectedIndex] == useCount)
+		return;
+	lastUsed[selectedIndex] = ++useCount;
+	u32 start = Microseconds();
+
+	for (unsigned index = 0; index < disks.size(); ++index)
+	{
+		if (index == selectedIndex || disks[index]->IsPacked())
+			continue;
+
+		unsigned newer = 0;
+		for (unsigned other = 0; other < disks.size(); ++other)
+		{
+			if (lastUsed[other] > lastUsed[index])
+				newer++;
+		}
+		if (newer >= imagesExpanded)
+		{
+#if defined(__CIRCLE__)
+			disks[index]->QueuePack();
+#else
+			disks[index]->Pack();
+#endif
+		}
+	}
+
+	if (!disks[selectedIndex]->Unpack())
+		DEBUG_LOG("Cannot expand %s\r\n", disks[selectedIndex]->GetName());
+
+	u32 elapsed = Microseconds() - start;
+	swapMicroseconds += elapsed;
+	if (elapsed > maxSwapMicroseconds)
+		maxSwapMicroseconds = elapsed;
+	swaps++;
+}
+
 void DiskCaddy::Display()
 {
 	unsigned numberOfImages = GetNumberOfImages();
@@ -34,6 +34,8 @@ public:
 #endif
 		, screenLCD(0)
 		, roms(0)
+		, imagesExpanded(0)
+		, useCount(0)
 	{
 	}
 	void SetScreen(Screen* screen, ScreenBase* screenLCD, ROMs* roms)
@@ -45,6 +47,14 @@ public:
 		this->roms = roms;
 	}
 
+	// 0 keeps every image expanded. Otherwise only this many of the images used most recently are (at least 2 as
+	// the drive is still reading the image being swapped out) and the others have their tracks compressed.
+	// The track memory of the last image compressed is kept for the next one to be expanded.
+	void SetCompression(unsigned imagesExpanded)
+	{
+		this->imagesExpanded = (imagesExpanded && imagesExpanded < 2) ? 2 : imagesExpanded;
+	}
+
 	bool Empty();
 
 	bool Insert(const FILINFO* fileInfo, bool readOnly);
@@ -55,7 +65,11 @@ public:
 		Update();
 #endif
 		if (selectedIndex < disks.size())
+		{
+			if (imagesExpanded)
+				Activate();
 			return disks[selectedIndex];
+		}
 
 		return 0;
 	}
@@ -100,6 +114,11 @@ public:
 	void Display();
 	bool Update();
 
+	// How long selecting an image took with compression on (expanding the first track is counted by DiskImage).
+	static unsigned Swaps() { return swaps; }
+	static unsigned SwapMicroseconds() { return swapMicroseconds; }	// In total
+	static unsigned MaxSwapMicroseconds() { return maxSwapMicroseconds; }
+
 private:
 	bool InsertD64(const FILINFO* fileInfo, unsigned char* diskImageData, unsigned size, bool readOnly);
 	bool InsertG64(const FILINFO* fileInfo, unsigned char* diskImageData, unsigned size, bool readOnly);
@@ -110,6 +129,7 @@ private:
 	bool InsertPRG(const FILINFO* fileInfo, unsigned char* diskImageData, unsigned size, bool readOnly);
 
 	void ShowSelectedImage(u32 index);
+	void Activate();
 
 	std::vector<DiskImage*> disks;
 	u32 selectedIndex;
@@ -119,6 +139,14 @@ private:
 #endif
 	ScreenBase* screenLCD;
 	ROMs* roms;
+
+	unsigned imagesExpanded;
+	std::vector<u32> lastUsed;	// useCount when each image was last selected
+	u32 useCount;
+
+	static unsigned swaps;
+	static unsigned swapMicroseconds;
+	static unsigned maxSwapMicroseconds;
 };
 
 #endif
@@ -24,10 +24,16 @@
 #include "debug.h"
 #include <string.h>
 #include <ctype.h>
+#include <stddef.h>
 #include "lz.h"
+#include "ImageHash.h"
 #include "Petscii.h"
 #include <malloc.h>
-#if !defined (__CIRCLE__) && !defined(__PICO2__) && !defined(ESP32)
+#if defined(__CIRCLE__)
+#include <circle/spinlock.h>
+#include <circle/timer.h>
+#endif
+#if !defined (__CIRCLE__) && !defined(__PICO2__) && !defined(ESP32) && !defined(__HOST__)
 extern "C"
 {
 #include "rpi-gpio.h"
@@ -82,6 +88,13 @@ static const int SECTOR_HEADER_LENGTH = 8;
 static const unsigned MAX_D64_SIZE = 0x32200 + 768;
 static const unsigned MAX_D71_SIZE = 0x55600 + 1366;
 static const unsigned MAX_D81_SIZE = 822400;
+static const unsigned G64_HEADER_LENGTH = 12 + HALF_TRACK_COUNT * 4 * 2;	// Signature then each half track's offset and speed zone
+
+// The MFM track OpenD81 builds for each side: a gap then a header and the data for each of the 10 physical sectors.
+static const unsigned D81_HEADER_LENGTH = 12 + 3 + 1 + 4 + 2 + 22;	// SYNC, 3xA1, FE, track/head/sector/size, crc, gap2
+static const unsigned D81_DATA_MARK_LENGTH = 12 + 3 + 1;				// SYNC, 3xA1, FB
+static const unsigned D81_PHYSICAL_SECTOR_LENGTH = D81_HEADER_LENGTH + D81_DATA_MARK_LENGTH + D81_SECTOR_LENGTH + 2 + 35;	// + crc, gap3
+static const unsigned D81_TRACK_LENGTH = 32 + 10 * D81_PHYSICAL_SECTOR_LENGTH;
 
 static const unsigned short GCR_SYNC_LENGTH = 5;
 static const unsigned short GCR_HEADER_LENGTH = 10;
@@ -166,83 +179,215 @@ DiskImage::DiskImage()
 	, dirty(false)
 	, attachedImageSize(0)
 	, fileInfo(0)
+	, hash(0)
+	, legacyHash(0)
+	, trackArena(0)
+	, trackArenaSize(0)
+	, packed(false)
+	, hasPackedTracks(false)
 {
-#if defined(__PICO2__) || defined(ESP32)
-#if defined(HAS_PSRAM)	
-	tracks = static_cast<unsigned char *>(pmalloc(HALF_TRACK_COUNT * MAX_TRACK_LENGTH * sizeof(unsigned char)));
-	plfio_showstat();
-#else	
-	DiskImage::tracks = new unsigned char[HALF_TRACK_COUNT * MAX_TRACK_LENGTH]();
-#endif	
-#endif
-	memset(tracks, 0x55, sizeof(tracks));
+	memset(tracks, 0, sizeof(tracks));
+	memset(trackLengths, 0, sizeof(trackLengths));
+	memset(trackDensity, 0, sizeof(trackDensity));
 	memset(trackUsed, 0, sizeof(trackUsed));
+	memset(trackDirty, 0, sizeof(trackDirty));
+	memset(trackEncoding, 0, sizeof(trackEncoding));
+	tracksToEncode = 0;
+	memset(sectorsIndexed, 0, sizeof(sectorsIndexed));
+	memset(packedTracks, 0, sizeof(packedTracks));
+	memset(packedLengths, 0, sizeof(packedLengths));
+#if defined(__CIRCLE__)
+	nextBackground = 0;
+	backgroundTrack = 0;
+	nextPack = 0;
+	packTrack = 0;
+	packQueued = false;
+	nextWriteBack = 0;
+#endif
 }
 
 DiskImage::~DiskImage()
 {
-#if defined(__PICO2__) || defined(ESP32)
-#if defined(HAS_PSRAM)	
-	free(tracks);
+#if defined(__CIRCLE__)
+	CancelBackgroundEncoding();
+	CancelPack();
+#endif
+	FreeTracks();
+	FreePackedTracks();
+}
+
+static unsigned char* NewTrackMemory(unsigned size)
+{
+#if defined(HAS_PSRAM)
+	return static_cast<unsigned char *>(pmalloc(size));
+#else
+	return new unsigned char[size];
+#endif
+}
+
+static void DeleteTrackMemory(unsigned char* memory)
+{
+#if defined(HAS_PSRAM)
+	free(memory);
 #else
-	delete[] tracks;
-#endif	
+	delete[] memory;
+#endif
+}
+
+#if defined(__CIRCLE__)
+// Guards the background work lists and what packing shares (the idle core packs and encodes, the emulator core swaps).
+static CSpinLock backgroundLock(TASK_LEVEL);
+#endif
+
+// Track memory of the last image packed, kept for the next image to be unpacked so a disk swap need not allocate.
+static unsigned char* spareArena = 0;
+static unsigned spareArenaSize = 0;
+
+static unsigned char* TakeSpareArena(unsigned size)
+{
+	unsigned char* arena = 0;
+#if defined(__CIRCLE__)
+	backgroundLock.Acquire();
 #endif
+	if (spareArena && spareArenaSize >= size)
+	{
+		arena = spareArena;
+		spareArena = 0;
+		spareArenaSize = 0;
+	}
+#if defined(__CIRCLE__)
+	backgroundLock.Release();
+#endif
+	return arena;
+}
+
+void DiskImage::FreeSpareTracks()
+{
+#if defined(__CIRCLE__)
+	backgroundLock.Acquire();
+#endif
+	if (spareArena)
+		DeleteTrackMemory(spareArena);
+	spareArena = 0;
+	spareArenaSize = 0;
+#if defined(__CIRCLE__)
+	backgroundLock.Release();
+#endif
+}
+
+// Lays out one allocation with a piece the size of each track that has a length and fills it.
+// Call once trackLengths[] is set and before any track data is written.
+// Without fillTracks only the blank track is filled (the tracks are about to be overwritten anyway).
+bool DiskImage::AllocateTracks(unsigned char fill, bool fillTracks)
+{
+	unsigned size = MAX_TRACK_LENGTH;	// The shared blank track
+	unsigned track;
+
+	FreeTracks();
+	for (track = 0; track < HALF_TRACK_COUNT; ++track)
+		size += trackLengths[track];
+
+	trackArena = TakeSpareArena(size);
+	if (!trackArena)
+		trackArena = NewTrackMemory(size);
+	if (!trackArena)
+	{
+		DEBUG_LOG("Cannot allocate %d bytes of track data\r\n", size);
+		return false;
+	}
+	trackArenaSize = size;
+
+	unsigned char* data = trackArena;
+	unsigned char* blank = trackArena + size - MAX_TRACK_LENGTH;
+	if (fillTracks)
+		memset(trackArena, fill, size);
+	else
+		memset(blank, fill, MAX_TRACK_LENGTH);
+	for (track = 0; track < HALF_TRACK_COUNT; ++track)
+	{
+		if (trackLengths[track])
+		{
+			tracks[track] = data;
+			data += trackLengths[track];
+		}
+		else
+		{
+			tracks[track] = blank;
+		}
+	}
+	return true;
+}
+
+void DiskImage::FreeTracks()
+{
+	if (!trackArena)
+		return;
+
+	DeleteTrackMemory(trackArena);
+	trackArena = 0;
+	trackArenaSize = 0;
+	memset(tracks, 0, sizeof(tracks));
 }
 
 void DiskImage::Close()
 {
+#if defined(__CIRCLE__)
+	CancelBackgroundEncoding();
+	CancelPack();
+#endif
+	if (dirty && hasPackedTracks)
+	{
+		// Saving reads the tracks directly
+		if (Unpack())
+			EncodeAllTracks();
+	}
 	switch (diskType)
 	{
 		case D64:
 			CloseD64();
-			memset(tracks, 0x55, sizeof(tracks));
 		break;
 		case G64:
 			CloseG64();
-			memset(tracks, 0x55, sizeof(tracks));
 		break;
 		case NIB:
 			CloseNIB();
-			memset(tracks, 0x55, sizeof(tracks));
 		break;
 		case NBZ:
 			CloseNBZ();
-			memset(tracks, 0x55, sizeof(tracks));
 		break;
 #if defined (PI1581SUPPORT)		
 		case D71:
 			CloseD71();
-			memset(tracksD81, 0x55, sizeof(tracksD81));
 		break;
 		case D81:
 			CloseD81();
-			memset(tracksD81, 0, sizeof(tracksD81));
 		break;
 #endif		
 		case T64:
 			CloseT64();
-			memset(tracks, 0x55, sizeof(tracks));
 		break;
 		default:
-			memset(tracks, 0x55, sizeof(tracks));
 		break;
 	}
+	FreeTracks();
+	FreePackedTracks();
 	memset(trackLengths, 0, sizeof(trackLengths));
 	memset(trackUsed, 0, sizeof(trackUsed));
+	memset(trackDirty, 0, sizeof(trackDirty));
+	memset(trackEncoding, 0, sizeof(trackEncoding));
+	tracksToEncode = 0;
+	memset(sectorsIndexed, 0, sizeof(sectorsIndexed));
 	diskType = NONE;
 	fileInfo = 0;
 	hash = 0;
+	legacyHash = 0;
 }
 
 void DiskImage::DumpTrack(unsigned track)
 {
+	EncodeTrack(track);
 
-#if defined(EXPERIMENTALZERO)
-	unsigned char* src = &tracks[track << 13];
-#else
 	unsigned char* src = tracks[track];
-#endif
 	unsigned trackLength = trackLengths[track];
 	DEBUG_LOG("track = %d trackLength = %d\r\n", track, trackLength);
 	for (unsigned index = 0; index < trackLength; ++index)
@@ -253,13 +398,10 @@ void DiskImage::DumpTrack(unsigned track)
 
 bool DiskImage::OpenD64(const FILINFO* fileInfo, unsigned char* diskImage, unsigned size)
 {
-	unsigned char errorinfo[MAXBLOCKSONDISK];
+	unsigned char errorinfo[MAXBLOCKSONDISK + 2 * 17];	// Room for the non-standard 42 track images
 	unsigned last_track;
 	unsigned sector_ref;
 	unsigned sectors;
-	unsigned speedZoneIndex;
-	unsigned sectorSize;
-	unsigned char error;
 
 	Close();
 
@@ -295,17 +437,16 @@ bool DiskImage::OpenD64(const FILINFO* fileInfo, unsigned char* diskImage, unsig
 			break;
 	}
 
+	for (unsigned halfTrackIndex = 0; halfTrackIndex < last_track * 2; ++halfTrackIndex)
+		trackLengths[halfTrackIndex] = trackSize[GetSpeedZoneIndexD64(halfTrackIndex >> 1)];
+	if (!AllocateTracks(0x55))
+		return false;
+
+	memcpy(diskID, diskImage + 0x165A2, sizeof(diskID));
 	sector_ref = 0;
 	for (unsigned halfTrackIndex = 0; halfTrackIndex < last_track * 2; ++halfTrackIndex)
 	{
 		unsigned char track = (halfTrackIndex >> 1);
-#if defined(EXPERIMENTALZERO)
-		unsigned char* dest = &tracks[halfTrackIndex << 13];
-#else
-		unsigned char* dest = tracks[halfTrackIndex];
-#endif
-
-		trackLengths[halfTrackIndex] = trackSize[GetSpeedZoneIndexD64(track)];
 
 		if ((halfTrackIndex & 1) == 0)
 		{
@@ -313,17 +454,10 @@ bool DiskImage::OpenD64(const FILINFO* fileInfo, unsigned char* diskImage, unsig
 			{
 				trackUsed[halfTrackIndex] = true;
 				//DEBUG_LOG("Track %d used\r\n", halfTrackIndex);
-				speedZoneIndex = GetSpeedZoneIndexD64(track);
-				sectors = sectorsPerTrack[speedZoneIndex];
-				sectorSize = GCR_SYNC_LENGTH + GCR_HEADER_LENGTH + GCR_HEADER_GAP_LENGTH + GCR_SYNC_LENGTH + GCR_SECTOR_DATA_LENGTH + gapSize[speedZoneIndex];
-
-				for (unsigned sectorNo = 0; sectorNo < sectors; ++sectorNo)
-				{
-					error = errorinfo[sector_ref++];
-					convert_sector_to_GCR(diskImage + offset, dest, track + 1, sectorNo, diskImage + 0x165A2, error, sectorSize);
-					dest += sectorSize;
-					offset += SECTOR_LENGTH;
-				}
+				sectors = sectorsPerTrack[GetSpeedZoneIndexD64(track)];
+				ParkD64Track(track, diskImage + offset, errorinfo + sector_ref);
+				sector_ref += sectors;
+				offset += sectors * SECTOR_LENGTH;
 			}
 			else
 			{
@@ -338,10 +472,507 @@ bool DiskImage::OpenD64(const FILINFO* fileInfo, unsigned char* diskImage, unsig
 		}
 	}
 
+	tracksToEncode = last_track;
+#if defined(__CIRCLE__)
+	QueueBackgroundEncoding();
+#endif
+
 	diskType = D64;
 	return true;
 }
 
+// Parks the sectors of a D64/D71 track (and their error codes) in the unused half track above it until EncodeD64Track() is needed.
+// The drive never sees them as anything reading the half track encodes the track first.
+void DiskImage::ParkD64Track(unsigned track, const unsigned char* sectors, const unsigned char* errors)
+{
+	unsigned count = sectorsPerTrack[GetSpeedZoneIndexD64(track)];
+	unsigned char* parked = TrackData(track * 2 + 1);
+
+	memcpy(parked, sectors, count * SECTOR_LENGTH);
+	memcpy(parked + count * SECTOR_LENGTH, errors, count);
+	trackEncoding[track] = TRACK_PENDING;
+}
+
+void DiskImage::EncodeD64Track(unsigned track)
+{
+	unsigned speedZoneIndex = GetSpeedZoneIndexD64(track);
+	unsigned sectors = sectorsPerTrack[speedZoneIndex];
+	unsigned sectorSize = GCR_SYNC_LENGTH + GCR_HEADER_LENGTH + GCR_HEADER_GAP_LENGTH + GCR_SYNC_LENGTH + GCR_SECTOR_DATA_LENGTH + gapSize[speedZoneIndex];
+	unsigned char* parked = TrackData(track * 2 + 1);
+	unsigned char* dest = TrackData(track * 2);
+
+	for (unsigned sectorNo = 0; sectorNo < sectors; ++sectorNo)
+	{
+		convert_sector_to_GCR(parked + sectorNo * SECTOR_LENGTH, dest, track + 1, sectorNo, diskID, parked[sectors * SECTOR_LENGTH + sectorNo], sectorSize);
+		dest += sectorSize;
+	}
+	memset(parked, 0x55, trackLengths[track * 2 + 1]);	// Back to an unformatted half track
+}
+
+void DiskImage::EncodePendingTrack(unsigned track)
+{
+	unsigned state = __atomic_load_n(&trackEncoding[track], __ATOMIC_ACQUIRE);
+#if defined(__CIRCLE__)
+	if (state == TRACK_ENCODING || !__atomic_compare_exchange_n(&trackEncoding[track], &state, TRACK_ENCODING, false, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE))
+	{
+		// Already encoded or the background encoder is part way through it.
+		while (__atomic_load_n(&trackEncoding[track], __ATOMIC_ACQUIRE) != TRACK_ENCODED)
+			;
+		return;
+	}
+#endif
+	if (state == TRACK_PACKED)
+	{
+		ExpandTrack(track);
+		state = packedEncoding[track];
+	}
+	if (state == TRACK_PENDING)
+		EncodeD64Track(track);
+	sectorsIndexed[track] = false;
+	__atomic_store_n(&trackEncoding[track], TRACK_ENCODED, __ATOMIC_RELEASE);
+}
+
+void DiskImage::EncodeAllTracks()
+{
+	for (unsigned track = 0; track < tracksToEncode; ++track)
+		EncodeTrack(track * 2);
+}
+
+unsigned DiskImage::packedTrackBytes = 0;
+unsigned DiskImage::packedBytes = 0;
+unsigned DiskImage::tracksExpanded = 0;
+unsigned DiskImage::expandTicks = 0;
+
+// Shared by whichever core is packing (under backgroundLock on Circle).
+static unsigned char packBuffer[MAX_TRACK_LENGTH + MAX_TRACK_LENGTH / 256 + 1];
+static unsigned packHash[LZ_HASH_SIZE];
+
+bool DiskImage::Pack()
+{
+	if (packed)
+		return true;
+	if (!trackArena || diskType == D81)
+		return false;
+
+#if defined(__CIRCLE__)
+	CancelBackgroundEncoding();
+	CancelPack();
+	backgroundLock.Acquire();
+#endif
+	bool success = true;
+	for (unsigned track = 0; success && track < HALF_TRACK_COUNT / 2; ++track)
+		success = PackTrack(track);
+	if (success)
+		FinishPack();	// Otherwise the image is left expanded
+#if defined(__CIRCLE__)
+	backgroundLock.Release();
+#endif
+	return success;
+}
+
+// Brings the compressed copy of a track up to date. Returns false if there is no memory for it.
+bool DiskImage::PackTrack(unsigned track)
+{
+	unsigned halfTrack = track * 2;
+	if (!trackLengths[halfTrack] && !trackLengths[halfTrack + 1])
+		return true;
+	if (trackEncoding[track] == TRACK_PACKED)
+		return true;	// Not expanded since it was last packed
+
+	// Tracks read since the last time still match their copy (even if it holds a D64 track not yet encoded).
+	bool keep = !trackDirty[halfTrack] && !trackDirty[halfTrack + 1];
+	for (unsigned half = halfTrack; half < halfTrack + 2; ++half)
+	{
+		if (trackLengths[half] && !packedTracks[half])
+			keep = false;
+	}
+	if (keep)
+		return true;
+
+	for (unsigned half = halfTrack; half < halfTrack + 2; ++half)
+	{
+		unsigned length = trackLengths[half];
+		if (!length)
+			continue;
+
+		if (packedTracks[half])
+		{
+			DeleteTrackMemory(packedTracks[half]);
+			packedTrackBytes -= length;
+			packedBytes -= packedLengths[half];
+		}
+
+		unsigned size = LZ_CompressHash(tracks[half], packBuffer, length, packHash);
+		unsigned char* source = packBuffer;
+		if (size >= length)
+		{
+			size = length;
+			source = tracks[half];
+		}
+		packedTracks[half] = NewTrackMemory(size);
+		if (!packedTracks[half])
+		{
+			DEBUG_LOG("Cannot allocate %d bytes to pack track\r\n", size);
+			packedLengths[half] = 0;
+			return false;
+		}
+		memcpy(packedTracks[half], source, size);
+		packedLengths[half] = size;
+		hasPackedTracks = true;
+		packedTrackBytes += length;
+		packedBytes += size;
+	}
+	packedEncoding[track] = trackEncoding[track];
+	return true;
+}
+
+// Once every track has its copy, switches the image over to them and gives up its track memory.
+void DiskImage::FinishPack()
+{
+	unsigned trackBytes = 0;
+	unsigned compressedBytes = 0;
+	for (unsigned track = 0; track < HALF_TRACK_COUNT / 2; ++track)
+	{
+		unsigned halfTrack = track * 2;
+		if (!trackLengths[halfTrack] && !trackLengths[halfTrack + 1])
+			continue;
+
+		trackEncoding[track] = TRACK_PACKED;
+		for (unsigned half = halfTrack; half < halfTrack + 2; ++half)
+		{
+			trackBytes += trackLengths[half];
+			compressedBytes += packedLengths[half];
+		}
+	}
+
+	if (!spareArena || spareArenaSize < trackArenaSize)
+	{
+		if (spareArena)
+			DeleteTrackMemory(spareArena);
+		spareArena = trackArena;
+		spareArenaSize = trackArenaSize;
+		trackArena = 0;
+		trackArenaSize = 0;
+		memset(tracks, 0, sizeof(tracks));
+	}
+	FreeTracks();
+	tracksToEncode = HALF_TRACK_COUNT / 2;
+	packed = true;
+	DEBUG_LOG("Packed %d bytes of tracks into %d\r\n", trackBytes, compressedBytes);
+}
+
+bool DiskImage::Unpack()
+{
+#if defined(__CIRCLE__)
+	CancelPack();
+#endif
+	if (!packed)
+		return true;
+
+	if (!AllocateTracks(0x55, false))
+		return false;
+	packed = false;
+	return true;
+}
+
+void DiskImage::ExpandTrack(unsigned track)
+{
+#if defined(__CIRCLE__)
+	unsigned start = CTimer::GetClockTicks();
+#endif
+	for (unsigned halfTrack = track * 2; halfTrack < track * 2 + 2; ++halfTrack)
+	{
+		unsigned length = trackLengths[halfTrack];
+		if (!length)
+			continue;
+
+		if (packedLengths[halfTrack] == length)
+			memcpy(tracks[halfTrack], packedTracks[halfTrack], length);
+		else
+			LZ_Uncompress(packedTracks[halfTrack], tracks[halfTrack], packedLengths[halfTrack]);
+	}
+	tracksExpanded++;
+#if defined(__CIRCLE__)
+	expandTicks += CTimer::GetClockTicks() - start;
+#endif
+}
+
+void DiskImage::FreePackedTracks()
+{
+	packed = false;
+	if (!hasPackedTracks)
+		return;
+
+	for (unsigned halfTrack = 0; halfTrack < HALF_TRACK_COUNT; ++halfTrack)
+	{
+		if (packedTracks[halfTrack])
+		{
+			DeleteTrackMemory(packedTracks[halfTrack]);
+			packedTracks[halfTrack] = 0;
+			packedTrackBytes -= trackLengths[halfTrack];
+			packedBytes -= packedLengths[halfTrack];
+			packedLengths[halfTrack] = 0;
+		}
+	}
+	hasPackedTracks = false;
+}
+
+#if defined(__CIRCLE__)
+bool DiskImage::backgroundEncoding = false;
+static DiskImage* backgroundImages = 0;	// Images with tracks left to encode (most recently opened first)
+
+void DiskImage::QueueBackgroundEncoding()
+{
+	if (!backgroundEncoding)
+		return;
+
+	backgroundTrack = 0;
+	backgroundLock.Acquire();
+	nextBackground = backgroundImages;
+	backgroundImages = this;
+	backgroundLock.Release();
+}
+
+void DiskImage::CancelBackgroundEncoding()
+{
+	if (!backgroundEncoding)
+		return;
+
+	backgroundLock.Acquire();	// Also waits for a track that is being encoded
+	for (DiskImage** link = &backgroundImages; *link; link = &(*link)->nextBackground)
+	{
+		if (*link == this)
+		{
+			*link = nextBackground;
+			break;
+		}
+	}
+	backgroundLock.Release();
+}
+
+// Encodes one pending track of any open image. Returns false when there are none left.
+bool DiskImage::EncodeInBackground()
+{
+	bool encoded = false;
+
+	backgroundLock.Acquire();
+	while (!encoded && backgroundImages)
+	{
+		DiskImage* image = backgroundImages;
+		if (image->backgroundTrack >= image->tracksToEncode)
+		{
+			backgroundImages = image->nextBackground;
+			continue;
+		}
+
+		unsigned track = image->backgroundTrack++;
+		unsigned pending = TRACK_PENDING;
+		if (__atomic_compare_exchange_n(&image->trackEncoding[track], &pending, TRACK_ENCODING, false, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE))
+		{
+			image->EncodeD64Track(track);
+			__atomic_store_n(&image->trackEncoding[track], TRACK_ENCODED, __ATOMIC_RELEASE);
+			encoded = true;
+		}
+	}
+	backgroundLock.Release();
+	return encoded;
+}
+
+static DiskImage* packImages = 0;	// Caddy images waiting to be packed (most recently swapped out first)
+
+void DiskImage::QueuePack()
+{
+	if (diskType == D81 || __atomic_load_n(&packQueued, __ATOMIC_ACQUIRE))
+		return;
+
+	CancelBackgroundEncoding();
+	backgroundLock.Acquire();
+	if (!packed && trackArena)
+	{
+		packTrack = 0;
+		nextPack = packImages;
+		packImages = this;
+		__atomic_store_n(&packQueued, true, __ATOMIC_RELEASE);
+	}
+	backgroundLock.Release();
+}
+
+void DiskImage::CancelPack()
+{
+	if (!__atomic_load_n(&packQueued, __ATOMIC_ACQUIRE))
+		return;
+
+	backgroundLock.Acquire();	// Also waits for a track that is being packed
+	for (DiskImage** link = &packImages; *link; link = &(*link)->nextPack)
+	{
+		if (*link == this)
+		{
+			*link = nextPack;
+			break;
+		}
+	}
+	__atomic_store_n(&packQueued, false, __ATOMIC_RELEASE);
+	backgroundLock.Release();
+}
+
+// Packs one track of a queued image, or finishes packing it. Returns false when there are none queued.
+bool DiskImage::PackInBackground()
+{
+	backgroundLock.Acquire();
+	DiskImage* image = packImages;
+	if (image)
+	{
+		bool done = image->packTrack >= HALF_TRACK_COUNT / 2;
+		if (done)
+			image->FinishPack();
+		else if (!image->PackTrack(image->packTrack++))
+			done = true;	// Out of memory so leave it expanded
+		if (done)
+		{
+			packImages = image->nextPack;
+			__atomic_store_n(&image->packQueued, false, __ATOMIC_RELEASE);
+		}
+	}
+	backgroundLock.Release();
+	return image != 0;
+}
+
+unsigned DiskImage::writeBacksQueued = 0;
+unsigned DiskImage::writeBacksFlushed = 0;
+static DiskImage* writeBackImages = 0;	// Oldest first
+static DiskImage** writeBackTail = &writeBackImages;
+
+bool DiskImage::QueueWriteBack(DiskImage* diskImage)
+{
+	if (!diskImage->IsDirty() || !diskImage->fileInfo)
+		return false;
+
+	// The name is relative to the folder the image came from and the browser may be elsewhere by the time it is saved.
+	FILINFO& info = diskImage->writeBackFileInfo;
+	const char* name = diskImage->fileInfo->fname;
+	info = *diskImage->fileInfo;
+	if (name[0] != '/' && !strchr(name, ':'))
+	{
+		char folder[sizeof(info.fname)];
+		if (f_getcwd(folder, sizeof(folder)) != FR_OK)
+			return false;	// Saved straight away instead
+		size_t length = strlen(folder);
+		const char* separator = (length && folder[length - 1] == '/') ? "" : "/";
+		if (snprintf(info.fname, sizeof(info.fname), "%s%s%s", folder, separator, name) >= (int)sizeof(info.fname))
+			return false;
+	}
+
+	diskImage->CancelPack();	// It is about to be saved
+	diskImage->fileInfo = &info;
+	diskImage->nextWriteBack = 0;
+
+	backgroundLock.Acquire();
+	*writeBackTail = diskImage;
+	writeBackTail = &diskImage->nextWriteBack;
+	__atomic_add_fetch(&writeBacksQueued, 1, __ATOMIC_RELEASE);
+	backgroundLock.Release();
+	return true;
+}
+
+// Saves the oldest queued image. Returns false if there were none.
+bool DiskImage::WriteBackNext()
+{
+	backgroundLock.Acquire();
+	DiskImage* diskImage = writeBackImages;
+	if (diskImage)
+	{
+		writeBackImages = diskImage->nextWriteBack;
+		if (!writeBackImages)
+			writeBackTail = &writeBackImages;
+	}
+	backgroundLock.Release();
+
+	if (!diskImage)
+		return false;
+
+	DEBUG_LOG("Writing back %s\r\n", diskImage->fileInfo->fname);
+	diskImage->Close();
+	delete diskImage;
+	__atomic_add_fetch(&writeBacksFlushed, 1, __ATOMIC_RELEASE);
+	return true;
+}
+
+void DiskImage::FlushWriteBacks()
+{
+	while (WriteBackNext())
+		;
+}
+#endif
+
+// Writes the sectors of the dirty tracks that differ from the file back in place.
+// Returns false if the file no longer has room for every used track and so needs rewriting in full.
+bool DiskImage::UpdateD64()
+{
+	unsigned char fileData[MAX_SECTORS_PER_TRACK * SECTOR_LENGTH];
+	unsigned char sectorData[SECTOR_LENGTH];
+	unsigned track, sector, sectors;
+	unsigned offset = 0;
+	unsigned sectorsWritten = 0;
+	UINT bytesRead;
+	UINT bytesWritten;
+
+	for (track = 0; track < HALF_TRACK_COUNT; track += 2)
+	{
+		if (trackUsed[track])
+			offset += sectorsPerTrack[GetSpeedZoneIndexD64(track >> 1)] * SECTOR_LENGTH;
+	}
+	if (offset > attachedImageSize)
+		return false;
+
+	FIL fp;
+	if (f_open(&fp, fileInfo->fname, FA_READ | FA_WRITE) != FR_OK)
+		return false;
+
+	DEBUG_LOG("Updating D64 file...\r\n");
+
+	SetACTLed(true);
+	offset = 0;
+	for (track = 0; track < HALF_TRACK_COUNT; track += 2)
+	{
+		if (!trackUsed[track])
+			continue;
+
+		sectors = sectorsPerTrack[GetSpeedZoneIndexD64(track >> 1)];
+		if (trackDirty[track])
+		{
+			if (f_lseek(&fp, offset) != FR_OK || f_read(&fp, fileData, sectors * SECTOR_LENGTH, &bytesRead) != FR_OK)
+				bytesRead = 0;
+
+			for (sector = 0; sector < sectors; sector++)
+			{
+				unsigned sectorOffset = sector * SECTOR_LENGTH;
+
+				memset(sectorData, 0, SECTOR_LENGTH);
+				ConvertSector(track, sector, sectorData);
+				if (sectorOffset + SECTOR_LENGTH <= bytesRead && memcmp(sectorData, fileData + sectorOffset, SECTOR_LENGTH) == 0)
+					continue;
+
+				if (f_lseek(&fp, offset + sectorOffset) != FR_OK || f_write(&fp, sectorData, SECTOR_LENGTH, &bytesWritten) != FR_OK || bytesWritten != SECTOR_LENGTH)
+				{
+					SetACTLed(false);
+					DEBUG_LOG("Cannot write d64 data.\r\n");
+					f_close(&fp);
+					return false;
+				}
+				sectorsWritten++;
+			}
+			trackDirty[track] = false;
+		}
+		offset += sectors * SECTOR_LENGTH;
+	}
+	f_close(&fp);
+	SetACTLed(false);
+
+	DEBUG_LOG("Updated %d blocks of D64 file\r\n", sectorsWritten);
+
+	return true;
+}
+
 bool DiskImage::WriteD64(char* name)
 {
 	BYTE id[3];
@@ -349,12 +980,18 @@ bool DiskImage::WriteD64(char* name)
 	if (readOnly)
 		return true;
 
+	EncodeTrack(34);
 	if (!GetID(34, id))
 	{
 		DEBUG_LOG("Cannot find directory sector.\r\n");
 		return false;
 	}
 
+	if (!name && fileInfo && UpdateD64())
+		return true;
+
+	EncodeAllTracks();
+
 	FIL fp;
 	FRESULT res = f_open(&fp, fileInfo ? fileInfo->fname : name, FA_CREATE_ALWAYS | FA_WRITE);
 	if (res == FR_OK)
@@ -401,6 +1038,7 @@ bool DiskImage::WriteD64(char* name)
 
 		//f_utime(fileInfo->fname, fileInfo);
 		SetACTLed(false);
+		memset(trackDirty, 0, sizeof(trackDirty));
 
 		DEBUG_LOG("Converted %d blocks into D64 file\r\n", blocks_to_save);
 
@@ -425,13 +1063,10 @@ void DiskImage::CloseD64()
 
 bool DiskImage::OpenD71(const FILINFO* fileInfo, unsigned char* diskImage, unsigned size)
 {
-	unsigned char errorinfo[MAXBLOCKSONDISK * 2];
+	unsigned char errorinfo[MAXBLOCKSONDISK * 2 + 2 * 17];
 	unsigned last_track;
 	unsigned sector_ref;
 	unsigned sectors;
-	unsigned speedZoneIndex;
-	unsigned sectorSize;
-	unsigned char error;
 
 	Close();
 
@@ -467,33 +1102,28 @@ bool DiskImage::OpenD71(const FILINFO* fileInfo, unsigned char* diskImage, unsig
 			break;
 	}
 
+	if (last_track > HALF_TRACK_COUNT / 2)
+		last_track = HALF_TRACK_COUNT / 2;	// Only as many tracks as there are half tracks for
+	for (unsigned halfTrackIndex = 0; halfTrackIndex < last_track * 2; ++halfTrackIndex)
+		trackLengths[halfTrackIndex] = trackSize[GetSpeedZoneIndexD64(halfTrackIndex >> 1)];
+	if (!AllocateTracks(0x55))
+		return false;
+
+	memcpy(diskID, diskImage + 0x165A2, sizeof(diskID));
 	sector_ref = 0;
 	for (unsigned halfTrackIndex = 0; halfTrackIndex < last_track * 2; ++halfTrackIndex)
 	{
 		unsigned char track = (halfTrackIndex >> 1);
-#if defined(EXPERIMENTALZERO)
-		unsigned char* dest = &tracks[halfTrackIndex << 13];
-#else
-		unsigned char* dest = tracks[halfTrackIndex];
-#endif
-
-		trackLengths[halfTrackIndex] = trackSize[GetSpeedZoneIndexD64(track)];
 
 		if ((halfTrackIndex & 1) == 0)
 		{
 			if (offset < size)
 			{
 				trackUsed[halfTrackIndex] = true;
-				speedZoneIndex = GetSpeedZoneIndexD64(track);
-				sectors = sectorsPerTrack[speedZoneIndex];
-				sectorSize = GCR_SYNC_LENGTH + GCR_HEADER_LENGTH + GCR_HEADER_GAP_LENGTH + GCR_SYNC_LENGTH + GCR_SECTOR_DATA_LENGTH + gapSize[speedZoneIndex];
-				for (unsigned sectorNo = 0; sectorNo < sectors; ++sectorNo)
-				{
-					error = errorinfo[sector_ref++];
-					convert_sector_to_GCR(diskImage + offset, dest, track + 1, sectorNo, diskImage + 0x165A2, error, sectorSize);
-					dest += sectorSize;
-					offset += SECTOR_LENGTH;
-				}
+				sectors = sectorsPerTrack[GetSpeedZoneIndexD64(track)];
+				ParkD64Track(track, diskImage + offset, errorinfo + sector_ref);
+				sector_ref += sectors;
+				offset += sectors * SECTOR_LENGTH;
 			}
 			else
 			{
@@ -505,6 +1135,10 @@ bool DiskImage::OpenD71(const FILINFO* fileInfo, unsigned char* diskImage, unsig
 			trackUsed[halfTrackIndex] = false;
 		}
 	}
+	tracksToEncode = last_track;
+#if defined(__CIRCLE__)
+	QueueBackgroundEncoding();
+#endif
 	diskType = D71;
 	return true;
 }
@@ -589,6 +1223,48 @@ void DiskImage::CloseD71()
 }
 
 #if defined (PI1581SUPPORT)
+// Lays out the arena for a D81; each track has both of its sides and their sync bits.
+bool DiskImage::AllocateTracksD81()
+{
+	unsigned size = MAX_TRACK_LENGTH + (MAX_TRACK_LENGTH >> 3);	// The shared blank track
+	unsigned track;
+
+	FreeTracks();
+	for (track = 0; track < D81_TRACK_COUNT; ++track)
+		size += 2 * (trackLengths[track] + ((trackLengths[track] + 7) >> 3));
+
+	trackArena = NewTrackMemory(size);
+	if (!trackArena)
+	{
+		DEBUG_LOG("Cannot allocate %d bytes of track data\r\n", size);
+		return false;
+	}
+	trackArenaSize = size;
+	memset(trackArena, 0, size);
+
+	unsigned char* data = trackArena;
+	unsigned char* blank = trackArena + size - MAX_TRACK_LENGTH - (MAX_TRACK_LENGTH >> 3);
+	for (track = 0; track < D81_TRACK_COUNT; ++track)
+	{
+		for (unsigned headIndex = 0; headIndex < 2; ++headIndex)
+		{
+			if (trackLengths[track])
+			{
+				tracksD81[track][headIndex] = data;
+				data += trackLengths[track];
+				trackD81SyncBits[track][headIndex] = data;
+				data += (trackLengths[track] + 7) >> 3;
+			}
+			else
+			{
+				tracksD81[track][headIndex] = blank;
+				trackD81SyncBits[track][headIndex] = blank + MAX_TRACK_LENGTH;
+			}
+		}
+	}
+	return true;
+}
+
 bool DiskImage::OpenD81(const FILINFO* fileInfo, unsigned char* diskImage, unsigned size)
 {
 	const unsigned physicalSectors = 10;
@@ -606,6 +1282,11 @@ bool DiskImage::OpenD81(const FILINFO* fileInfo, unsigned char* diskImage, unsig
 
 	attachedImageSize = size;
 
+	for (unsigned trackIndex = 0; trackIndex < D81_TRACK_COUNT; ++trackIndex)
+		trackLengths[trackIndex] = D81_TRACK_LENGTH;
+	if (!AllocateTracksD81())
+		return false;
+
 	unsigned char* src = diskImage;
 
 	for (unsigned trackIndex = 0; trackIndex < D81_TRACK_COUNT; ++trackIndex)
@@ -614,8 +1295,6 @@ bool DiskImage::OpenD81(const FILINFO* fileInfo, unsigned char* diskImage, unsig
 		unsigned index;
 
 		trackUsed[trackIndex] = true;
-		memset(trackD81SyncBits[trackIndex][0], 0, MAX_TRACK_LENGTH >> 3);
-		memset(trackD81SyncBits[trackIndex][1], 0, MAX_TRACK_LENGTH >> 3);
 //32x	4e
 // For 10 sectors
 //		12x	00	// SYNC
@@ -779,7 +1458,66 @@ bool DiskImage::OpenD81(const FILINFO* fileInfo, unsigned char* diskImage, unsig
 		}
 	}
 
-	diskType = D81;
+	diskType = D81;
+	return true;
+}
+
+// Where OpenD81 put the data of a physical sector in its MFM track.
+unsigned char* DiskImage::D81SectorData(unsigned track, unsigned headIndex, unsigned physicalSectorIndex)
+{
+	return tracksD81[track][headIndex] + 32 + physicalSectorIndex * D81_PHYSICAL_SECTOR_LENGTH + D81_HEADER_LENGTH + D81_DATA_MARK_LENGTH;
+}
+
+// As UpdateD64 for the dirty tracks of a D81. Returns false if the file is too short to be updated in place.
+bool DiskImage::UpdateD81()
+{
+	const unsigned physicalSectors = 10;
+	const unsigned trackLength = physicalSectors * 2 * D81_SECTOR_LENGTH;
+	unsigned char fileData[D81_SECTOR_LENGTH];
+	unsigned sectorsWritten = 0;
+	UINT bytesRead;
+	UINT bytesWritten;
+
+	if (attachedImageSize < D81_TRACK_COUNT * trackLength)
+		return false;
+
+	FIL fp;
+	if (f_open(&fp, fileInfo->fname, FA_READ | FA_WRITE) != FR_OK)
+		return false;
+
+	SetACTLed(true);
+	for (unsigned trackIndex = 0; trackIndex < D81_TRACK_COUNT; ++trackIndex)
+	{
+		if (!trackDirty[trackIndex] || trackLengths[trackIndex] == 0)
+			continue;
+
+		for (unsigned headIndex = 0; headIndex < 2; ++headIndex)
+		{
+			for (unsigned physicalSectorIndex = 0; physicalSectorIndex < physicalSectors; ++physicalSectorIndex)
+			{
+				unsigned offset = trackIndex * trackLength + (headIndex * physicalSectors + physicalSectorIndex) * D81_SECTOR_LENGTH;
+				unsigned char* src = D81SectorData(trackIndex, headIndex, physicalSectorIndex);
+
+				if (f_lseek(&fp, offset) == FR_OK && f_read(&fp, fileData, D81_SECTOR_LENGTH, &bytesRead) == FR_OK
+					&& bytesRead == D81_SECTOR_LENGTH && memcmp(src, fileData, D81_SECTOR_LENGTH) == 0)
+					continue;
+
+				if (f_lseek(&fp, offset) != FR_OK || f_write(&fp, src, D81_SECTOR_LENGTH, &bytesWritten) != FR_OK || bytesWritten != D81_SECTOR_LENGTH)
+				{
+					SetACTLed(false);
+					f_close(&fp);
+					return false;
+				}
+				sectorsWritten++;
+			}
+		}
+		trackDirty[trackIndex] = false;
+	}
+	f_close(&fp);
+	SetACTLed(false);
+
+	DEBUG_LOG("Updated %d sectors of D81 file\r\n", sectorsWritten);
+
 	return true;
 }
 
@@ -790,6 +1528,9 @@ bool DiskImage::WriteD81(char *name)
 	if (readOnly)
 		return true;
 
+	if (!name && fileInfo && UpdateD81())
+		return true;
+
 	FIL fp;
 	FRESULT res = f_open(&fp, fileInfo ? fileInfo->fname : name, FA_CREATE_ALWAYS | FA_WRITE);
 	if (res == FR_OK)
@@ -871,6 +1612,7 @@ bool DiskImage::WriteD81(char *name)
 
 		//f_utime(fileInfo->fname, fileInfo);
 		SetACTLed(false);
+		memset(trackDirty, 0, sizeof(trackDirty));
 
 		return true;
 	}
@@ -901,12 +1643,14 @@ bool DiskImage::OpenG64(const FILINFO* fileInfo, unsigned char* diskImage, unsig
 
 	if (memcmp(diskImage, "GCR-1541", 8) == 0)
 	{
-		hash = HashBuffer(diskImage, size);
+		legacyHash = HashBuffer(diskImage, size);
 
-		//DEBUG_LOG("Is G64 %08x\r\n", hash);
+		//DEBUG_LOG("Is G64 %08x\r\n", legacyHash);
 
 		unsigned char numTracks = diskImage[9];
 		//DEBUG_LOG("numTracks = %d\r\n", numTracks);
+		if (numTracks > HALF_TRACK_COUNT)
+			numTracks = HALF_TRACK_COUNT;
 
 		unsigned char* data = diskImage + 12;
 		unsigned char* speedZoneData = diskImage + 0x15c;
@@ -923,29 +1667,36 @@ bool DiskImage::OpenG64(const FILINFO* fileInfo, unsigned char* diskImage, unsig
 
 			trackDensity[track] = *(unsigned*)(speedZoneData + track * 4);
 
-			if (offset == 0)
+			if (offset == 0 || size < 2 || offset > size - 2)	// None or past the end of the file
 			{
 				trackLengths[track] = capacity_max[trackDensity[track]];
 				trackUsed[track] = false;
 			}
 			else
 			{
-				unsigned char* trackData = diskImage + offset;
-
-				trackLength = *(unsigned short*)(trackData);
+				trackLength = *(unsigned short*)(diskImage + offset);
 				//DEBUG_LOG("trackLength = %d offset = %d\r\n", trackLength, offset);
-				trackData += 2;
 				trackLengths[track] = trackLength;
-#if defined(EXPERIMENTALZERO)
-				memcpy(&tracks[track << 13], trackData, trackLength);
-#else
-				memcpy(tracks[track], trackData, trackLength);
-#endif
 				trackUsed[track] = true;
 				//DEBUG_LOG("%d has data\r\n", track);
 			}
 		}
 
+		if (!AllocateTracks(0x55))
+			return false;
+
+		data = diskImage + 12;
+		for (track = 0; track < numTracks; ++track, data += 4)
+		{
+			if (trackUsed[track])
+			{
+				unsigned offset = *(unsigned*)data + 2;
+				unsigned length = size - offset < trackLengths[track] ? size - offset : trackLengths[track];
+				memcpy(tracks[track], diskImage + offset, length);
+				memset(tracks[track] + length, 0xff, trackLengths[track] - length);	// Cut short by the end of the file
+			}
+		}
+
 		diskType = G64;
 		return true;
 	}
@@ -971,6 +1722,7 @@ bool DiskImage::WriteG64(char* name)
 	if (readOnly)
 		return true;
 
+	EncodeAllTracks();
 	FIL fp;
 	FRESULT res = f_open(&fp, fileInfo ? fileInfo->fname : name, FA_CREATE_ALWAYS | FA_WRITE);
 	if (res == FR_OK)
@@ -1039,11 +1791,7 @@ bool DiskImage::WriteG64(char* name)
 
 			gcr_track[0] = (BYTE)(track_len % 256);
 			gcr_track[1] = (BYTE)(track_len / 256);
-#if defined(EXPERIMENTALZERO)
-			memcpy(buffer, &tracks[track << 13], track_len);
-#else
 			memcpy(buffer, tracks[track], track_len);
-#endif
 
 			memcpy(gcr_track + 2, buffer, track_len);
 			bytesToWrite = G64_TRACK_MAXLEN + 2;
@@ -1083,9 +1831,27 @@ void DiskImage::CloseG64()
 
 bool DiskImage::OpenNIB(const FILINFO* fileInfo, unsigned char* diskImage, unsigned size)
 {
-	int track, t_index = 0, h_index = 0;
+	TrackCacheKey key;
 	Close();
 
+	if (memcmp(diskImage, "MNIB-1541-RAW", 13) != 0)
+		return false;
+
+	bool cache = GetTrackCacheKey(fileInfo, diskImage, size, key);
+	if (cache && LoadCachedTracks(fileInfo, key))
+		return true;
+
+	if (!ConvertNIB(fileInfo, diskImage, size))
+		return false;
+	if (cache)
+		SaveCachedTracks(key);
+	return true;
+}
+
+bool DiskImage::ConvertNIB(const FILINFO* fileInfo, unsigned char* diskImage, unsigned size)
+{
+	int track, t_index = 0, h_index = 0;
+
 	this->fileInfo = fileInfo;
 
 	attachedImageSize = size;
@@ -1098,7 +1864,13 @@ bool DiskImage::OpenNIB(const FILINFO* fileInfo, unsigned char* diskImage, unsig
 			trackLengths[track] = capacity_max[trackDensity[track]];
 			trackUsed[track] = false;
 		}
+		// Room for a whole NIB track as that is what extract_GCR_track() returns when it cannot find the track's cycle.
+		for (h_index = 0; diskImage[0x10 + h_index]; h_index += 2)
+			trackLengths[diskImage[0x10 + h_index] - 2] = NIB_TRACK_LENGTH;
+		if (!AllocateTracks(0x55))
+			return false;
 
+		h_index = 0;
 		while (diskImage[0x10 + h_index])
 		{
 			track = diskImage[0x10 + h_index] - 2;
@@ -1109,19 +1881,11 @@ bool DiskImage::OpenNIB(const FILINFO* fileInfo, unsigned char* diskImage, unsig
 
 			unsigned char* nibdata = diskImage + (t_index * NIB_TRACK_LENGTH) + 0x100;
 			int align;
-#if defined(EXPERIMENTALZERO)
-			trackLengths[track] = extract_GCR_track(&tracks[track << 13], nibdata, &align
-				//, ALIGN_GAP
-				, ALIGN_NONE
-				, capacity_min[trackDensity[track]],
-				capacity_max[trackDensity[track]]);
-#else
 			trackLengths[track] = extract_GCR_track(tracks[track], nibdata, &align
 				//, ALIGN_GAP
 				, ALIGN_NONE
 				, capacity_min[trackDensity[track]],
 				capacity_max[trackDensity[track]]);
-#endif
 
 			trackUsed[track] = true;
 
@@ -1183,11 +1947,7 @@ bool DiskImage::WriteNIB()
 			{
 				if (trackUsed[track])
 				{
-#if defined(EXPERIMENTALZERO)
-					if (f_write(&fp, &tracks[track << 13], bytesToWrite, &bytesWritten) != FR_OK || bytesToWrite != bytesWritten)
-#else
 					if (f_write(&fp, tracks[track], bytesToWrite, &bytesWritten) != FR_OK || bytesToWrite != bytesWritten)
-#endif
 					{
 						DEBUG_LOG("Cannot write track data.\r\n");
 					}
@@ -1222,12 +1982,20 @@ void DiskImage::CloseNIB()
 
 bool DiskImage::OpenNBZ(const FILINFO* fileInfo, unsigned char* diskImage, unsigned size)
 {
+	TrackCacheKey key;
 	Close();
 
+	// Keyed on the compressed image so a cached one is not even uncompressed
+	bool cache = GetTrackCacheKey(fileInfo, diskImage, size, key);
+	if (cache && LoadCachedTracks(fileInfo, key))
+		return true;
+
 	if ((size = LZ_Uncompress(diskImage, compressionBuffer, size)))
 	{
-		if (OpenNIB(fileInfo, compressionBuffer, size))
+		if (ConvertNIB(fileInfo, compressionBuffer, size))
 		{
+			if (cache)
+				SaveCachedTracks(key);
 			diskType = NIB;
 			return true;
 		}
@@ -1291,6 +2059,400 @@ void DiskImage::CloseNBZ()
 	attachedImageSize = 0;
 }
 
+// Each cached image is a file holding a TrackCacheHeader followed by the GCR of every used track.
+static const char TRACK_CACHE_MAGIC[8] = { 'P', 'I', '1', '5', '4', '1', 'T', 'C' };
+static const u32 TRACK_CACHE_VERSION = 2;
+static const unsigned TRACK_CACHE_ENTRIES = 128;
+
+struct TrackCacheHeader
+{
+	char magic[8];
+	u32 version;
+	u64 hash;				// ImageHash of the image file
+	u32 size;
+	u16 fdate;
+	u16 ftime;
+	u32 lastUsed;			// Sequence number of the last mount that used it
+	u32 nibSize;			// What ConvertNIB() was given
+	u16 trackLengths[HALF_TRACK_COUNT];
+	u8 trackDensity[HALF_TRACK_COUNT];
+	u8 trackUsed[HALF_TRACK_COUNT];
+};
+
+struct TrackCacheEntry
+{
+	u64 hash;
+	u32 size;
+	u16 fdate;
+	u16 ftime;
+	u32 lastUsed;
+	u32 bytes;
+};
+
+// Index of the cache directory. Built from the file headers the first time the cache is used.
+static char trackCachePath[128];
+static unsigned trackCacheMaxBytes = 0;
+static bool trackCacheScanned = false;
+static TrackCacheEntry trackCacheEntries[TRACK_CACHE_ENTRIES];
+static unsigned trackCacheCount = 0;
+static unsigned trackCacheBytes = 0;
+static u32 trackCacheSequence = 0;
+static unsigned trackCacheHits = 0;
+static unsigned trackCacheMisses = 0;
+
+static void TrackCacheFileName(char* name, unsigned length, u64 hash, u16 fdate, u16 ftime)
+{
+	snprintf(name, length, "%s/%08x%08x%04x%04x.trk", trackCachePath, (unsigned)(hash >> 32), (unsigned)hash, fdate, ftime);
+}
+
+static bool ReadTrackCacheHeader(FIL* fp, TrackCacheHeader& header)
+{
+	UINT bytesRead;
+
+	if (f_read(fp, &header, sizeof(header), &bytesRead) != FR_OK || bytesRead != sizeof(header))
+		return false;
+	return memcmp(header.magic, TRACK_CACHE_MAGIC, sizeof(TRACK_CACHE_MAGIC)) == 0 && header.version == TRACK_CACHE_VERSION;
+}
+
+static void RemoveTrackCacheEntry(unsigned index)
+{
+	char name[sizeof(trackCachePath) + 256];
+	TrackCacheEntry& entry = trackCacheEntries[index];
+
+	TrackCacheFileName(name, sizeof(name), entry.hash, entry.fdate, entry.ftime);
+	f_unlink(name);
+	trackCacheBytes -= entry.bytes;
+	entry = trackCacheEntries[--trackCacheCount];
+}
+
+static unsigned OldestTrackCacheEntry()
+{
+	unsigned oldest = 0;
+	for (unsigned entry = 1; entry < trackCacheCount; ++entry)
+	{
+		if (trackCacheEntries[entry].lastUsed < trackCacheEntries[oldest].lastUsed)
+			oldest = entry;
+	}
+	return oldest;
+}
+
+// Indexes the most recently used files (only those whose header cannot be read are removed while listing the directory),
+// then removes the rest and as many of the least recently used as it takes to get within the size limit.
+static void ScanTrackCache()
+{
+	DIR dir;
+	FILINFO info;
+	FIL fp;
+	char name[sizeof(trackCachePath) + 256];
+	unsigned dropped = 0;
+
+	trackCacheScanned = true;
+	trackCacheCount = 0;
+	trackCacheBytes = 0;
+	if (f_opendir(&dir, trackCachePath) != FR_OK)
+		return;
+	while (f_readdir(&dir, &info) == FR_OK && info.fname[0])
+	{
+		if (info.fattrib & AM_DIR)
+			continue;
+
+		TrackCacheHeader header;
+		bool valid = false;
+
+		snprintf(name, sizeof(name), "%s/%s", trackCachePath, info.fname);
+		if (f_open(&fp, name, FA_READ) == FR_OK)
+		{
+			valid = ReadTrackCacheHeader(&fp, header);
+			f_close(&fp);
+		}
+		if (!valid)
+		{
+			f_unlink(name);
+			continue;
+		}
+
+		unsigned index = trackCacheCount;
+		if (trackCacheCount == TRACK_CACHE_ENTRIES)
+		{
+			// Keep the more recently used of this and the oldest indexed so far
+			dropped++;
+			index = OldestTrackCacheEntry();
+			if (trackCacheEntries[index].lastUsed >= header.lastUsed)
+				continue;
+			trackCacheBytes -= trackCacheEntries[index].bytes;
+		}
+		else
+		{
+			trackCacheCount++;
+		}
+
+		TrackCacheEntry& entry = trackCacheEntries[index];
+		entry.hash = header.hash;
+		entry.size = header.size;
+		entry.fdate = header.fdate;
+		entry.ftime = header.ftime;
+		entry.lastUsed = header.lastUsed;
+		entry.bytes = info.fsize;
+		trackCacheBytes += info.fsize;
+		if (header.lastUsed > trackCacheSequence)
+			trackCacheSequence = header.lastUsed;
+	}
+	f_closedir(&dir);
+
+	// Files that did not make it into the index can never be found so go now
+	if (dropped && f_opendir(&dir, trackCachePath) == FR_OK)
+	{
+		char indexed[sizeof(trackCachePath) + 256];
+		while (f_readdir(&dir, &info) == FR_OK && info.fname[0])
+		{
+			if (info.fattrib & AM_DIR)
+				continue;
+
+			snprintf(name, sizeof(name), "%s/%s", trackCachePath, info.fname);
+			bool found = false;
+			for (unsigned index = 0; !found && index < trackCacheCount; ++index)
+			{
+				const TrackCacheEntry& entry = trackCacheEntries[index];
+				TrackCacheFileName(indexed, sizeof(indexed), entry.hash, entry.fdate, entry.ftime);
+				found = strcmp(name, indexed) == 0;
+			}
+			if (!found)
+				f_unlink(name);
+		}
+		f_closedir(&dir);
+	}
+
+	while (trackCacheCount && trackCacheBytes > trackCacheMaxBytes)
+		RemoveTrackCacheEntry(OldestTrackCacheEntry());
+	DEBUG_LOG("Track cache %s holds %d images (%d bytes), %d dropped\r\n", trackCachePath, trackCacheCount, trackCacheBytes, dropped);
+}
+
+static int FindTrackCacheEntry(u64 hash, u32 size, u16 fdate, u16 ftime)
+{
+	for (unsigned index = 0; index < trackCacheCount; ++index)
+	{
+		const TrackCacheEntry& entry = trackCacheEntries[index];
+		if (entry.hash == hash && entry.size == size && entry.fdate == fdate && entry.ftime == ftime)
+			return index;
+	}
+	return -1;
+}
+
+void DiskImage::SetTrackCache(const char* path, unsigned maxBytes)
+{
+	strncpy(trackCachePath, path, sizeof(trackCachePath) - 1);
+	trackCachePath[sizeof(trackCachePath) - 1] = 0;
+	trackCacheMaxBytes = maxBytes;
+	trackCacheScanned = false;
+}
+
+// Removes every file in the cache directory, including any it does not recognise.
+void DiskImage::PurgeTrackCache()
+{
+	DIR dir;
+	FILINFO info;
+	char name[sizeof(trackCachePath) + 256];
+	unsigned removed = 0;
+
+	if (!trackCachePath[0])
+		return;
+	if (f_opendir(&dir, trackCachePath) == FR_OK)
+	{
+		while (f_readdir(&dir, &info) == FR_OK && info.fname[0])
+		{
+			if (info.fattrib & AM_DIR)
+				continue;
+			snprintf(name, sizeof(name), "%s/%s", trackCachePath, info.fname);
+			if (f_unlink(name) == FR_OK)
+				removed++;
+		}
+		f_closedir(&dir);
+	}
+	trackCacheScanned = true;
+	trackCacheCount = 0;
+	trackCacheBytes = 0;
+	DEBUG_LOG("Purged %d files from track cache %s\r\n", removed, trackCachePath);
+}
+
+unsigned DiskImage::TrackCacheImages() { return trackCacheCount; }
+unsigned DiskImage::TrackCacheBytes() { return trackCacheBytes; }
+unsigned DiskImage::TrackCacheMaxBytes() { return trackCacheMaxBytes; }
+unsigned DiskImage::TrackCacheHits() { return trackCacheHits; }
+unsigned DiskImage::TrackCacheMisses() { return trackCacheMisses; }
+
+// Returns false if the cache is off.
+bool DiskImage::GetTrackCacheKey(const FILINFO* fileInfo, const unsigned char* diskImage, unsigned size, TrackCacheKey& key)
+{
+	FILINFO info;
+
+	if (!trackCacheMaxBytes || !trackCachePath[0])
+		return false;
+	if (!trackCacheScanned)
+		ScanTrackCache();
+
+	key.hash = ImageHash::Hash(diskImage, size);
+	key.size = size;
+	// The caddy's FILINFO may only have a name (when mounted from the web server)
+	if (f_stat(fileInfo->fname, &info) == FR_OK)
+	{
+		key.fdate = info.fdate;
+		key.ftime = info.ftime;
+	}
+	else
+	{
+		key.fdate = 0;
+		key.ftime = 0;
+	}
+	return true;
+}
+
+bool DiskImage::LoadCachedTracks(const FILINFO* fileInfo, const TrackCacheKey& key)
+{
+	FIL fp;
+	TrackCacheHeader header;
+	char name[sizeof(trackCachePath) + 256];
+	UINT bytesRead;
+	UINT bytesWritten;
+	unsigned track;
+
+	int index = FindTrackCacheEntry(key.hash, key.size, key.fdate, key.ftime);
+	if (index < 0)
+	{
+		trackCacheMisses++;
+		return false;
+	}
+
+	TrackCacheFileName(name, sizeof(name), key.hash, key.fdate, key.ftime);
+	if (f_open(&fp, name, FA_READ | FA_WRITE) != FR_OK)
+	{
+		RemoveTrackCacheEntry(index);
+		trackCacheMisses++;
+		return false;
+	}
+
+	bool success = false;
+	SetACTLed(true);
+	if (ReadTrackCacheHeader(&fp, header) && header.hash == key.hash && header.size == key.size)
+	{
+		// Laid out as ConvertNIB() does, with room for a whole NIB track
+		for (track = 0; track < HALF_TRACK_COUNT; ++track)
+		{
+			trackLengths[track] = header.trackUsed[track] ? NIB_TRACK_LENGTH : header.trackLengths[track];
+			trackDensity[track] = header.trackDensity[track];
+			trackUsed[track] = header.trackUsed[track] != 0;
+		}
+		if (AllocateTracks(0x55))
+		{
+			success = true;
+			for (track = 0; track < HALF_TRACK_COUNT && success; ++track)
+			{
+				trackLengths[track] = header.trackLengths[track];
+				if (trackUsed[track])
+					success = f_read(&fp, tracks[track], trackLengths[track], &bytesRead) == FR_OK && bytesRead == trackLengths[track];
+			}
+		}
+	}
+	if (success)
+	{
+		u32 lastUsed = ++trackCacheSequence;
+		trackCacheEntries[index].lastUsed = lastUsed;
+		f_lseek(&fp, offsetof(TrackCacheHeader, lastUsed));
+		f_write(&fp, &lastUsed, sizeof(lastUsed), &bytesWritten);
+	}
+	SetACTLed(false);
+	f_close(&fp);
+
+	if (!success)
+	{
+		DEBUG_LOG("Track cache %s is unreadable\r\n", name);
+		FreeTracks();
+		RemoveTrackCacheEntry(index);
+		trackCacheMisses++;
+		return false;
+	}
+
+	this->fileInfo = fileInfo;
+	attachedImageSize = header.nibSize;
+	diskType = NIB;
+	trackCacheHits++;
+	DEBUG_LOG("Loaded converted tracks from %s\r\n", name);
+	return true;
+}
+
+void DiskImage::SaveCachedTracks(const TrackCacheKey& key)
+{
+	FIL fp;
+	TrackCacheHeader header;
+	char name[sizeof(trackCachePath) + 256];
+	UINT bytesWritten;
+	unsigned track;
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, TRACK_CACHE_MAGIC, sizeof(TRACK_CACHE_MAGIC));
+	header.version = TRACK_CACHE_VERSION;
+	header.hash = key.hash;
+	header.size = key.size;
+	header.fdate = key.fdate;
+	header.ftime = key.ftime;
+	header.lastUsed = ++trackCacheSequence;
+	header.nibSize = attachedImageSize;
+
+	unsigned bytes = sizeof(header);
+	for (track = 0; track < HALF_TRACK_COUNT; ++track)
+	{
+		header.trackLengths[track] = trackLengths[track];
+		header.trackDensity[track] = trackDensity[track];
+		header.trackUsed[track] = trackUsed[track];
+		if (trackUsed[track])
+			bytes += trackLengths[track];
+	}
+	if (bytes > trackCacheMaxBytes)
+		return;
+
+	// Make room by dropping the least recently used
+	int index = FindTrackCacheEntry(key.hash, key.size, key.fdate, key.ftime);
+	if (index >= 0)
+		RemoveTrackCacheEntry(index);
+	while (trackCacheCount && (trackCacheCount == TRACK_CACHE_ENTRIES || trackCacheBytes + bytes > trackCacheMaxBytes))
+		RemoveTrackCacheEntry(OldestTrackCacheEntry());
+
+	TrackCacheFileName(name, sizeof(name), key.hash, key.fdate, key.ftime);
+	FRESULT res = f_open(&fp, name, FA_CREATE_ALWAYS | FA_WRITE);
+	if (res != FR_OK && f_mkdir(trackCachePath) == FR_OK)	// First use
+		res = f_open(&fp, name, FA_CREATE_ALWAYS | FA_WRITE);
+	if (res != FR_OK)
+	{
+		DEBUG_LOG("Cannot create %s (%d)\r\n", name, res);
+		return;
+	}
+
+	SetACTLed(true);
+	bool success = f_write(&fp, &header, sizeof(header), &bytesWritten) == FR_OK && bytesWritten == sizeof(header);
+	for (track = 0; track < HALF_TRACK_COUNT && success; ++track)
+	{
+		if (trackUsed[track])
+			success = f_write(&fp, tracks[track], trackLengths[track], &bytesWritten) == FR_OK && bytesWritten == trackLengths[track];
+	}
+	SetACTLed(false);
+	f_close(&fp);
+
+	if (!success)
+	{
+		DEBUG_LOG("Cannot write %s\r\n", name);
+		f_unlink(name);
+		return;
+	}
+
+	TrackCacheEntry& entry = trackCacheEntries[trackCacheCount++];
+	entry.hash = key.hash;
+	entry.size = key.size;
+	entry.fdate = key.fdate;
+	entry.ftime = key.ftime;
+	entry.lastUsed = header.lastUsed;
+	entry.bytes = bytes;
+	trackCacheBytes += bytes;
+}
+
 bool DiskImage::OpenT64(const FILINFO* fileInfo, unsigned char* diskImage, unsigned size)
 {
 	bool success = false;
@@ -1443,12 +2605,36 @@ bool DiskImage::GetDecodedSector(u32 track, u32 sector, u8* buffer)
 	{
 		track = (track - 1) * 2;
 		if (trackUsed[track])
+		{
+			EncodeTrack(track);
 			return ConvertSector(track, sector, buffer);
+		}
 	}
 
 	return false;
 }
 
+unsigned DiskImage::ParsedLength(DiskType type)
+{
+	switch (type)
+	{
+		case D64:
+			return MAX_D64_SIZE + MAX_SECTORS_PER_TRACK * SECTOR_LENGTH;	// A short last track is still read whole
+		case D71:
+			return MAX_D71_SIZE + MAX_SECTORS_PER_TRACK * SECTOR_LENGTH;
+		case D81:
+			return MAX_D81_SIZE;
+		case G64:
+			return G64_HEADER_LENGTH;	// OpenG64() checks the track offsets
+		case NIB:
+			return NIB_HEADER_SIZE + 1 + HALF_TRACK_COUNT * NIB_TRACK_LENGTH;
+		case T64:
+			return READBUFFER_SIZE;		// The directory's offsets and lengths are trusted
+		default:
+			return 0;					// NBZ and PRG only read the file
+	}
+}
+
 DiskImage::DiskType DiskImage::GetDiskImageTypeViaExtention(const char* diskImageName)
 {
 	if (!diskImageName) return NONE;
@@ -1562,11 +2748,7 @@ bool DiskImage::ConvertSector(unsigned track, unsigned sector, unsigned char* da
 	int index;
 	int bitIndex;
 
-	bitIndex = FindSectorHeader(track, sector, 0);
-	if (bitIndex < 0)
-		return false;
-
-	bitIndex = FindSync(track, bitIndex, (SECTOR_LENGTH_WITH_CHECKSUM * 2) * 8);
+	bitIndex = FindSectorData(track, sector);
 	if (bitIndex < 0)
 		return false;
 
@@ -1587,63 +2769,56 @@ bool DiskImage::ConvertSector(unsigned track, unsigned sector, unsigned char* da
 
 void DiskImage::DecodeBlock(unsigned track, int bitIndex, unsigned char* buf, int num)
 {
-	int shift, i, j;
-	unsigned char gcr[5];
-	unsigned char byte;
-	unsigned char* offset;
-#if defined(EXPERIMENTALZERO)
-	unsigned char* end = &tracks[track << 13] + trackLengths[track];
-#else
-	unsigned char* end = tracks[track] + trackLengths[track];
-#endif
+	unsigned char gcr[(SECTOR_LENGTH_WITH_CHECKSUM / 4) * 5 + 1];
+	unsigned trackLength = trackLengths[track];
+	unsigned offset = bitIndex >> 3;
+	unsigned count = num * 5 + 1;
+	unsigned copied = 0;
 
-	shift = bitIndex & 7;
-#if defined(EXPERIMENTALZERO)
-	offset = &tracks[track << 13] + (bitIndex >> 3);
-#else
-	offset = tracks[track] + (bitIndex >> 3);
-#endif
+	if (count > sizeof(gcr))
+		count = sizeof(gcr);
 
-	byte = offset[0] << shift;
-	for (i = 0; i < num; i++, buf += 4)
+	// Gather the bytes (wrapping around the end of the track) so the block can be decoded a word at a time
+	while (copied < count)
 	{
-		for (j = 0; j < 5; j++)
-		{
-			offset++;
-			if (offset >= end)
-#if defined(EXPERIMENTALZERO)
-				offset = &tracks[track << 13];
-#else
-				offset = tracks[track];
-#endif
-		
-			if (shift)
-			{
-				gcr[j] = byte | ((offset[0] << shift) >> 8);
-				byte = offset[0] << shift;
-			}
-			else 
-			{
-				gcr[j] = byte;
-				byte = offset[0];
-			}
-		}
-		convert_4bytes_from_GCR(gcr, buf);
+		unsigned chunk = trackLength - offset;
+		if (chunk > count - copied)
+			chunk = count - copied;
+		memcpy(gcr + copied, tracks[track] + offset, chunk);
+		copied += chunk;
+		offset = 0;
 	}
+	convert_GCR_bits_to_bytes(gcr, bitIndex & 7, buf, (count - 1) / 5);
 }
 
 int DiskImage::FindSync(unsigned track, int bitIndex, int maxBits, int* syncStartIndex)
 {
-	int readShiftRegister = 0;
-#if defined(EXPERIMENTALZERO)
-	unsigned char byte = tracks[(track << 13) + (bitIndex >> 3)] << (bitIndex & 7);
-#else
+	unsigned readShiftRegister = 0;
 	unsigned char byte = tracks[track][bitIndex >> 3] << (bitIndex & 7);
-#endif
 	bool prevBitZero = true;
 
 	while (maxBits--)
 	{
+		if (!syncStartIndex && (bitIndex & 7) == 0 && maxBits >= 7)
+		{
+			// A whole byte at a time. Only its first 0 bit can end a sync as it cannot follow 10 1s within the byte.
+			if (byte != 0xff)
+			{
+				unsigned ones = 0;
+				while (byte & (0x80 >> ones))
+					ones++;
+				if ((((readShiftRegister << ones) | (byte >> (8 - ones))) & 0x3ff) == 0x3ff)
+					return bitIndex + ones;
+			}
+			readShiftRegister = (readShiftRegister << 8) | byte;
+			maxBits -= 7;
+			bitIndex += 8;
+			if (bitIndex >= int(BitsInTrack(track)))
+				bitIndex = 0;
+			byte = tracks[track][bitIndex >> 3];
+			continue;
+		}
+
 		if (byte & 0x80)
 		{
 			if (syncStartIndex && prevBitZero)
@@ -1671,11 +2846,7 @@ int DiskImage::FindSync(unsigned track, int bitIndex, int maxBits, int* syncStar
 			bitIndex++;
 			if (bitIndex >= int(BitsInTrack(track)))
 				bitIndex = 0;
-#if defined(EXPERIMENTALZERO)
-			byte = tracks[(track << 13)+(bitIndex >> 3)];
-#else
 			byte = tracks[track][bitIndex >> 3];
-#endif
 		}
 	}
 	return -1;
@@ -1687,6 +2858,20 @@ int DiskImage::FindSectorHeader(unsigned track, unsigned sector, unsigned char*
 	int bitIndex;
 	int bitIndexPrev;
 
+	if ((track & 1) == 0 && sector < MAX_SECTORS_PER_TRACK)
+	{
+		if (!sectorsIndexed[track >> 1])
+			IndexSectors(track);
+		bitIndex = sectorHeaderIndex[track >> 1][sector];
+		if (bitIndex >= 0 && id)
+		{
+			DecodeBlock(track, bitIndex, header, 2);
+			id[0] = header[5];
+			id[1] = header[4];
+		}
+		return bitIndex;
+	}
+
 	bitIndex = 0;
 	bitIndexPrev = -1;
 	for (;;)
@@ -1711,6 +2896,55 @@ int DiskImage::FindSectorHeader(unsigned track, unsigned sector, unsigned char*
 	return -1;
 }
 
+int DiskImage::FindSectorData(unsigned track, unsigned sector)
+{
+	if ((track & 1) == 0 && sector < MAX_SECTORS_PER_TRACK)
+	{
+		if (!sectorsIndexed[track >> 1])
+			IndexSectors(track);
+		return sectorDataIndex[track >> 1][sector];
+	}
+
+	int bitIndex = FindSectorHeader(track, sector, 0);
+	if (bitIndex < 0)
+		return -1;
+	return FindSync(track, bitIndex, (SECTOR_LENGTH_WITH_CHECKSUM * 2) * 8);
+}
+
+// Goes round the track once the way FindSectorHeader() would, noting the first header of each sector and its data block.
+void DiskImage::IndexSectors(unsigned track)
+{
+	unsigned char header[10];
+	int* headers = sectorHeaderIndex[track >> 1];
+	int* data = sectorDataIndex[track >> 1];
+	int bitIndex;
+	int bitIndexPrev;
+	unsigned sector;
+
+	for (sector = 0; sector < MAX_SECTORS_PER_TRACK; ++sector)
+		headers[sector] = data[sector] = -1;
+
+	bitIndex = 0;
+	bitIndexPrev = -1;
+	for (;;)
+	{
+		bitIndex = FindSync(track, bitIndex, NIB_TRACK_LENGTH * 8);
+		if (bitIndexPrev == bitIndex)
+			break;
+		if (bitIndexPrev < 0)
+			bitIndexPrev = bitIndex;
+		DecodeBlock(track, bitIndex, header, 2);
+
+		sector = header[2];
+		if (header[0] == 0x08 && sector < MAX_SECTORS_PER_TRACK && headers[sector] < 0)
+		{
+			headers[sector] = bitIndex;
+			data[sector] = FindSync(track, bitIndex, (SECTOR_LENGTH_WITH_CHECKSUM * 2) * 8);
+		}
+	}
+	sectorsIndexed[track >> 1] = true;
+}
+
 unsigned DiskImage::GetID(unsigned track, unsigned char* id)
 {
 	if (FindSectorHeader(track, 0, id) >= 0)
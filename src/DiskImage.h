@@ -21,7 +21,7 @@
 #include "defs.h"
 #include "types.h"
 #if !defined (__CIRCLE__)
-#if defined(__PICO2__) || defined(ESP32)
+#if defined(__PICO2__) || defined(ESP32) || defined(__HOST__)
 #include "ff.h"
 #else
 #include "types.h"
@@ -54,6 +54,8 @@ static const unsigned short G64_MAX_TRACK_LENGTH = 7928;
 
 static const unsigned short D81_SECTOR_LENGTH = 512;
 
+static const unsigned char MAX_SECTORS_PER_TRACK = 21;
+
 class DiskImage
 {
 public:
@@ -91,13 +93,57 @@ public:
 
 	bool GetDecodedSector(u32 track, u32 sector, u8* buffer);
 
+	// D64 and D71 tracks are only converted to GCR the first time they are needed.
+	// Anything reading a track directly (rather than through a DiskImage method) must call this first.
+	inline void EncodeTrack(unsigned halfTrack)
+	{
+		if (__atomic_load_n(&trackEncoding[halfTrack >> 1], __ATOMIC_ACQUIRE) != TRACK_ENCODED)
+			EncodePendingTrack(halfTrack >> 1);
+	}
+	void EncodeAllTracks();
+
+	// Caddy images that are not in use can keep their tracks LZ compressed instead (not D81 images).
+	// Unpack() only makes room for the tracks; each is expanded again by EncodeTrack() the first time it is needed.
+	bool Pack();
+	bool Unpack();
+	inline bool IsPacked() const { return packed; }
+	static unsigned PackedTrackBytes() { return packedTrackBytes; }	// Of every compressed copy held
+	static unsigned PackedBytes() { return packedBytes; }			// What they compressed to
+	static unsigned TracksExpanded() { return tracksExpanded; }
+	static unsigned ExpandTicks() { return expandTicks; }			// Total time expanding them (Circle only)
+	static void FreeSpareTracks();		// The track memory the last packed image left for the next one to be unpacked
+
+	// Converted NIB/NBZ tracks can be kept in a directory so opening the same image again just reads them back.
+	// The least recently mounted images are removed once the directory would grow past maxBytes (0 turns the cache off).
+	static void SetTrackCache(const char* path, unsigned maxBytes);
+	static void PurgeTrackCache();
+	static unsigned TrackCacheImages();
+	static unsigned TrackCacheBytes();
+	static unsigned TrackCacheMaxBytes();
+	static unsigned TrackCacheHits();
+	static unsigned TrackCacheMisses();
+#if defined(__CIRCLE__)
+	// Lets an otherwise idle core convert the rest of the tracks ahead of the drive.
+	static void SetBackgroundEncoding(bool enable) { backgroundEncoding = enable; }
+	static bool EncodeInBackground();
+
+	// Dirty images taken out of the caddy are saved later, one at a time while the browser is idle, so leaving emulation
+	// does not wait for the SD card. That is on the emulator core, as FatFs and the shared buffers are not for two cores.
+	static bool QueueWriteBack(DiskImage* diskImage);	// Takes ownership (and deletes it once saved) if it returns true
+	static bool WriteBackNext();						// Emulator core only
+	static void FlushWriteBacks();						// Emulator core only; saves every queued image
+	static unsigned WriteBacksPending() { return __atomic_load_n(&writeBacksQueued, __ATOMIC_ACQUIRE) - __atomic_load_n(&writeBacksFlushed, __ATOMIC_ACQUIRE); }
+	static unsigned WriteBacksFlushed() { return __atomic_load_n(&writeBacksFlushed, __ATOMIC_ACQUIRE); }
+
+	// A caddy image swapped out during emulation is packed by the idle core, a track at a time, rather than in the
+	// emulator loop. Unpack() (or closing the image) takes it back off the queue first.
+	void QueuePack();
+	static bool PackInBackground();
+#endif
+
 	inline unsigned char GetNextByte(u32 track, u32 byte)
 	{
-#if defined(EXPERIMENTALZERO)
-		return tracks[(track << 13) + byte];
-#else
 		return tracks[track][byte];
-#endif
 	}
 
 	inline bool GetNextBit(u32 track, u32 byte, u32 bit)
@@ -105,11 +151,7 @@ public:
 		//if (attachedImageSize == 0)
 		//	return 0;
 
-#if defined(EXPERIMENTALZERO)
-		return ((tracks[(track << 13) + byte] >> bit) & 1) != 0;
-#else
 		return ((tracks[track][byte] >> bit) & 1) != 0;
-#endif
 	}
 
 
@@ -118,20 +160,6 @@ public:
 		if (attachedImageSize == 0)
 			return;
 
-#if defined(EXPERIMENTALZERO)
-		u8 dataOld = tracks[(track << 13) + byte];
-		u8 bitMask = 1 << bit;
-		if (value)
-		{
-			TestDirty(track, (dataOld & bitMask) == 0);
-			tracks[(track << 13) + byte] |= bitMask;
-		}
-		else
-		{
-			TestDirty(track, (dataOld & bitMask) != 0);
-			tracks[(track << 13) + byte] &= ~bitMask;
-		}
-#else
 		u8 dataOld = tracks[track][byte];
 		u8 bitMask = 1 << bit;
 		if (value)
@@ -144,7 +172,6 @@ public:
 			TestDirty(track, (dataOld & bitMask) != 0);
 			tracks[track][byte] &= ~bitMask;
 		}
-#endif
 	}
 
 	static const unsigned char SectorsPerTrack[42];
@@ -186,6 +213,9 @@ public:
 #endif /* PI1581SUPPORT */
 
 	static DiskType GetDiskImageTypeViaExtention(const char* diskImageName);
+	// How far into its buffer the Open function for the type may read, whatever the size of the file.
+	// Whoever reads a shorter file in pads it with 0xff up to there.
+	static unsigned ParsedLength(DiskType type);
 	static bool IsDiskImageExtention(const char* diskImageName);
 	static bool IsDiskImageD81Extention(const char* diskImageName);
 	static bool IsDiskImageD71Extention(const char* diskImageName);
@@ -203,27 +233,27 @@ public:
 
 #if !defined(__PICO2__) && !defined(ESP32)
 	static unsigned char readBuffer[READBUFFER_SIZE];
+#else	/* for small mem-footprint allocate these dynamically */
+	static unsigned char *readBuffer;
+#endif
+	// Each track points into trackArena (see AllocateTracks).
 	union
 	{
-#if defined(EXPERIMENTALZERO)
-		unsigned char tracks[HALF_TRACK_COUNT * MAX_TRACK_LENGTH];
-#else
-		unsigned char tracks[HALF_TRACK_COUNT][MAX_TRACK_LENGTH];
-#endif
+		unsigned char* tracks[HALF_TRACK_COUNT];
 #if defined(PI1581SUPPORT)
-		unsigned char tracksD81[HALF_TRACK_COUNT][2][MAX_TRACK_LENGTH];
-#endif		
-	};
-#else	/* for small mem-footprint allocate these dynamically */
-	static unsigned char *readBuffer;
-	unsigned char *tracks;
+		unsigned char* tracksD81[D81_TRACK_COUNT][2];
 #endif
+	};
 
 	bool WriteD64(char* name = 0);
 	bool WriteG64(char* name = 0);
 	bool WriteD81(char *name = 0);
 
-	unsigned GetHash() const { return hash; }
+	// ImageHash of the file the image was opened from (set by whatever read the file in, 0 if nothing did).
+	u64 GetHash() const { return hash; }
+	void SetHash(u64 hash) { this->hash = hash; }
+	// FNV-1a of G64 images, which older builds identified images by.
+	u32 GetLegacyHash() const { return legacyHash; }
 
 	inline static unsigned GetSpeedZoneIndexD64(unsigned track)
 	{
@@ -253,15 +283,68 @@ private:
 			trackDirty[track] = true;
 			trackUsed[track] = true;
 			dirty = true;
+			sectorsIndexed[track >> 1] = false;
 		}
 	}
 
+	enum TrackEncoding
+	{
+		TRACK_ENCODED,
+		TRACK_PENDING,		// The sectors are parked in the (unused) half track above
+		TRACK_ENCODING,
+		TRACK_PACKED		// Only the compressed copy is valid; packedEncoding says what it holds
+	};
+
+	inline unsigned char* TrackData(unsigned halfTrack)
+	{
+		return tracks[halfTrack];
+	}
+
+	bool AllocateTracks(unsigned char fill, bool fillTracks = true);
+#if defined(PI1581SUPPORT)
+	bool AllocateTracksD81();
+#endif
+	void FreeTracks();
+
+	void ParkD64Track(unsigned track, const unsigned char* sectors, const unsigned char* errors);
+	// Write back only the sectors that have changed since the image was opened.
+	bool UpdateD64();
+#if defined(PI1581SUPPORT)
+	bool UpdateD81();
+	unsigned char* D81SectorData(unsigned track, unsigned headIndex, unsigned physicalSectorIndex);
+#endif
+
+	void EncodeD64Track(unsigned track);
+	void EncodePendingTrack(unsigned track);
+	bool PackTrack(unsigned track);
+	void FinishPack();
+	void ExpandTrack(unsigned track);
+	void FreePackedTracks();
+#if defined(__CIRCLE__)
+	void QueueBackgroundEncoding();
+	void CancelBackgroundEncoding();
+#endif
+
 	bool ConvertSector(unsigned track, unsigned sector, unsigned char* buffer);
 	void DecodeBlock(unsigned track, int bitIndex, unsigned char* buf, int num);
 	unsigned GetID(unsigned track, unsigned char* id);
 	int FindSectorHeader(unsigned track, unsigned sector, unsigned char* id);
+	int FindSectorData(unsigned track, unsigned sector);
+	void IndexSectors(unsigned track);
 	int FindSync(unsigned track, int bitIndex, int maxBits, int* syncStartIndex = 0);
 
+	struct TrackCacheKey
+	{
+		u64 hash;
+		u32 size;
+		u16 fdate;
+		u16 ftime;
+	};
+	bool ConvertNIB(const FILINFO* fileInfo, unsigned char* diskImage, unsigned size);
+	static bool GetTrackCacheKey(const FILINFO* fileInfo, const unsigned char* diskImage, unsigned size, TrackCacheKey& key);
+	bool LoadCachedTracks(const FILINFO* fileInfo, const TrackCacheKey& key);
+	void SaveCachedTracks(const TrackCacheKey& key);
+
 	void OutputD81HeaderByte(unsigned char*& dest, unsigned char byte);
 	void OutputD81DataByte(unsigned char*& src, unsigned char*& dest);
 
@@ -278,19 +361,58 @@ private:
 	unsigned attachedImageSize;
 	DiskType diskType;
 	const FILINFO* fileInfo;
-	unsigned hash;
+	u64 hash;
+	u32 legacyHash;
 
 	unsigned short trackLengths[HALF_TRACK_COUNT];
-	union
-	{
-		unsigned char trackDensity[HALF_TRACK_COUNT];
-#if defined(PI1581SUPPORT)		
-		unsigned char trackD81SyncBits[HALF_TRACK_COUNT][2][MAX_TRACK_LENGTH >> 3];
-#endif		
-	};
+	unsigned char trackDensity[HALF_TRACK_COUNT];
+#if defined(PI1581SUPPORT)
+	unsigned char* trackD81SyncBits[D81_TRACK_COUNT][2];
+#endif
+	// One allocation holding the data of every track, sized to trackLengths[] when the image is opened.
+	// Tracks without a length share a blank MAX_TRACK_LENGTH at the end so reading or writing one is harmless.
+	unsigned char* trackArena;
+	unsigned trackArenaSize;
 	bool trackDirty[HALF_TRACK_COUNT];
 	bool trackUsed[HALF_TRACK_COUNT];
 
+	unsigned trackEncoding[HALF_TRACK_COUNT];	// TrackEncoding of each whole track (D71 has up to 70)
+
+	// Bit index just after the sync of each sector's header and data block (-1 if there is none) on the even half tracks.
+	// Built the first time a sector of the track is looked for and thrown away when the track is written.
+	bool sectorsIndexed[HALF_TRACK_COUNT / 2];
+	int sectorHeaderIndex[HALF_TRACK_COUNT / 2][MAX_SECTORS_PER_TRACK];
+	int sectorDataIndex[HALF_TRACK_COUNT / 2][MAX_SECTORS_PER_TRACK];
+	unsigned tracksToEncode;
+	unsigned char diskID[3];
+
+	// Compressed copy of each half track (stored as is when it does not compress).
+	// A copy is kept while the image is unpacked so only tracks written since need compressing again.
+	bool packed;
+	bool hasPackedTracks;
+	unsigned char* packedTracks[HALF_TRACK_COUNT];
+	unsigned short packedLengths[HALF_TRACK_COUNT];
+	unsigned char packedEncoding[HALF_TRACK_COUNT];	// TrackEncoding of each whole track when it was compressed
+	static unsigned packedTrackBytes;
+	static unsigned packedBytes;
+	static unsigned tracksExpanded;
+	static unsigned expandTicks;
+#if defined(__CIRCLE__)
+	DiskImage* nextBackground;
+	unsigned backgroundTrack;
+	static bool backgroundEncoding;
+
+	DiskImage* nextPack;
+	unsigned packTrack;		// Next track to pack in the background
+	bool packQueued;
+	void CancelPack();
+
+	DiskImage* nextWriteBack;
+	FILINFO writeBackFileInfo;	// The caddy's FILINFO may be gone by the time the image is saved (fname holds the full path)
+	static unsigned writeBacksQueued;
+	static unsigned writeBacksFlushed;
+#endif
+
 	unsigned short crc;
 	static const unsigned short CRC1021[256];
 };
@@ -417,6 +417,7 @@ Drive::Drive()
 {
 #if defined(FAST_CODE)
 	localSeed = 0x811c9dc5U;
+	scheduledCycles = 0;
 #else
 	srand(0x811c9dc5U);
 #endif
@@ -426,6 +427,7 @@ Drive::Drive()
 void Drive::Reset()
 {
 #if defined(FAST_CODE)
+	CatchUpRead();
 	LED = false;
 	cyclesForBit = 0;
 	UE7Counter = 16;
@@ -461,12 +463,42 @@ void Drive::Insert(DiskImage* diskImage)
 		return; // Can't insert D81/D82 images into 1540/1541 drives.
 	Eject();
 	this->diskImage = diskImage;
+	diskImage->EncodeTrack(headTrackPos);
 	newDiskImageQueuedCylesRemaining = DISK_SWAP_CYCLES_DISK_EJECTING + DISK_SWAP_CYCLES_NO_DISK + DISK_SWAP_CYCLES_DISK_INSERTING;
 }
 
 void Drive::Eject()
 {
-	if (diskImage) diskImage = 0;
+	if (diskImage)
+	{
+#if defined(FAST_CODE)
+		CatchUpRead();
+#endif
+		diskImage = 0;
+	}
+}
+
+// Takes on the mechanics of another drive while keeping the disk that is in this one.
+// The disk is treated as having been in the drive all along so no swap is signalled.
+void Drive::RestoreState(const Drive& state)
+{
+	DiskImage* disk = diskImage;
+	m6522* VIA = m_pVIA;
+
+	*this = state;
+	diskImage = disk;
+	m_pVIA = VIA;
+	newDiskImageQueuedCylesRemaining = 0;
+#if defined(FAST_CODE)
+	// Anything read ahead came off the other disk. Drop back to where that read started.
+	if (scheduledCycles)
+	{
+		RestoreReadState(scheduleStart);
+		scheduledCycles = 0;
+	}
+#endif
+	UpdateHeadSectorPosition();
+	if (diskImage) m_pVIA->GetPortB()->SetInput(0x10, !diskImage->GetReadOnly());
 }
 
 void Drive::DumpTrack(unsigned track)
@@ -478,6 +510,11 @@ void Drive::DumpTrack(unsigned track)
 void Drive::OnPortOut(void* pThis, unsigned char status)
 {
 	Drive* pDrive = (Drive*)pThis;
+#if defined(FAST_CODE)
+	// Anything that alters how the disk is read must see the read logic as it is now, not where it has been run ahead to.
+	if (pDrive->scheduledCycles && (pDrive->motor != ((status & 4) != 0) || pDrive->CLOCK_SEL_AB != ((status >> 5) & 3) || (pDrive->motor && pDrive->lastHeadDirection != (status & 3))))
+		pDrive->CatchUpRead();
+#endif
 	if (pDrive->motor)
 		pDrive->MoveHead(status & 3);
 	pDrive->motor = (status & 4) != 0;
@@ -546,24 +583,24 @@ bool Drive::Update()
 		// So we need to simulate 16 cycles for every 1 CPU cycle
 #if defined(FAST_CODE)
 		if (writing)
+		{
+			CatchUpRead();
 			DriveLoopWrite();
+		}
 		else
 		{
-			if (fluxReversalCyclesLeft > 16 && cyclesLeftForBit > 16)
-			{
-				DriveLoopReadNoFluxNoCycles();
-			}
-			else if (fluxReversalCyclesLeft > 16)
+			if (scheduledCycles == 0)
+				ScheduleRead();
+			if (++scheduledCyclesElapsed == scheduledCycles)
 			{
-				DriveLoopReadNoFlux();
-			}
-			else if (cyclesLeftForBit > 16)
-			{
-				DriveLoopReadNoCycles();
-			}
-			else
-			{
-				DriveLoopRead();
+				// The CPU has caught up with the read logic so let it see what happened this cycle.
+				scheduledCycles = 0;
+				m_pVIA->GetPortB()->SetInput(0x80, !scheduledSync);	// PB7 active low SYNC
+				if (scheduledByteReady)
+				{
+					SO = (FCR & m6522::FCR_CA2_OUTPUT_MODE0) != 0;	// bit 2 of the FCR indicates "Byte Ready Active" turned on or not.
+					m_pVIA->GetPortA()->SetInput(scheduledByte);
+				}
 			}
 		}
 #else
@@ -647,7 +684,8 @@ bool Drive::Update()
 		}
 #endif
 	}
-	m_pVIA->InputCA1(!SO);
+	if (m_pVIA->GetCA1() == SO)
+		m_pVIA->InputCA1(!SO);
 
 #if defined(PROFILE)
 	read_performance_counters(&pct);
@@ -662,240 +700,236 @@ bool Drive::Update()
 #define min(a,b) (((a) < (b)) ? (a) : (b))
 #define max(a,b) (((a) > (b)) ? (a) : (b))
 
-void Drive::DriveLoopReadNoFluxNoCycles()
+// Reading is event scheduled.
+// Between flux reversals, bit cells and UF4 clocks the read logic does nothing, and most of what it does do the CPU can not see.
+// All that is visible is PB7 (SYNC) changing and a byte being latched into PortA (with BYTE READY/SO).
+// So rather than stepping the counters 16 times every CPU cycle, RunRead jumps straight from one counter expiring to the next,
+// running ahead to the end of the cycle in which the next visible change occurs. Update then just counts cycles until the CPU gets there.
+// If anything the read logic depends on changes before then (density, head, motor, R/W mode or the disk) CatchUpRead rewinds and replays up to the current cycle.
+#define READ_SCHEDULE_MAX_CYCLES 128
+
+// Runs the read logic for at most maxCycles CPU cycles, stopping at the end of the first cycle in which PB7 changes or a byte is latched.
+// Returns the number of cycles run.
+unsigned Drive::RunRead(unsigned maxCycles)
 {
-	unsigned int cycles = 16;
-	fluxReversalCyclesLeft -= 16;
-	cyclesLeftForBit -= 16;
-	while (true)
-	{
-		if (cycles < UE7Counter)
-		{
-			UE7Counter -= cycles;
-			cycles = 0;
-			return;
-		}
-		cycles -= UE7Counter;
-
-		UE7Counter = 16 - CLOCK_SEL_AB;	// A and B inputs of UE7 come from the VIA's CLOCK SEL A/B outputs (ie PB5/6) ie preload the encoder/decoder clock for the current density settings.
-									// The decoder consists of UF4 and UE5A. The ecoder has two outputs, Pin 1 of UE5A is the serial data output and pin 2 of UF4 (output B) is the serial clock output.
-		++UF4Counter &= 0xf; // Clock and clamp UF4.
-								// The UD2 read shift register is clocked by serial clock (the rising edge of encoder/decoder's UF4 B output (serial clock))
-								//	- ie on counts 2, 6, 10 and 14 (2 is the only count that outputs a 1 into readShiftRegister as the MSB bits of the count NORed together for other values are 0)
-		if ((UF4Counter & 0x3) == 2)
-		{
-			readShiftRegister <<= 1;
-			readShiftRegister |= (UF4Counter == 2); 
-
-			//writeShiftRegister <<= 1;
-			
-			bool resetTime = ((readShiftRegister & 0x3ff) == 0x3ff);
-			m_pVIA->GetPortB()->SetInput(0x80, !resetTime);
-			if (resetTime)	// if the last 10 bits are 1s then SYNC
-				UE3Counter = 0;	// Phase lock on to byte boundary
-			else
-				UE3Counter++;
-		}
-		// UC5B (NOR used to invert UF4's output B serial clock) output high when UF4 counts 0,1,4,5,8,9,12 and 13
-		else if (((UF4Counter & 2) == 0) && (UE3Counter == 8))	// Phase locked on to byte boundary
-		{
-			UE3Counter = 0;
-			SO = (m_pVIA->GetFCR() & m6522::FCR_CA2_OUTPUT_MODE0) != 0;	// bit 2 of the FCR indicates "Byte Ready Active" turned on or not.
-//			writeShiftRegister = readShiftRegister;
-			m_pVIA->GetPortA()->SetInput(readShiftRegister & 0xff);
-		}
-	};
-}
-
-void Drive::DriveLoopReadNoFlux()
-{
-	unsigned int minCycles;
-	unsigned int cycles = 16;
-
-	fluxReversalCyclesLeft -= 16;
+	// Work in 16Mhz ticks from now rather than counting every counter down at each step.
+	unsigned int endTicks = maxCycles * 16;
+	unsigned int bitAt = cyclesLeftForBit;
+	unsigned int fluxAt = fluxReversalCyclesLeft;
+	unsigned int clockAt = UE7Counter;
+	unsigned int clockPeriod = 16 - CLOCK_SEL_AB;	// A and B inputs of UE7 come from the VIA's CLOCK SEL A/B outputs (ie PB5/6) ie preload the encoder/decoder clock for the current density settings.
+	unsigned int nextAt;
 
 	while (true)
 	{
-		minCycles = min(min(cyclesLeftForBit, cycles), UE7Counter);
-		cyclesLeftForBit -= minCycles;
-		cycles -= minCycles;
-		UE7Counter -= minCycles;
-
-		if (cycles == 0)
-			return;
+		nextAt = min(bitAt, fluxAt);
 
-		if (cyclesLeftForBit == 0)
+		// Clock UF4 until the next bit cell or flux reversal.
+		while (clockAt < nextAt)
 		{
-			cyclesForBitErrorCounter -= cyclesPerBitErrorConstant;
-			cyclesLeftForBit = cyclesPerBitInt + (cyclesForBitErrorCounter < cyclesPerBitErrorConstant);
-
-			//cyclesForBit -= cyclesPerBit;
-			//cyclesLeftForBit = ceil(cyclesPerBit - cyclesForBit);
-			//cyclesForBit += cyclesLeftForBit;
-
-			if (GetNextBit())
-			{
-				ResetEncoderDecoder(18 * 16, /*20 * 16*/ 2 * 16);
-			}
-			if (cycles < UE7Counter)
-			{
-				UE7Counter -= cycles;
-				cyclesLeftForBit -= cycles;
-				return;
-			}
-			cyclesLeftForBit -= UE7Counter;
-			cycles -= UE7Counter;
-		}
+			if (clockAt > endTicks)
+				goto done;
 
-		//if (UE7Counter == 0x0) // The count carry (bit 4) clocks UF4.
-		{
-			UE7Counter = 16 - CLOCK_SEL_AB;	// A and B inputs of UE7 come from the VIA's CLOCK SEL A/B outputs (ie PB5/6) ie preload the encoder/decoder clock for the current density settings.
-										// The decoder consists of UF4 and UE5A. The ecoder has two outputs, Pin 1 of UE5A is the serial data output and pin 2 of UF4 (output B) is the serial clock output.
+			// The count carry (bit 4) of UE7 clocks UF4.
+			unsigned int ticks = clockAt;
+			clockAt += clockPeriod;
 			++UF4Counter &= 0xf; // Clock and clamp UF4.
-								 // The UD2 read shift register is clocked by serial clock (the rising edge of encoder/decoder's UF4 B output (serial clock))
-								 //	- ie on counts 2, 6, 10 and 14 (2 is the only count that outputs a 1 into readShiftRegister as the MSB bits of the count NORed together for other values are 0)
+			// The UD2 read shift register is clocked by serial clock (the rising edge of encoder/decoder's UF4 B output (serial clock))
+			//	- ie on counts 2, 6, 10 and 14 (2 is the only count that outputs a 1 into readShiftRegister as the MSB bits of the count NORed together for other values are 0)
 			if ((UF4Counter & 0x3) == 2)
 			{
 				readShiftRegister <<= 1;
 				readShiftRegister |= (UF4Counter == 2);
 
-				//writeShiftRegister <<= 1;
-
-				bool resetTime = ((readShiftRegister & 0x3ff) == 0x3ff);
-				m_pVIA->GetPortB()->SetInput(0x80, !resetTime);
-				if (resetTime)	// if the last 10 bits are 1s then SYNC
+				bool sync = ((readShiftRegister & 0x3ff) == 0x3ff);
+				if (sync)	// if the last 10 bits are 1s then SYNC
 					UE3Counter = 0;	// Phase lock on to byte boundary
 				else
 					UE3Counter++;
+				if (sync == scheduledSync)
+					continue;
+				scheduledSync = sync;
 			}
 			// UC5B (NOR used to invert UF4's output B serial clock) output high when UF4 counts 0,1,4,5,8,9,12 and 13
 			else if (((UF4Counter & 2) == 0) && (UE3Counter == 8))	// Phase locked on to byte boundary
 			{
 				UE3Counter = 0;
-				SO = (m_pVIA->GetFCR() & m6522::FCR_CA2_OUTPUT_MODE0) != 0;	// bit 2 of the FCR indicates "Byte Ready Active" turned on or not.
-	//			writeShiftRegister = readShiftRegister;
-				m_pVIA->GetPortA()->SetInput(readShiftRegister & 0xff);
+				scheduledByteReady = true;
+				scheduledByte = (u8)readShiftRegister;
+			}
+			else
+			{
+				continue;
 			}
-		}
-	};
-}
-void Drive::DriveLoopReadNoCycles()
-{
-	unsigned int minCycles;
-	unsigned int cycles = 16;
 
-	cyclesLeftForBit -= 16;
-	while (true)
-	{
-		minCycles = min(cycles, min(UE7Counter, fluxReversalCyclesLeft));
-		fluxReversalCyclesLeft -= minCycles;
-		cycles -= minCycles;
-		UE7Counter -= minCycles;
+			// Finish off the cycle the event happened in. (Both a SYNC change and a byte can occur in the same cycle.)
+			if (endTicks > ticks + 15)
+				endTicks = ticks ? ((ticks + 15) & ~15) : 16;
+		}
 
-		if (cycles == 0)
-			return;
+		if (nextAt > endTicks)
+			goto done;
 
-		if (fluxReversalCyclesLeft == 0)//Not entirely right, a flux reversal will be skipped if a bit read was going to happen
+		if (bitAt == nextAt)
 		{
-			ResetEncoderDecoder(2 * 16, /*25 * 16*/23 * 16); // Trigger a random noise generated zero crossing and start seeing more anywhere between 2us and 25us after this one.
-		}
+			cyclesForBitErrorCounter -= cyclesPerBitErrorConstant;
+			bitAt += cyclesPerBitInt + (cyclesForBitErrorCounter < cyclesPerBitErrorConstant);
 
-		if (UE7Counter == 0x0) // The count carry (bit 4) clocks UF4.
-		{
-			UE7Counter = 16 - CLOCK_SEL_AB;	// A and B inputs of UE7 come from the VIA's CLOCK SEL A/B outputs (ie PB5/6) ie preload the encoder/decoder clock for the current density settings.
-										// The decoder consists of UF4 and UE5A. The ecoder has two outputs, Pin 1 of UE5A is the serial data output and pin 2 of UF4 (output B) is the serial clock output.
-			++UF4Counter &= 0xf; // Clock and clamp UF4.
-								 // The UD2 read shift register is clocked by serial clock (the rising edge of encoder/decoder's UF4 B output (serial clock))
-								 //	- ie on counts 2, 6, 10 and 14 (2 is the only count that outputs a 1 into readShiftRegister as the MSB bits of the count NORed together for other values are 0)
-			if ((UF4Counter & 0x3) == 2)
+			// Any 1 bit coming from the disk will come in the form of a flux reversal.
+			if (GetNextBit())
 			{
-				readShiftRegister <<= 1;
-				readShiftRegister |= (UF4Counter == 2);
-
-				//writeShiftRegister <<= 1;
+				// Pin 12 of UE5D is the BIT SYNC Input. A pulse here terminates the current encoder/decoder clock cycle early and begins a new one.
+				ResetEncoderDecoder(18 * 16, /*20 * 16*/ 2 * 16);
+				clockAt = nextAt + UE7Counter;
+				fluxAt = nextAt + fluxReversalCyclesLeft;
 
-				bool resetTime = ((readShiftRegister & 0x3ff) == 0x3ff);
-				m_pVIA->GetPortB()->SetInput(0x80, !resetTime);
-				if (resetTime)	// if the last 10 bits are 1s then SYNC
-					UE3Counter = 0;	// Phase lock on to byte boundary
-				else
-					UE3Counter++;
-			}
-			// UC5B (NOR used to invert UF4's output B serial clock) output high when UF4 counts 0,1,4,5,8,9,12 and 13
-			else if (((UF4Counter & 2) == 0) && (UE3Counter == 8))	// Phase locked on to byte boundary
-			{
-				UE3Counter = 0;
-				SO = (m_pVIA->GetFCR() & m6522::FCR_CA2_OUTPUT_MODE0) != 0;	// bit 2 of the FCR indicates "Byte Ready Active" turned on or not.
-	//			writeShiftRegister = readShiftRegister;
-				m_pVIA->GetPortA()->SetInput(readShiftRegister & 0xff);
+				// Well formed GCR can go straight from one 1 bit to the next.
+				if (ReadGCRBitCells(nextAt, bitAt, fluxAt, clockAt, endTicks))
+					goto done;
+				continue;
 			}
 		}
-	};
+
+		if (fluxAt == nextAt)//Not entirely right, a flux reversal will be skipped if a bit read was going to happen
+		{
+			ResetEncoderDecoder(2 * 16, /*25 * 16*/23 * 16); // Trigger a random noise generated zero crossing and start seeing more anywhere between 2us and 25us after this one.
+			clockAt = nextAt + UE7Counter;
+			fluxAt = nextAt + fluxReversalCyclesLeft;
+		}
+	}
+
+done:
+	cyclesLeftForBit = bitAt - endTicks;
+	fluxReversalCyclesLeft = fluxAt - endTicks;
+	UE7Counter = clockAt - endTicks;
+	return endTicks >> 4;
 }
 
-void Drive::DriveLoopRead()
+// Reading well formed GCR at the density it was written at.
+// Every bit cell then clocks exactly one bit into the shift register, two encoder/decoder clocks into the cell (counts 2, 6 and 10 of UF4 after the last 1).
+// A byte is latched on the second clock after the 8th bit is shifted in (counts 4, 8 and 12) or if a 1 resets UF4 first, on the first clock after that (count 1).
+// So from the 1 bit just read at resetAt we can work out everything up to and including the next 1 directly from the bitstream, without stepping UE7 and UF4.
+// Anything else (3 or more 0s in a row, a track read at the wrong density or flux noise) is left to RunRead.
+// Returns true if endTicks was reached, otherwise the read logic is left just after the last 1 bit read.
+bool Drive::ReadGCRBitCells(unsigned int resetAt, unsigned int& bitAt, unsigned int& fluxAt, unsigned int& clockAt, unsigned int& endTicks)
 {
-	unsigned int minCycles;
-	unsigned int cycles = 16;
+	const unsigned int clockPeriod = 16 - CLOCK_SEL_AB;
+	unsigned int bitTimes[3] = { 0 };
+	unsigned int errorCounters[3];
 
 	while (true)
 	{
-		minCycles = min(min(cyclesLeftForBit, cycles), min(UE7Counter, fluxReversalCyclesLeft));
-		cyclesLeftForBit -= minCycles;
-		fluxReversalCyclesLeft -= minCycles;
-		cycles -= minCycles;
-		UE7Counter -= minCycles;
-
-		if (cycles == 0)
-			return;
-
-		if (cyclesLeftForBit == 0)
+		// Find the next 1.
+		unsigned int errorCounter = cyclesForBitErrorCounter;
+		unsigned int time = bitAt;
+		u32 bitOffset = headBitOffset;
+		int bitCells = 0;
+		while (true)
 		{
-			cyclesForBitErrorCounter -= cyclesPerBitErrorConstant;
-			cyclesLeftForBit = cyclesPerBitInt + (cyclesForBitErrorCounter < cyclesPerBitErrorConstant);
-
-			if (GetNextBit())
-			{
-				ResetEncoderDecoder(18 * 16, /*20 * 16*/ 2 * 16);
-			}
+			bitTimes[bitCells] = time;
+			errorCounter -= cyclesPerBitErrorConstant;
+			errorCounters[bitCells] = errorCounter;
+			time += cyclesPerBitInt + (errorCounter < cyclesPerBitErrorConstant);
+			if (++bitOffset == bitsInTrack)
+				bitOffset = 0;
+			bitCells++;
+			if ((diskImage->GetNextByte(headTrackPos, bitOffset >> 3) >> ((~bitOffset) & 7)) & 1)
+				break;
+			if (bitCells == 3)
+				return false;
 		}
+		unsigned int oneAt = bitTimes[bitCells - 1];
 
-		if (fluxReversalCyclesLeft == 0)//Not entirely right, a flux reversal will be skipped if a bit read was going to happen
-		{
-			ResetEncoderDecoder(2 * 16, /*25 * 16*/23 * 16); // Trigger a random noise generated zero crossing and start seeing more anywhere between 2us and 25us after this one.
-		}
+		// Must see exactly one shift per bit cell and no flux noise before the 1.
+		if (fluxAt < oneAt || resetAt + (4 * bitCells - 2) * clockPeriod >= oneAt || resetAt + (4 * bitCells + 2) * clockPeriod < oneAt)
+			return false;
 
-		if (UE7Counter == 0x0) // The count carry (bit 4) clocks UF4.
+		// UE7/UF4 clocks from resetAt up to (but not including) the next 1.
+		unsigned int count = (UE3Counter == 8) ? 1 : 2;
+		for (unsigned int clock = resetAt + count * clockPeriod; clock < oneAt; clock = resetAt + count * clockPeriod)
 		{
-			UE7Counter = 16-CLOCK_SEL_AB;	// A and B inputs of UE7 come from the VIA's CLOCK SEL A/B outputs (ie PB5/6) ie preload the encoder/decoder clock for the current density settings.
-										// The decoder consists of UF4 and UE5A. The ecoder has two outputs, Pin 1 of UE5A is the serial data output and pin 2 of UF4 (output B) is the serial clock output.
-			++UF4Counter &= 0xf; // Clock and clamp UF4.
-								 // The UD2 read shift register is clocked by serial clock (the rising edge of encoder/decoder's UF4 B output (serial clock))
-								 //	- ie on counts 2, 6, 10 and 14 (2 is the only count that outputs a 1 into readShiftRegister as the MSB bits of the count NORed together for other values are 0)
-			if ((UF4Counter & 0x3) == 2)
+			if (clock > endTicks)
+				break;
+
+			bool event;
+			if ((count & 3) == 2)
 			{
 				readShiftRegister <<= 1;
-				readShiftRegister |= (UF4Counter == 2);
-
-				//writeShiftRegister <<= 1;
+				readShiftRegister |= (count == 2);
 
-				bool resetTime = ((readShiftRegister & 0x3ff) == 0x3ff);
-				m_pVIA->GetPortB()->SetInput(0x80, !resetTime);
-				if (resetTime)	// if the last 10 bits are 1s then SYNC
+				bool sync = ((readShiftRegister & 0x3ff) == 0x3ff);
+				if (sync)	// if the last 10 bits are 1s then SYNC
 					UE3Counter = 0;	// Phase lock on to byte boundary
 				else
 					UE3Counter++;
+				event = sync != scheduledSync;
+				scheduledSync = sync;
+				count += (UE3Counter == 8) ? 2 : 4;
 			}
-			// UC5B (NOR used to invert UF4's output B serial clock) output high when UF4 counts 0,1,4,5,8,9,12 and 13
-			else if (((UF4Counter & 2) == 0) && (UE3Counter == 8))	// Phase locked on to byte boundary
+			else
 			{
+				// Byte ready
 				UE3Counter = 0;
-				SO = (m_pVIA->GetFCR() & m6522::FCR_CA2_OUTPUT_MODE0) != 0;	// bit 2 of the FCR indicates "Byte Ready Active" turned on or not.
-	//			writeShiftRegister = readShiftRegister;
-				m_pVIA->GetPortA()->SetInput(readShiftRegister & 0xff);
+				scheduledByteReady = true;
+				scheduledByte = (u8)readShiftRegister;
+				event = true;
+				count += (count == 1) ? 1 : 2;
 			}
+
+			if (event && endTicks > clock + 15)
+				endTicks = (clock + 15) & ~15;
 		}
-	};
+
+		if (oneAt > endTicks)
+		{
+			// Stop part way through the bit cells.
+			int bitsRead = 0;
+			while (bitTimes[bitsRead] <= endTicks)
+				bitsRead++;
+			if (bitsRead)
+			{
+				cyclesForBitErrorCounter = errorCounters[bitsRead - 1];
+				headBitOffset += bitsRead;
+				if (headBitOffset >= bitsInTrack)
+					headBitOffset -= bitsInTrack;
+			}
+			bitAt = bitTimes[bitsRead];
+			UF4Counter = (endTicks - resetAt) / clockPeriod;
+			clockAt = resetAt + (UF4Counter + 1) * clockPeriod;
+			return true;
+		}
+
+		cyclesForBitErrorCounter = errorCounter;
+		headBitOffset = bitOffset;
+		bitAt = time;
+
+		ResetEncoderDecoder(18 * 16, /*20 * 16*/ 2 * 16);
+		resetAt = oneAt;
+		clockAt = resetAt + UE7Counter;
+		fluxAt = resetAt + fluxReversalCyclesLeft;
+	}
+}
+
+void Drive::ScheduleRead()
+{
+	SaveReadState(scheduleStart);
+	scheduledSync = (m_pVIA->GetPortB()->GetInput() & 0x80) == 0;
+	scheduledByteReady = false;
+	scheduledCyclesElapsed = 0;
+	scheduledCycles = RunRead(READ_SCHEDULE_MAX_CYCLES);
+}
+
+// Brings the read logic back to the current cycle.
+void Drive::CatchUpRead()
+{
+	if (scheduledCycles)
+	{
+		// Nothing the CPU can see happens before the scheduled event so replaying from the start of the schedule will run the full number of cycles.
+		scheduledCycles = 0;
+		RestoreReadState(scheduleStart);
+		scheduledSync = (m_pVIA->GetPortB()->GetInput() & 0x80) == 0;
+		RunRead(scheduledCyclesElapsed);
+	}
 }
 
 void Drive::DriveLoopWrite()
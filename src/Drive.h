@@ -55,16 +55,13 @@ public:
 	bool Update();
 #if defined(FAST_CODE)
 	void DriveLoopWrite();
-	void DriveLoopRead();
-	void DriveLoopReadNoFluxNoCycles();
-	void DriveLoopReadNoFlux();
-	void DriveLoopReadNoCycles();
 #endif
 
 	void Insert(DiskImage* diskImage);
 	inline const DiskImage* GetDiskImage() const { return diskImage; }
 	void Eject();
 	void Reset();
+	void RestoreState(const Drive& state);
 	inline unsigned Track() const { return headTrackPos; }
 	inline unsigned SectorPos() const { return headBitOffset >> 3; }
 	inline unsigned GetHeadBitOffset() const { return headBitOffset; }
@@ -100,6 +97,7 @@ private:
 
 		if (diskImage)
 		{
+			diskImage->EncodeTrack(headTrackPos);
 			bitsInTrack = diskImage->BitsInTrack(headTrackPos);
 			headBitOffset %= bitsInTrack;
 			cyclesPerBit = CYCLES_16Mhz_PER_ROTATION / (float)bitsInTrack;
@@ -131,6 +129,53 @@ private:
 
 	void DumpTrack(unsigned track); // Used for debugging disk images.
 
+#if defined(FAST_CODE)
+	// Reading is event scheduled (see Drive.cpp). ReadState is everything the read side of the encoder/decoder changes as the disk spins.
+	struct ReadState
+	{
+		unsigned int cyclesLeftForBit;
+		unsigned int fluxReversalCyclesLeft;
+		unsigned int UE7Counter;
+		unsigned int cyclesForBitErrorCounter;
+		u32 readShiftRegister;
+		u32 headBitOffset;
+		int32_t localSeed;
+		int UF4Counter;
+		int UE3Counter;
+	};
+
+	inline void SaveReadState(ReadState& state) const
+	{
+		state.cyclesLeftForBit = cyclesLeftForBit;
+		state.fluxReversalCyclesLeft = fluxReversalCyclesLeft;
+		state.UE7Counter = UE7Counter;
+		state.cyclesForBitErrorCounter = cyclesForBitErrorCounter;
+		state.readShiftRegister = readShiftRegister;
+		state.headBitOffset = headBitOffset;
+		state.localSeed = localSeed;
+		state.UF4Counter = UF4Counter;
+		state.UE3Counter = UE3Counter;
+	}
+
+	inline void RestoreReadState(const ReadState& state)
+	{
+		cyclesLeftForBit = state.cyclesLeftForBit;
+		fluxReversalCyclesLeft = state.fluxReversalCyclesLeft;
+		UE7Counter = state.UE7Counter;
+		cyclesForBitErrorCounter = state.cyclesForBitErrorCounter;
+		readShiftRegister = state.readShiftRegister;
+		headBitOffset = state.headBitOffset;
+		localSeed = state.localSeed;
+		UF4Counter = state.UF4Counter;
+		UE3Counter = state.UE3Counter;
+	}
+
+	unsigned RunRead(unsigned maxCycles);
+	bool ReadGCRBitCells(unsigned int resetAt, unsigned int& bitAt, unsigned int& fluxAt, unsigned int& clockAt, unsigned int& endTicks);
+	void ScheduleRead();
+	void CatchUpRead();
+#endif
+
 #if defined(FAST_CODE)
 	inline u32 AdvanceSectorPosition(int& byteOffset)
 	{
@@ -196,6 +241,13 @@ private:
 	unsigned int cyclesForBitErrorCounter;
 	unsigned int cyclesPerBitErrorConstant;
 	unsigned int cyclesPerBitInt;
+
+	ReadState scheduleStart;			// Read state at the start of the current schedule (for rewinding)
+	unsigned scheduledCycles;			// Cycles from the start of the schedule to the event (0 = nothing scheduled)
+	unsigned scheduledCyclesElapsed;
+	bool scheduledSync;					// SYNC (PB7 active low) at the end of the event cycle
+	bool scheduledByteReady;
+	u8 scheduledByte;
 #else
 	int UE7Counter;
 	u8 writeShiftRegister;
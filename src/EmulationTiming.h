@@ -0,0 +1,137 @@
+// Pi1541 - A Commodore 1541 disk drive emulator
+// Copyright(C) 2018 Stephen White
+//
+// This file is part of Pi1541.
+//
+// Pi1541 is free software : you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Pi1541 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Pi1541. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef EMULATIONTIMING_H
+#define EMULATIONTIMING_H
+
+#include "types.h"
+
+// How long each pass of the realtime emulation loop takes compared to its 1us budget.
+// An overrun is a pass that took long enough to lose at least one whole emulated cycle.
+// Updated by the emulation loop and read without locking by the web server (it is only telemetry).
+class EmulationTiming
+{
+public:
+	enum Device
+	{
+		DEVICE_NONE,
+		DEVICE_1541,
+		DEVICE_1581
+	};
+
+	// Pass lengths in budgets: <2 (on time), 2, 3, 4, 5-8, 9-16, 17-32, 33+
+	static const unsigned HISTOGRAM_BINS = 8;
+	static const unsigned OVERRUN_LOG_SIZE = 16;
+
+	struct Overrun
+	{
+		u64 pass;			// Loop pass (ie emulated microsecond) since the mount
+		u16 pc;
+		u8 halfTrack;		// Track * 2 on the 1581
+		u8 budgets;			// Saturates at 255
+	};
+
+	EmulationTiming()
+	{
+		Reset(DEVICE_NONE, 1);
+	}
+
+	// ticksPerBudget is how many ticks of the loop's timer make up 1us.
+	void Reset(Device device, unsigned ticksPerBudget)
+	{
+		this->device = device;
+		this->ticksPerBudget = ticksPerBudget;
+		overrunTicks = ticksPerBudget * 2;
+		passes = 0;
+		for (unsigned bin = 0; bin < HISTOGRAM_BINS; ++bin)
+			histogram[bin] = 0;
+		overruns = 0;
+		cyclesLost = 0;
+		overrunRun = 0;
+		longestOverrunRun = 0;
+	}
+
+	// Returns false if the pass overran. The caller then reports where with RecordOverrun().
+	inline bool RecordPass(unsigned ticks)
+	{
+		passes++;
+		if (ticks < overrunTicks)
+		{
+			histogram[0]++;
+			overrunRun = 0;
+			return true;
+		}
+		lastOverrunTicks = ticks;
+		return false;
+	}
+
+	void RecordOverrun(u16 pc, unsigned halfTrack)
+	{
+		unsigned budgets = lastOverrunTicks / ticksPerBudget;
+		unsigned bin;
+
+		if (budgets <= 4) bin = budgets - 1;
+		else if (budgets <= 8) bin = 4;
+		else if (budgets <= 16) bin = 5;
+		else if (budgets <= 32) bin = 6;
+		else bin = 7;
+		histogram[bin]++;
+
+		Overrun& overrun = overrunLog[overruns % OVERRUN_LOG_SIZE];
+		overrun.pass = passes;
+		overrun.pc = pc;
+		overrun.halfTrack = halfTrack;
+		overrun.budgets = budgets > 255 ? 255 : budgets;
+
+		overruns++;
+		cyclesLost += budgets - 1;
+		overrunRun++;
+		if (overrunRun > longestOverrunRun)
+			longestOverrunRun = overrunRun;
+	}
+
+	// The most recent overrun is index 0.
+	const Overrun* GetOverrun(unsigned index) const
+	{
+		if (index >= overruns || index >= OVERRUN_LOG_SIZE)
+			return 0;
+		return &overrunLog[(overruns - 1 - index) % OVERRUN_LOG_SIZE];
+	}
+
+	static const char* GetBinName(unsigned bin)
+	{
+		static const char* names[HISTOGRAM_BINS] = { "<2", "2", "3", "4", "5-8", "9-16", "17-32", "33+" };
+		return names[bin];
+	}
+
+	Device device;
+	u64 passes;
+	u64 histogram[HISTOGRAM_BINS];
+	u32 overruns;
+	u64 cyclesLost;
+	u32 longestOverrunRun;
+
+private:
+	unsigned ticksPerBudget;
+	unsigned overrunTicks;
+	unsigned lastOverrunTicks;
+	u32 overrunRun;
+	Overrun overrunLog[OVERRUN_LOG_SIZE];
+};
+
+#endif
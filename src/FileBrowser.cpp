@@ -379,19 +379,114 @@ FileBrowser::BrowsableList::BrowsableList()
 	searchPrefix[0] = 0;
 }
 
+void FileBrowser::BrowsableList::EntryList::Page(const FolderIndex* folderIndex, bool parent)
+{
+	clear();
+	this->folderIndex = folderIndex;
+	this->parent = parent;
+}
+
+void FileBrowser::BrowsableList::EntryList::clear()
+{
+	entries.clear();
+	materialised.clear();
+	folderIndex = 0;
+	parent = false;
+}
+
+const char* FileBrowser::BrowsableList::EntryList::Name(u32 index) const
+{
+	if (!folderIndex)
+		return entries[index].filImage.fname;
+	if (parent && index == 0)
+		return "..";
+	return folderIndex->Name(index - parent);
+}
+
+u8 FileBrowser::BrowsableList::EntryList::Attrib(u32 index) const
+{
+	if (!folderIndex)
+		return entries[index].filImage.fattrib;
+	if (parent && index == 0)
+		return AM_DIR;
+	return folderIndex->records[index - parent].attrib;
+}
+
+FileBrowser::BrowsableList::Entry& FileBrowser::BrowsableList::EntryList::Materialise(u32 index)
+{
+	std::map<u32, Entry>::iterator it = materialised.find(index);
+	if (it != materialised.end())
+		return it->second;
+
+	Entry& entry = materialised[index];
+	memset(&entry.filImage, 0, sizeof(entry.filImage));
+	memset(&entry.filIcon, 0, sizeof(entry.filIcon));
+	if (parent && index == 0)
+	{
+		strcpy(entry.filImage.fname, "..");
+		entry.filImage.fattrib = AM_DIR;
+	}
+	else
+	{
+		const FolderIndex::Record& record = folderIndex->records[index - parent];
+		strncpy(entry.filImage.fname, &folderIndex->names[record.name], sizeof(entry.filImage.fname) - 1);
+		entry.filImage.fsize = record.size;
+		entry.filImage.fattrib = record.attrib;
+		if (record.icon != FolderIndex::NO_ICON)
+			strncpy(entry.filIcon.fname, &folderIndex->names[record.icon], sizeof(entry.filIcon.fname) - 1);
+	}
+	return entry;
+}
+
+void FileBrowser::BrowsableList::EntryList::ClearCaddyIndices()
+{
+	for (unsigned index = 0; index < entries.size(); ++index)
+		entries[index].caddyIndex = -1;
+	for (std::map<u32, Entry>::iterator it = materialised.begin(); it != materialised.end(); ++it)
+		it->second.caddyIndex = -1;
+}
+
+void FileBrowser::BrowsableList::EntryList::Trim(const std::vector<std::pair<u32, u32> >& windows, u32 currentIndex)
+{
+	std::map<u32, Entry>::iterator it = materialised.begin();
+	while (it != materialised.end())
+	{
+		bool keep = it->first == currentIndex || it->second.caddyIndex >= 0;
+		for (unsigned window = 0; !keep && window < windows.size(); ++window)
+			keep = it->first >= windows[window].first && it->first < windows[window].second;
+		if (keep)
+			++it;
+		else
+			materialised.erase(it++);
+	}
+}
+
 void FileBrowser::BrowsableList::ClearSelections()
 {
-	u32 entryIndex;
+	entries.ClearCaddyIndices();
+}
 
-	for (entryIndex = 0; entryIndex < entries.size(); ++entryIndex)
+// Called before the views are drawn so only the entries they are about to show (and any selected) stay materialised.
+void FileBrowser::BrowsableList::TrimEntries()
+{
+	std::vector<std::pair<u32, u32> > windows;
+	for (u32 index = 0; index < views.size(); ++index)
 	{
-		entries[entryIndex].caddyIndex = -1;
+		u32 first = views[index].offset;
+		if (currentIndex - first >= views[index].rows)
+			first = currentIndex >= views[index].rows ? currentIndex - views[index].rows + 1 : 0;
+		windows.push_back(std::make_pair(first, first + views[index].rows));
 	}
+	entries.Trim(windows, currentIndex);
+	SetCurrent();
 }
 
 void FileBrowser::BrowsableList::RefreshViews()
 {
 	u32 index;
+
+	if (entries.Paged())
+		TrimEntries();
 	for (index = 0; index < views.size(); ++index)
 	{
 		views[index].Refresh();
@@ -460,8 +555,7 @@ bool FileBrowser::BrowsableList::CheckBrowseNavigation()
 		// first look from next to last
 		for (i=1+currentIndex; i <= numberOfEntriesMinus1 ; i++)
 		{
-			FileBrowser::BrowsableList::Entry* entry = &entries[i];
-			if (strncasecmp(searchPrefix, entry->filImage.fname, searchPrefixIndex) == 0)
+			if (strncasecmp(searchPrefix, entries.Name(i), searchPrefixIndex) == 0)
 			{
 				found=i;
 				break;
@@ -472,8 +566,7 @@ bool FileBrowser::BrowsableList::CheckBrowseNavigation()
 			// look from first to previous
 			for (i=0; i< 1+currentIndex ; i++)
 			{
-				FileBrowser::BrowsableList::Entry* entry = &entries[i];
-				if (strncasecmp(searchPrefix, entry->filImage.fname, searchPrefixIndex) == 0)
+				if (strncasecmp(searchPrefix, entries.Name(i), searchPrefixIndex) == 0)
 				{
 					found=i;
 					break;
@@ -522,9 +615,8 @@ FileBrowser::BrowsableList::Entry* FileBrowser::BrowsableList::FindEntry(const c
 
 	for (index = 0; index < len; ++index)
 	{
-		Entry* entry = &entries[index];
-		if (!(entry->filImage.fattrib & AM_DIR) && strcasecmp(name, entry->filImage.fname) == 0)
-			return entry;
+		if (!(entries.Attrib(index) & AM_DIR) && strcasecmp(name, entries.Name(index)) == 0)
+			return &entries[index];
 	}
 	return 0;
 }
@@ -583,23 +675,235 @@ u32 FileBrowser::Colour(int index)
 	return palette[index & 0xf];
 }
 
-struct greater
+// Folders before files, then by name
+struct RecordOrder
 {
-	bool operator()(const FileBrowser::BrowsableList::Entry& lhs, const FileBrowser::BrowsableList::Entry& rhs) const
-	{
-		if (strcasecmp(lhs.filImage.fname, "..") == 0)
-			return true;
-		else if (strcasecmp(rhs.filImage.fname, "..") == 0)
-			return false;
-		else if (((lhs.filImage.fattrib & AM_DIR) && (rhs.filImage.fattrib & AM_DIR)) || (!(lhs.filImage.fattrib & AM_DIR) && !(rhs.filImage.fattrib & AM_DIR)))
-			return strcasecmp(lhs.filImage.fname, rhs.filImage.fname) < 0;
-		else if ((lhs.filImage.fattrib & AM_DIR) && !(rhs.filImage.fattrib & AM_DIR))
-			return true;
-		else
-			return false;
+	RecordOrder(const FileBrowser::FolderIndex& folderIndex) : names(&folderIndex.names[0])
+	{
 	}
+
+	bool operator()(const FileBrowser::FolderIndex::Record& lhs, const FileBrowser::FolderIndex::Record& rhs) const
+	{
+		if ((lhs.attrib & AM_DIR) != (rhs.attrib & AM_DIR))
+			return (lhs.attrib & AM_DIR) != 0;
+		return strcasecmp(names + lhs.name, names + rhs.name) < 0;
+	}
+
+	const char* names;
+};
+
+#if defined(__CIRCLE__)
+#define FOLDER_LISTINGS 4
+#else
+#define FOLDER_LISTINGS 2
+#endif
+
+// Only the core running the browser and IEC commands touches these; other cores just bump the generation.
+struct CachedFolder
+{
+	CachedFolder() : fdate(0), ftime(0), generation(0), lastUsed(0), browsing(false)
+	{
+	}
+	std::string path;
+	WORD fdate;
+	WORD ftime;
+	unsigned generation;
+	u32 lastUsed;	// 0 if unused
+	bool browsing;	// The browser's folder list is paging from it
+	FileBrowser::FolderIndex folderIndex;
 };
 
+static CachedFolder cachedFolders[FOLDER_LISTINGS];
+static u32 cachedFolderUseCount = 0;
+unsigned FileBrowser::folderListingGeneration = 0;
+
+struct IconSlot
+{
+	u32 hash;
+	int index;		// Into the records or -1 if empty
+	u16 length;		// Of the name being matched
+	bool fullName;	// Else the name without its extension
+};
+
+static u32 HashName(const char* name, unsigned length)
+{
+	u32 hash = 2166136261u;
+	for (unsigned index = 0; index < length; ++index)
+		hash = (hash ^ (u8)tolower(name[index])) * 16777619u;
+	return hash;
+}
+
+// Gives "game.d64" the icon "game.d64.png", or failing that "game.png".
+// Both names of every record go in an open addressed table so each icon is a single lookup.
+static void JoinIcons(FileBrowser::FolderIndex& folderIndex, const std::vector<u32>& icons)
+{
+	std::vector<FileBrowser::FolderIndex::Record>& records = folderIndex.records;
+	if (records.empty() || icons.empty())
+		return;
+
+	unsigned mask = 15;
+	while (mask < records.size() * 4)
+		mask = (mask << 1) | 1;
+
+	IconSlot empty = { 0, -1, 0, false };
+	std::vector<IconSlot> slots(mask + 1, empty);
+	std::vector<bool> fullNameIcon(records.size(), false);
+
+	for (unsigned index = 0; index < records.size(); ++index)
+	{
+		const char* name = folderIndex.Name(index);
+		const char* ext = strrchr(name, '.');
+		unsigned length = strlen(name);
+		u32 hash = records[index].hash;
+
+		for (int fullName = 1; fullName >= 0; --fullName)
+		{
+			if (!fullName)
+			{
+				if (!ext || ext == name)
+					break;
+				length = ext - name;
+				hash = HashName(name, length);
+			}
+			unsigned slot = hash & mask;
+			while (slots[slot].index >= 0)
+				slot = (slot + 1) & mask;
+			slots[slot].hash = hash;
+			slots[slot].index = index;
+			slots[slot].length = length;
+			slots[slot].fullName = fullName;
+		}
+	}
+
+	for (unsigned icon = 0; icon < icons.size(); ++icon)
+	{
+		const char* iconName = &folderIndex.names[icons[icon]];
+		unsigned length = strlen(iconName) - 4;	// Without the .png
+		u32 hash = HashName(iconName, length);
+
+		for (unsigned slot = hash & mask; slots[slot].index >= 0; slot = (slot + 1) & mask)
+		{
+			const IconSlot& iconSlot = slots[slot];
+			if (iconSlot.hash != hash || iconSlot.length != length || (!iconSlot.fullName && fullNameIcon[iconSlot.index]))
+				continue;
+			if (strncasecmp(folderIndex.Name(iconSlot.index), iconName, length) == 0)
+			{
+				records[iconSlot.index].icon = icons[icon];
+				if (iconSlot.fullName)
+					fullNameIcon[iconSlot.index] = true;
+			}
+		}
+	}
+}
+
+static bool ReadFolderListing(FileBrowser::FolderIndex& folderIndex)
+{
+	DIR dir;
+	FILINFO info;
+	FileBrowser::FolderIndex::Record record;
+	std::vector<u32> icons;
+
+	folderIndex.records.clear();
+	folderIndex.names.clear();
+	if (f_opendir(&dir, ".") != FR_OK)
+		return false;
+
+	while (f_readdir(&dir, &info) == FR_OK && info.fname[0] != 0)
+	{
+		if (info.fname[0] == '.')
+			continue;
+
+		unsigned length = strlen(info.fname);
+		u32 name = folderIndex.names.size();
+		folderIndex.names.insert(folderIndex.names.end(), info.fname, info.fname + length + 1);
+
+		const char* ext = strrchr(info.fname, '.');
+		if (ext && strcasecmp(ext, ".png") == 0)
+		{
+			icons.push_back(name);
+		}
+		else
+		{
+			record.hash = HashName(info.fname, length);
+			record.name = name;
+			record.icon = FileBrowser::FolderIndex::NO_ICON;
+			record.size = (u32)info.fsize;
+			record.attrib = info.fattrib;
+			folderIndex.records.push_back(record);
+		}
+	}
+	f_closedir(&dir);
+
+	if (!folderIndex.records.empty())
+		std::sort(folderIndex.records.begin(), folderIndex.records.end(), RecordOrder(folderIndex));
+	JoinIcons(folderIndex, icons);
+	return true;
+}
+
+const FileBrowser::FolderIndex* FileBrowser::FolderListing(bool browsing)
+{
+	char path[1024];
+	FILINFO info;
+	unsigned index;
+
+	// Read before the folder is so a change made while reading it is not missed.
+	unsigned generation = __atomic_load_n(&folderListingGeneration, __ATOMIC_ACQUIRE);
+#if defined(__CIRCLE__)
+	generation += DiskImage::WriteBacksFlushed();
+#endif
+
+	if (f_getcwd(path, sizeof(path)) != FR_OK)
+		return 0;
+	// The root of a volume has no directory entry to give a timestamp
+	if (f_stat(path, &info) != FR_OK)
+	{
+		info.fdate = 0;
+		info.ftime = 0;
+	}
+
+	// The browser is asking again so it has let go of its old one.
+	if (browsing)
+	{
+		for (index = 0; index < FOLDER_LISTINGS; ++index)
+			cachedFolders[index].browsing = false;
+	}
+
+	CachedFolder* listing = 0;
+	CachedFolder* oldest = 0;
+	for (index = 0; index < FOLDER_LISTINGS; ++index)
+	{
+		CachedFolder* cachedFolder = &cachedFolders[index];
+		if (cachedFolder->lastUsed && cachedFolder->path == path)
+		{
+			if (cachedFolder->generation == generation && cachedFolder->fdate == info.fdate && cachedFolder->ftime == info.ftime)
+			{
+				listing = cachedFolder;
+				break;
+			}
+			// Out of date and not in use so it goes first
+			if (!cachedFolder->browsing)
+				cachedFolder->lastUsed = 0;
+		}
+		if (!cachedFolder->browsing && (!oldest || cachedFolder->lastUsed < oldest->lastUsed))
+			oldest = cachedFolder;
+	}
+
+	if (!listing)
+	{
+		listing = oldest;
+		listing->lastUsed = 0;
+		if (!ReadFolderListing(listing->folderIndex))
+			return 0;
+		listing->path = path;
+		listing->fdate = info.fdate;
+		listing->ftime = info.ftime;
+		listing->generation = generation;
+	}
+	listing->lastUsed = ++cachedFolderUseCount;
+	listing->browsing |= browsing;
+	return &listing->folderIndex;
+}
+
 void FileBrowser::RefreshDevicesEntries(std::vector<FileBrowser::BrowsableList::Entry>& entries, bool toLower)
 {
 	FileBrowser::BrowsableList::Entry entry;
@@ -649,61 +953,20 @@ void FileBrowser::RefreshDevicesEntries(std::vector<FileBrowser::BrowsableList::
 
 void FileBrowser::RefreshFolderEntries()
 {
-	DIR dir;
-	FileBrowser::BrowsableList::Entry entry;
-	FRESULT res;
-	char* ext;
-
 	folder.Clear();
 	if (displayingDevices)
 	{
-		FileBrowser::RefreshDevicesEntries(folder.entries, false);
+		std::vector<FileBrowser::BrowsableList::Entry> devices;
+		FileBrowser::RefreshDevicesEntries(devices, false);
+		for (unsigned index = 0; index < devices.size(); ++index)
+			folder.entries.push_back(devices[index]);
 	}
 	else
 	{
-		res = f_opendir(&dir, ".");
-		if (res == FR_OK)
+		const FolderIndex* listing = FolderListing(true);
+		if (listing)
 		{
-			do
-			{
-				res = f_readdir(&dir, &entry.filImage);
-				ext = strrchr(entry.filImage.fname, '.');
-				if (res == FR_OK && entry.filImage.fname[0] != 0 && !(ext && strcasecmp(ext, ".png") == 0) && (entry.filImage.fname[0] != '.'))
-					folder.entries.push_back(entry);
-			} while (res == FR_OK && entry.filImage.fname[0] != 0);
-			f_closedir(&dir);
-
-			// Now check for icons
-			res = f_opendir(&dir, ".");
-			if (res == FR_OK)/* XXX Fixme */
-			{
-				do
-				{
-					res = f_readdir(&dir, &entry.filIcon);
-					ext = strrchr(entry.filIcon.fname, '.');
-					if (ext)
-					{
-						int length = ext - entry.filIcon.fname;
-						if (res == FR_OK && entry.filIcon.fname[0] != 0 && strcasecmp(ext, ".png") == 0)
-						{
-							for (unsigned index = 0; index < folder.entries.size(); ++index)
-							{
-								FileBrowser::BrowsableList::Entry* entryAtIndex = &folder.entries[index];
-								if (strncasecmp(entry.filIcon.fname, entryAtIndex->filImage.fname, length) == 0)
-									entryAtIndex->filIcon = entry.filIcon;
-							}
-						}
-					}
-				} while (res == FR_OK && entry.filIcon.fname[0] != 0);
-			}
-			f_closedir(&dir);
-
-			strcpy(entry.filImage.fname, "..");
-			entry.filImage.fattrib |= AM_DIR;
-			entry.filIcon.fname[0] = 0;
-			folder.entries.push_back(entry);
-
-			std::sort(folder.entries.begin(), folder.entries.end(), greater());
+			folder.entries.Page(listing, true);
 
 			folder.currentIndex = 0;
 			folder.SetCurrent();
@@ -884,12 +1147,12 @@ void FileBrowser::DisplayPNG(FILINFO& filIcon, int x, int y)
 		res = f_open(&fp, filIcon.fname, FA_READ);
 		if (res == FR_OK)
 		{
-			char* PNG = (char*)malloc(filIcon.fsize);
+			char* PNG = (char*)malloc(f_size(&fp));
 			if (PNG)
 			{
 				UINT bytesRead;
 				SetACTLed(true);
-				f_read(&fp, PNG, filIcon.fsize, &bytesRead);
+				f_read(&fp, PNG, f_size(&fp), &bytesRead);
 				SetACTLed(false);
 				f_close(&fp);
 
@@ -986,8 +1249,7 @@ void FileBrowser::PopFolder()
 				u32 numberOfEntriesMinus1 = folder.entries.size() - 1;
 				for (unsigned i = 0; i <= numberOfEntriesMinus1; i++)
 				{
-					FileBrowser::BrowsableList::Entry* entry = &folder.entries[i];
-					if (strcmp(last_ptr, entry->filImage.fname) == 0)
+					if (strcmp(last_ptr, folder.entries.Name(i)) == 0)
 					{
 						found = i;
 						break;
@@ -1091,7 +1353,10 @@ bool FileBrowser::AddToCaddy(FileBrowser::BrowsableList::Entry* current)
 		RefeshDisplay();
 
 		for (unsigned i = 0; i < folder.entries.size(); ++i)
-			ret |= AddImageToCaddy(&folder.entries[i]);
+		{
+			if (!(folder.entries.Attrib(i) & AM_DIR) && DiskImage::IsDiskImageExtention(folder.entries.Name(i)))
+				ret |= AddImageToCaddy(&folder.entries[i]);
+		}
 
 		folder.currentIndex = folder.entries.size() - 1;
 		folder.SetCurrent();
@@ -1267,11 +1532,9 @@ void FileBrowser::UpdateInputFolders()
 	{
 		MakeLST("autoswap.lst");
 		FolderChanged();
-		FileBrowser::BrowsableList::Entry* current = 0;
 		for (unsigned index = 0; index < folder.entries.size(); ++index)
 		{
-			current = &folder.entries[index];
-			if (strcasecmp(current->filImage.fname, "autoswap.lst") == 0)
+			if (strcasecmp(folder.entries.Name(index), "autoswap.lst") == 0)
 			{
 				folder.currentIndex = index;
 				folder.SetCurrent();
@@ -1319,23 +1582,22 @@ bool FileBrowser::MakeLST(const char* filenameLST)
 	res = f_open(&fp, filenameLST,  FA_CREATE_ALWAYS | FA_WRITE);
 	if (res == FR_OK)
 	{
-		FileBrowser::BrowsableList::Entry* entry = 0;
 		UINT bytes;
 
 		BrowsableList& list = caddySelections.entries.size() > 1 ? caddySelections : folder;
 
 		for (unsigned index = 0; index < list.entries.size(); ++index)
 		{
-			entry = &list.entries[index];
-			if (entry->filImage.fattrib & AM_DIR)
+			const char* name = list.entries.Name(index);
+			if (list.entries.Attrib(index) & AM_DIR)
 				continue;	// skip dirs
 
-			if ( DiskImage::IsDiskImageExtention(entry->filImage.fname)
-				&& !DiskImage::IsLSTExtention(entry->filImage.fname) )
+			if ( DiskImage::IsDiskImageExtention(name)
+				&& !DiskImage::IsLSTExtention(name) )
 			{
 				f_write(&fp,
-					entry->filImage.fname,
-					strlen(entry->filImage.fname),
+					name,
+					strlen(name),
 					&bytes);
 				f_write(&fp, "\r\n", 2, &bytes);
 			}
@@ -1348,6 +1610,7 @@ bool FileBrowser::MakeLST(const char* filenameLST)
 		f_write(&fp, "\r\n", 2, &bytes);
 
 		f_close(&fp);
+		InvalidateFolderListings();
 	}
 	else
 		retcode=false;
@@ -1405,6 +1668,7 @@ bool FileBrowser::MakeLSTFromDir(const char* dir, const char *lstfn)
 		retcode = true;
 	out:
 		f_close(&fp);
+		InvalidateFolderListings();
 	}
 
 	return retcode;
@@ -1431,6 +1695,7 @@ bool FileBrowser::SelectLST(const char* filenameLST)
 
 			TextParser textParser;
 
+			lstImages.clear();
 			textParser.SetData((char*)FileBrowser::LSTBuffer);
 			char* token = textParser.GetToken(true);
 			while (token)
@@ -1444,7 +1709,8 @@ bool FileBrowser::SelectLST(const char* filenameLST)
 					if (entry && !(entry->filImage.fattrib & AM_DIR))
 					{
 						bool readOnly = (entry->filImage.fattrib & AM_RDO) != 0;
-						if (diskCaddy->Insert(&entry->filImage, readOnly))
+						lstImages.push_back(entry->filImage);
+						if (diskCaddy->Insert(&lstImages.back(), readOnly))
 							validImage = true;
 					}
 				}
@@ -1606,6 +1872,8 @@ void FileBrowser::DisplayDiskInfo(DiskImage* diskImage, const char* filenameForI
 				unsigned length = diskImage->TrackLength(track);
 				unsigned countSync = 0;
 
+				diskImage->EncodeTrack(track);
+
 				u8 shiftReg = 0;
 				for (index = 0; index < length / 8; ++index)
 				{
@@ -1930,9 +2198,9 @@ void FileBrowser::SelectAutoMountImage(const char* image)
 
 		for (index = 0; index < maxEntries; ++index)
 		{
-			current = &folder.entries[index];
-			if (strcasecmp(current->filImage.fname, image) == 0)
+			if (strcasecmp(folder.entries.Name(index), image) == 0)
 			{
+				current = &folder.entries[index];
 				break;
 			}
 		}
@@ -1943,7 +2211,7 @@ void FileBrowser::SelectAutoMountImage(const char* image)
 			caddySelections.entries.push_back(*current);
 			selectionsMade = FillCaddyWithSelections();
 			if (selectionsMade)
-				lastSelectionName = current->filImage.fname;
+				lastSelectionName = image;
 		}
 	}
 }
@@ -1964,10 +2232,10 @@ int FileBrowser::BrowsableList::FindNextAutoName(char* filename)
 
 	for (index = 0; index < len; ++index)
 	{
-		Entry* entry = &entries[index];
-		if (	!(entry->filImage.fattrib & AM_DIR) 
-			&& strncasecmp(filename, entry->filImage.fname, inputlen) == 0
-			&& sscanf(entry->filImage.fname, scanfname, &foundnumber) == 1
+		const char* name = entries.Name(index);
+		if (	!(entries.Attrib(index) & AM_DIR) 
+			&& strncasecmp(filename, name, inputlen) == 0
+			&& sscanf(name, scanfname, &foundnumber) == 1
 			)
 		{
 			if (foundnumber > lastNumber)
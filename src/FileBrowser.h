@@ -29,6 +29,7 @@
 #endif
 #include <string>
 #include <list>
+#include <map>
 #include <vector>
 #include "types.h"
 #include "DiskImage.h"
@@ -62,6 +63,26 @@ class FileBrowser
 {
 public:
 
+	// A folder's entries sorted as compact records, with every name in one string pool.
+	struct FolderIndex
+	{
+		static const u32 NO_ICON = 0xffffffff;
+
+		struct Record
+		{
+			u32 hash;		// Of the lower cased name
+			u32 name;		// Offset into names
+			u32 icon;		// Offset into names of the icon's file name or NO_ICON
+			u32 size;
+			u8 attrib;
+		};
+
+		const char* Name(u32 index) const { return &names[records[index].name]; }
+
+		std::vector<Record> records;
+		std::vector<char> names;
+	};
+
 	class BrowsableList;
 
 	class BrowsableListView
@@ -156,15 +177,54 @@ public:
 			int caddyIndex;
 		};
 
+		// Either a vector of entries (the caddy selections and devices) or a folder paged in from its FolderIndex.
+		// Paged, an entry is only materialised when asked for and TrimEntries() drops those no longer shown.
+		// Name() and Attrib() read the records directly so searching does not materialise anything.
+		class EntryList
+		{
+		public:
+			EntryList() : folderIndex(0), parent(false)
+			{
+			}
+
+			void Page(const FolderIndex* folderIndex, bool parent);
+			bool Paged() const { return folderIndex != 0; }
+
+			u32 size() const { return folderIndex ? folderIndex->records.size() + parent : entries.size(); }
+			bool empty() const { return size() == 0; }
+			Entry& operator[](u32 index) { return folderIndex ? Materialise(index) : entries[index]; }
+			const char* Name(u32 index) const;
+			u8 Attrib(u32 index) const;
+
+			void clear();
+			void push_back(const Entry& entry) { entries.push_back(entry); }
+			std::vector<Entry>::iterator begin() { return entries.begin(); }
+			std::vector<Entry>::iterator end() { return entries.end(); }
+			std::vector<Entry>::iterator erase(std::vector<Entry>::iterator it) { return entries.erase(it); }
+
+			void ClearCaddyIndices();
+			// Drops materialised entries outside [first, last) of each window other than the current and selected ones.
+			void Trim(const std::vector<std::pair<u32, u32> >& windows, u32 currentIndex);
+
+		private:
+			Entry& Materialise(u32 index);
+
+			std::vector<Entry> entries;
+			const FolderIndex* folderIndex;
+			bool parent;	// A ".." entry before the records
+			std::map<u32, Entry> materialised;
+		};
+
 		Entry* FindEntry(const char* name);
 		int FindNextAutoName(char* basename);
 
 		void RefreshViews();
 		void RefreshViewsHighlightScroll();
 		bool CheckBrowseNavigation();
+		void TrimEntries();
 
 		InputMappings* inputMappings;
-		std::vector<Entry> entries;
+		EntryList entries;
 		Entry* current;
 		u32 currentIndex;
 		float currentHighlightTime;
@@ -212,6 +272,13 @@ public:
 
 	static void RefreshDevicesEntries(std::vector<FileBrowser::BrowsableList::Entry>& entries, bool toLower);
 
+	// The current folder's index (without "..") with icons joined, as shared by the browser and the IEC $ listing.
+	// Indices of the last few folders are kept until something of ours changes a folder or the folder's timestamp changes.
+	// The browser's one is left untouched until it asks again; any other is only valid until the next call.
+	static const FolderIndex* FolderListing(bool browsing = false);
+	// Called (from any core) after we create, delete, rename or resize a file.
+	static void InvalidateFolderListings() { __atomic_add_fetch(&folderListingGeneration, 1, __ATOMIC_RELEASE); }
+
 	bool MakeLST(const char* filenameLST);
 	bool MakeLSTFromDir(const char* dir, const char *lstfn);
 	bool SelectLST(const char* filenameLST);
@@ -221,6 +288,8 @@ public:
 	void DeviceSwitched();
 
 private:
+	static unsigned folderListingGeneration;
+
 	void DisplayPNG(FILINFO& filIcon, int x, int y);
 	void RefreshFolderEntries();
 
@@ -251,6 +320,7 @@ private:
 	} state;
 
 	BrowsableList folder;
+	std::list<FILINFO> lstImages;	// The caddy's images refer to these, as folder entries can be dropped once off screen
 	DiskCaddy* diskCaddy;
 	bool selectionsMade;
 	const char* lastSelectionName;
@@ -0,0 +1,166 @@
+// Pi1541 - A Commodore 1541 disk drive emulator
+// Copyright(C) 2018 Stephen White
+//
+// This file is part of Pi1541.
+//
+// Pi1541 is free software : you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Pi1541 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Pi1541. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef IMAGEHASH_H
+#define IMAGEHASH_H
+
+#include "types.h"
+#include <string.h>
+
+// XXH64 (https://github.com/Cyan4973/xxHash) with a seed of 0, so a value can be checked with `xxhsum -H1 image`.
+// It takes the data 8 bytes at a time across four independent lanes and can be fed a chunk at a time
+// (eg as an image is read) giving the same result as hashing the whole buffer at once.
+class ImageHash
+{
+public:
+	ImageHash()
+	{
+		Reset();
+	}
+
+	void Reset()
+	{
+		lanes[0] = PRIME1 + PRIME2;
+		lanes[1] = PRIME2;
+		lanes[2] = 0;
+		lanes[3] = 0 - PRIME1;
+		total = 0;
+		buffered = 0;
+	}
+
+	void Update(const void* data, unsigned length)
+	{
+		const u8* bytes = (const u8*)data;
+
+		total += length;
+		if (buffered)
+		{
+			unsigned take = STRIPE - buffered;
+			if (take > length)
+				take = length;
+			memcpy(buffer + buffered, bytes, take);
+			buffered += take;
+			bytes += take;
+			length -= take;
+			if (buffered < STRIPE)
+				return;
+			Stripe(buffer);
+			buffered = 0;
+		}
+		while (length >= STRIPE)
+		{
+			Stripe(bytes);
+			bytes += STRIPE;
+			length -= STRIPE;
+		}
+		memcpy(buffer, bytes, length);
+		buffered = length;
+	}
+
+	u64 Final() const
+	{
+		u64 hash;
+		const u8* bytes = buffer;
+		unsigned length = buffered;
+
+		if (total >= STRIPE)
+		{
+			hash = Rotate(lanes[0], 1) + Rotate(lanes[1], 7) + Rotate(lanes[2], 12) + Rotate(lanes[3], 18);
+			for (unsigned lane = 0; lane < 4; ++lane)
+				hash = (hash ^ Round(0, lanes[lane])) * PRIME1 + PRIME4;
+		}
+		else
+		{
+			hash = PRIME5;
+		}
+		hash += total;
+
+		for (; length >= 8; bytes += 8, length -= 8)
+			hash = Rotate(hash ^ Round(0, Load64(bytes)), 27) * PRIME1 + PRIME4;
+		if (length >= 4)
+		{
+			hash = Rotate(hash ^ (Load32(bytes) * PRIME1), 23) * PRIME2 + PRIME3;
+			bytes += 4;
+			length -= 4;
+		}
+		for (; length; ++bytes, --length)
+			hash = Rotate(hash ^ (*bytes * PRIME5), 11) * PRIME1;
+
+		hash ^= hash >> 33;
+		hash *= PRIME2;
+		hash ^= hash >> 29;
+		hash *= PRIME3;
+		hash ^= hash >> 32;
+		return hash;
+	}
+
+	static u64 Hash(const void* data, unsigned length)
+	{
+		ImageHash imageHash;
+		imageHash.Update(data, length);
+		return imageHash.Final();
+	}
+
+private:
+	static const unsigned STRIPE = 32;
+	static const u64 PRIME1 = 0x9E3779B185EBCA87ULL;
+	static const u64 PRIME2 = 0xC2B2AE3D27D4EB4FULL;
+	static const u64 PRIME3 = 0x165667B19E3779F9ULL;
+	static const u64 PRIME4 = 0x85EBCA77C2B2AE63ULL;
+	static const u64 PRIME5 = 0x27D4EB2F165667C5ULL;
+
+	static inline u64 Rotate(u64 value, unsigned bits)
+	{
+		return (value << bits) | (value >> (64 - bits));
+	}
+
+	static inline u64 Round(u64 lane, u64 input)
+	{
+		return Rotate(lane + input * PRIME2, 31) * PRIME1;
+	}
+
+	// Little endian, whatever the alignment
+	static inline u64 Load64(const u8* bytes)
+	{
+		u64 value;
+		memcpy(&value, bytes, sizeof(value));
+		return value;
+	}
+
+	static inline u64 Load32(const u8* bytes)
+	{
+		u32 value;
+		memcpy(&value, bytes, sizeof(value));
+		return value;
+	}
+
+	inline void Stripe(const u8* bytes)
+	{
+		lanes[0] = Round(lanes[0], Load64(bytes));
+		lanes[1] = Round(lanes[1], Load64(bytes + 8));
+		lanes[2] = Round(lanes[2], Load64(bytes + 16));
+		lanes[3] = Round(lanes[3], Load64(bytes + 24));
+	}
+
+	u64 lanes[4];
+	u64 total;
+	u8 buffer[STRIPE];
+	unsigned buffered;
+};
+
+#endif
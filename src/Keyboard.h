@@ -25,6 +25,9 @@
 #elif defined(__PICO2__)
 
 #elif defined(ESP32)
+#elif defined(__HOST__)
+struct TUSBKeyboardDevice;
+#include "rpi-base.h"
 #else
 extern "C"
 {
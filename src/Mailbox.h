@@ -0,0 +1,149 @@
+// Pi1541 - A Commodore 1541 disk drive emulator
+// Copyright(C) 2018 Stephen White
+//
+// This file is part of Pi1541.
+//
+// Pi1541 is free software : you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Pi1541 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Pi1541. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef MAILBOX_H
+#define MAILBOX_H
+
+#include "types.h"
+
+// Lock free single producer, single consumer ring for passing messages between two cores.
+// Exactly one core may Post() and exactly one (other) core may Receive().
+// SIZE must be a power of two; one slot is kept free to tell a full ring from an empty one.
+template <typename T, unsigned SIZE>
+class Mailbox
+{
+public:
+	Mailbox() : head(0), tail(0) {}
+
+	// Producer. Returns false (and drops the message) if the ring is full.
+	bool Post(const T& message)
+	{
+		unsigned next = (head + 1) & (SIZE - 1);
+		if (next == __atomic_load_n(&tail, __ATOMIC_ACQUIRE))
+			return false;
+		messages[head] = message;
+		__atomic_store_n(&head, next, __ATOMIC_RELEASE);	// Publish the message before the new head
+		return true;
+	}
+
+	// Consumer.
+	bool Receive(T& message)
+	{
+		if (tail == __atomic_load_n(&head, __ATOMIC_ACQUIRE))
+			return false;
+		message = messages[tail];
+		__atomic_store_n(&tail, (tail + 1) & (SIZE - 1), __ATOMIC_RELEASE);	// Only then hand the slot back
+		return true;
+	}
+
+	// Consumer. A cheap check before draining.
+	inline bool IsEmpty() const
+	{
+		return tail == __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+	}
+
+private:
+	unsigned head;	// Written by the producer only
+	unsigned tail;	// Written by the consumer only
+	T messages[SIZE];
+};
+
+// A value one core rewrites now and then and other cores copy whenever they like (a sequence lock).
+// Writing never waits; a copy that overlapped a write is taken again.
+template <typename T>
+class Snapshot
+{
+public:
+	Snapshot() : sequence(0) {}
+
+	// Writer. Only ever one core.
+	void Write(const T& update)
+	{
+		__atomic_store_n(&sequence, sequence + 1, __ATOMIC_RELAXED);	// Odd while writing
+		__atomic_thread_fence(__ATOMIC_RELEASE);
+		value = update;
+		__atomic_store_n(&sequence, sequence + 1, __ATOMIC_RELEASE);
+	}
+
+	// Readers.
+	void Read(T& copy) const
+	{
+		unsigned before;
+		do
+		{
+			while ((before = __atomic_load_n(&sequence, __ATOMIC_ACQUIRE)) & 1)
+				;
+			copy = value;
+			__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		} while (__atomic_load_n(&sequence, __ATOMIC_RELAXED) != before);
+	}
+
+private:
+	unsigned sequence;
+	T value;
+};
+
+// Requests from the network core to the emulator core.
+// The emulator only drains them every so many cycles so they are handled within a millisecond or so, not immediately.
+struct EmulatorCommand
+{
+	enum Type
+	{
+		MOUNT_IMAGE,		// Leave emulation and mount image from path
+		MOUNT_LST,			// Leave emulation and select the images listed in image (in path)
+		AUTOLOAD,			// The automount image has been rewritten; restart with it
+		SWAP_DISK,			// Insert the caddy's image at index
+		EXIT,				// Leave emulation back to the browser
+		OPTIONS_CHANGED,	// options.txt (or config.txt) has been rewritten; reported until the next boot
+		STATUS_REQUEST,		// Post an EmulatorStatus back
+		PURGE_TRACK_CACHE,	// Empty the converted track cache (once back in the browser)
+		RESET				// Leave emulation as though the computer had reset the bus
+	};
+
+	Type type;
+	int index;
+	char path[256];
+	char image[256];
+};
+
+// Replies from the emulator core to a STATUS_REQUEST.
+struct EmulatorStatus
+{
+	u32 sequence;			// Increments with each status posted
+	u8 emulating;			// EmulatingMode
+	u8 deviceID;
+	u8 halfTrack;			// Track * 2 on the 1581
+	bool motor;
+	bool LED;
+	bool optionsChanged;
+	u8 selectedIndex;		// Image in the caddy
+	u8 numberOfImages;
+	bool diskInserted;		// The selected image is in the drive (never when browsing)
+};
+
+// The caddy's image names, published by the emulator core whenever they may have changed (never from the emulation loops).
+struct EmulatorCaddy
+{
+	char names[1024];		// Each followed by '\n', as many as fit
+};
+
+typedef Mailbox<EmulatorCommand, 8> EmulatorCommandMailbox;
+typedef Mailbox<EmulatorStatus, 4> EmulatorStatusMailbox;
+typedef Snapshot<EmulatorCaddy> EmulatorCaddySnapshot;
+
+#endif
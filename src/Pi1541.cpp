@@ -17,9 +17,12 @@
 // along with Pi1541. If not, see <http://www.gnu.org/licenses/>.
 
 #include "Pi1541.h"
+#include "DataBus.h"
 #include "debug.h"
 #include "options.h"
 #include "ROMs.h"
+#include <stdlib.h>
+#include <string.h>
 
 extern Options options;
 extern Pi1541 pi1541;
@@ -34,62 +37,16 @@ extern ROMs roms;
 // 74LS42 Ouputs a low to the !CS based on the four inputs provided by address bits 10-13
 // 1800 !cs2 on pin 9
 // 1c00 !cs2 on pin 7
+static DataBus dataBus;
+
 u8 read6502(u16 address)
 {
-	u8 value = 0;
-	if (address & 0x8000)
-	{
-		switch (address & 0xe000) // keep bits 15,14,13
-		{
-			case 0x8000: // 0x8000-0x9fff
-				if (options.GetRAMBOard()) {
-					value = s_u8Memory[address]; // 74LS42 outputs low on pin 1 or pin 2
-					break;
-				}
-			case 0xa000: // 0xa000-0xbfff
-			case 0xc000: // 0xc000-0xdfff
-			case 0xe000: // 0xe000-0xffff
-				value = roms.Read(address);
-				break;
-		}
-	}
-	else
-	{
-		// Address lines 15, 12, 11 and 10 are fed into a 74LS42 for decoding
-		u16 addressLines12_11_10 = (address & 0x1c00) >> 10;
-		switch (addressLines12_11_10)
-		{
-			case 0:
-			case 1:
-				value = s_u8Memory[address & 0x7ff]; // 74LS42 outputs low on pin 1 or pin 2
-				break;
-			case 6:
-				value = pi1541.VIA[0].Read(address);	// 74LS42 outputs low on pin 7
-				break;
-			case 7:
-				value = pi1541.VIA[1].Read(address);	// 74LS42 outputs low on pin 9
-				break;
-			default:
-				value = address >> 8;	// Empty address bus
-				break;
-		}
-	}
-	return value;
+	return dataBus.Read(address);
 }
 
-// Allows a mode where we have RAM at all addresses other than the ROM and the VIAs. (Maybe useful to someone?)
-u8 read6502ExtraRAM(u16 address)
+void write6502(u16 address, const u8 value)
 {
-	if (address & 0x8000)
-	{
-		return roms.Read(address);
-	}
-	else
-	{
-		u16 addressLines11And12 = address & 0x1800;
-		if (addressLines11And12 == 0x1800) return pi1541.VIA[(address & 0x400) != 0].Read(address);	// address line 10 indicates what VIA to index
-		return s_u8Memory[address & 0x7fff];
-	}
+	dataBus.Write(address, value);
 }
 
 // Use for debugging (Reads VIA registers without the regular VIA read side effects)
@@ -113,57 +70,18 @@ u8 peek6502(u16 address)
 	return value;
 }
 
-void write6502(u16 address, const u8 value)
-{
-	if (address & 0x8000)
-	{
-		switch (address & 0xe000) // keep bits 15,14,13
-		{
-			case 0x8000: // 0x8000-0x9fff
-				if (options.GetRAMBOard()) {
-					s_u8Memory[address] = value; // 74LS42 outputs low on pin 1 or pin 2
-					break;
-				}
-			case 0xa000: // 0xa000-0xbfff
-			case 0xc000: // 0xc000-0xdfff
-			case 0xe000: // 0xe000-0xffff
-				return;
-		}
-	}
-	else
-	{
-		// Address lines 15, 12, 11 and 10 are fed into a 74LS42 for decoding
-		u16 addressLines12_11_10 = (address & 0x1c00) >> 10;
-		switch (addressLines12_11_10)
-		{
-			case 0:
-			case 1:
-				s_u8Memory[address & 0x7ff] = value; // 74LS42 outputs low on pin 1 or pin 2
-				break;
-			case 6:
-				pi1541.VIA[0].Write(address, value);	// 74LS42 outputs low on pin 7
-				break;
-			case 7:
-				pi1541.VIA[1].Write(address, value);	// 74LS42 outputs low on pin 9
-				break;
-			default:
-				break;
-		}
-	}
-}
-
-void write6502ExtraRAM(u16 address, const u8 value)
-{
-	if (address & 0x8000) return; // address line 15 selects the ROM
-	u16 addressLines11And12 = address & 0x1800;
-	if (addressLines11And12 == 0) s_u8Memory[address & 0x7fff] = value;
-	else if (addressLines11And12 == 0x1800) pi1541.VIA[(address & 0x400) != 0].Write(address, value);	// address line 10 indicates what VIA to index
-}
+static u8 ReadVIA0(u16 address) { return pi1541.VIA[0].Read(address); }
+static u8 ReadVIA1(u16 address) { return pi1541.VIA[1].Read(address); }
+static void WriteVIA0(u16 address, const u8 value) { pi1541.VIA[0].Write(address, value); }
+static void WriteVIA1(u16 address, const u8 value) { pi1541.VIA[1].Write(address, value); }
 
 Pi1541::Pi1541()
 {
 	VIA[0].ConnectIRQ(&m6502.IRQ);
 	VIA[1].ConnectIRQ(&m6502.IRQ);
+	bootStateValid = false;
+	bootStateRAM = 0;
+	bootStateRAMSize = 0;
 }
 
 void Pi1541::Initialise()
@@ -216,3 +134,101 @@ void Pi1541::Reset()
 	VIABortB->SetInput(VIAPORTPINS_ATNAOUT, true);
 }
 
+// Everything other than the ROM that changes what the self test leaves behind.
+u32 Pi1541::BootStateConfig()
+{
+	u32 config = VIA[0].GetPortB()->GetInput() & (VIAPORTPINS_DEVSEL0 | VIAPORTPINS_DEVSEL1);
+	if (options.GetExtraRAM()) config |= 0x100;
+	if (options.GetRAMBOard()) config |= 0x200;
+	return config;
+}
+
+// Only the RAM the 6502 can actually see needs to be kept.
+u32 Pi1541::BootStateRAMSize()
+{
+	if (options.GetExtraRAM())
+		return 0x8000;
+	else if (options.GetRAMBOard())
+		return 0xa000;
+	return 0x800;
+}
+
+void Pi1541::SaveBootState(u32 ROMHash)
+{
+	u32 RAMSize = BootStateRAMSize();
+
+	if (RAMSize > bootStateRAMSize)
+	{
+		free(bootStateRAM);
+		bootStateRAM = (u8*)malloc(RAMSize);
+		bootStateRAMSize = bootStateRAM ? RAMSize : 0;
+	}
+	bootStateValid = bootStateRAM != 0;
+	if (!bootStateValid)
+		return;
+
+	bootStateROMHash = ROMHash;
+	bootStateConfig = BootStateConfig();
+	bootStateCPU = m6502;
+	bootStateVIA[0] = VIA[0];
+	bootStateVIA[1] = VIA[1];
+	bootStateDrive = drive;
+	memcpy(bootStateRAM, s_u8Memory, RAMSize);
+}
+
+bool Pi1541::RestoreBootState(u32 ROMHash)
+{
+	if (!bootStateValid || bootStateROMHash != ROMHash || bootStateConfig != BootStateConfig())
+		return false;
+
+	m6502 = bootStateCPU;
+	VIA[0] = bootStateVIA[0];
+	VIA[1] = bootStateVIA[1];
+	drive.RestoreState(bootStateDrive);	// Must come after the VIAs as it sets the write protect input
+	memcpy(s_u8Memory, bootStateRAM, BootStateRAMSize());
+
+	// Bring the bus latches back in line with what the VIA is now driving.
+	IOPort* VIABortB = VIA[0].GetPortB();
+	IEC_Bus::PortB_OnPortOut(0, VIABortB->GetOutput() & VIABortB->GetDirection());
+	return true;
+}
+
+// Lays out the address space for the RAM options and the ROM currently selected.
+void Pi1541::ConfigureDataBus()
+{
+	const u8* ROM = roms.GetCurrentROM();
+
+	if (options.GetExtraRAM())
+	{
+		// Allows a mode where we have RAM at all addresses other than the ROM and the VIAs. (Maybe useful to someone?)
+		// Address lines 11 and 12 select the VIAs (line 10 indicates which) and only RAM with both low is writable.
+		for (unsigned block = 0; block < 0x8000; block += 0x2000)
+		{
+			dataBus.MapRead(block, block + 0x17ff, s_u8Memory, 0x7fff);
+			dataBus.MapWrite(block, block + 0x07ff, s_u8Memory, 0x7fff);
+			dataBus.MapDevice(block + 0x0800, block + 0x17ff, 0, DataBus::IgnoreWrite);
+			dataBus.MapDevice(block + 0x1800, block + 0x1bff, ReadVIA0, WriteVIA0);
+			dataBus.MapDevice(block + 0x1c00, block + 0x1fff, ReadVIA1, WriteVIA1);
+		}
+		dataBus.MapROM(0x8000, 0xffff, ROM, 0x3fff);
+		return;
+	}
+
+	// Address lines 13 and 14 are not decoded so everything below 0x8000 repeats every 0x2000.
+	for (unsigned block = 0; block < 0x8000; block += 0x2000)
+	{
+		dataBus.MapMemory(block, block + 0x07ff, s_u8Memory, 0x7ff);	// 74LS42 outputs low on pin 1 or pin 2
+		dataBus.MapOpenBus(block + 0x0800, block + 0x17ff);
+		dataBus.MapDevice(block + 0x1800, block + 0x1bff, ReadVIA0, WriteVIA0);	// 74LS42 outputs low on pin 7
+		dataBus.MapDevice(block + 0x1c00, block + 0x1fff, ReadVIA1, WriteVIA1);	// 74LS42 outputs low on pin 9
+	}
+	if (options.GetRAMBOard())
+	{
+		dataBus.MapMemory(0x8000, 0x9fff, s_u8Memory, 0xffff);
+		dataBus.MapROM(0xa000, 0xffff, ROM, 0x3fff);
+	}
+	else
+	{
+		dataBus.MapROM(0x8000, 0xffff, ROM, 0x3fff);
+	}
+}
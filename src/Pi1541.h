@@ -35,6 +35,15 @@ public:
 
 	void Reset();
 
+	// Decodes the 6502 address space for the current ROM and RAM options.
+	// Must be called before emulating if either has changed.
+	void ConfigureDataBus();
+
+	// Machine state captured once the DOS has finished its power on self test.
+	// Only valid for the ROM, RAM configuration and device number it was taken with.
+	void SaveBootState(u32 ROMHash);
+	bool RestoreBootState(u32 ROMHash);
+
 	//void ConfigureOfExtraRAM(bool extraRAM);
 
 	Drive drive;
@@ -55,6 +64,18 @@ public:
 	}
 
 private:
+	u32 BootStateConfig();
+	u32 BootStateRAMSize();
+
+	bool bootStateValid;
+	u32 bootStateROMHash;
+	u32 bootStateConfig;
+	M6502 bootStateCPU;
+	m6522 bootStateVIA[2];
+	Drive bootStateDrive;
+	u8* bootStateRAM;
+	u32 bootStateRAMSize;
+
 	//u8 Memory[0xc000];
 
 	//static u8 Read6502(u16 address, void* data);
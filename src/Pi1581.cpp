@@ -18,6 +18,7 @@
 
 #include "defs.h"
 #include "Pi1581.h"
+#include "DataBus.h"
 #include "iec_bus.h"
 #include "options.h"
 #include "ROMs.h"
@@ -91,34 +92,11 @@ extern u16 pc;
 // RAM
 // 0-$1fff
 
+static DataBus dataBus;
+
 u8 read6502_1581(u16 address)
 {
-	u8 value = 0;
-#if defined(PI1581SUPPORT)
-	if (address & 0x8000)
-	{
-		value = roms.Read1581(address);
-	}
-	else if (address >= 0x6000)
-	{
-		value = pi1581.wd177x.Read(address);
-		//DEBUG_LOG("177x r %04x %02x %04x\r\n", address, value, pc);
-	}
-	else if (address >= 0x4000)
-	{
-		value = pi1581.CIA.Read(address);
-		//DEBUG_LOG("CIA r %04x %02x %04x\r\n", address, value, pc);
-	}
-	else if (address < 0x2000)
-	{
-		value = s_u8Memory[address & 0x1fff];
-	}
-	else
-	{
-		value = address >> 8;	// Empty address bus
-	}
-#endif
-	return value;
+	return dataBus.Read(address);
 }
 
 // Use for debugging (Reads VIA registers without the regular VIA read side effects)
@@ -130,27 +108,15 @@ u8 peek6502_1581(u16 address)
 
 void write6502_1581(u16 address, const u8 value)
 {
+	dataBus.Write(address, value);
+}
+
 #if defined(PI1581SUPPORT)
-	if (address & 0x8000)
-	{
-		return;
-	}
-	else if (address >= 0x6000)
-	{
-		//DEBUG_LOG("177x w %04x %02x %04x\r\n", address, value, pc);
-		pi1581.wd177x.Write(address, value);
-	}
-	else if (address >= 0x4000)
-	{
-		//DEBUG_LOG("CIA w %04x %02x %04x\r\n", address, value, pc);
-		pi1581.CIA.Write(address, value);
-	}
-	else if (address < 0x2000)
-	{
-		s_u8Memory[address & 0x1fff] = value;
-	}
+static u8 Read177x(u16 address) { return pi1581.wd177x.Read(address); }
+static u8 ReadCIA(u16 address) { return pi1581.CIA.Read(address); }
+static void Write177x(u16 address, const u8 value) { pi1581.wd177x.Write(address, value); }
+static void WriteCIA(u16 address, const u8 value) { pi1581.CIA.Write(address, value); }
 #endif
-}
 
 static void CIAPortA_OnPortOut(void* pUserData, unsigned char status)
 {
@@ -289,6 +255,17 @@ void Pi1581::Reset()
 	CIABPortB->SetInput(VIAPORTPINS_ATNAOUT, true);
 }
 
+void Pi1581::ConfigureDataBus()
+{
+#if defined(PI1581SUPPORT)
+	dataBus.MapMemory(0x0000, 0x1fff, s_u8Memory, 0x1fff);
+	dataBus.MapOpenBus(0x2000, 0x3fff);
+	dataBus.MapDevice(0x4000, 0x5fff, ReadCIA, WriteCIA);
+	dataBus.MapDevice(0x6000, 0x7fff, Read177x, Write177x);
+	dataBus.MapROM(0x8000, 0xffff, roms.ROMImage1581, 0x7fff);
+#endif
+}
+
 void Pi1581::SetDeviceID(u8 id)
 {
 	CIA.GetPortA()->SetInput(PORTA_PINS_DEVSEL0, id & 1);
@@ -37,6 +37,9 @@ public:
 
 	void Reset();
 
+	// Decodes the 6502 address space. Must be called before emulating.
+	void ConfigureDataBus();
+
 	void SetDeviceID(u8 id);
 
 	void Insert(DiskImage* diskImage);
@@ -35,6 +35,10 @@ public:
 	{
 		return ROMImages[currentROMIndex][address & 0x3fff];
 	}
+	inline const u8* GetCurrentROM() const
+	{
+		return ROMImages[currentROMIndex];
+	}
 	inline u8 ReadMPS802(u16 address)
 	{
 		return ROMImageMPS802[address & 0x1fff];
@@ -0,0 +1,544 @@
+// Pi1541 - A Commodore 1541 disk drive emulator
+// Copyright(C) 2018 Stephen White
+//
+// This file is part of Pi1541.
+//
+// Pi1541 is free software : you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Pi1541 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Pi1541. If not, see <http://www.gnu.org/licenses/>.
+
+#include "ZipArchive.h"
+#include "DiskImage.h"
+#include <string.h>
+#include <string>
+
+#define ZIP_LOCAL_SIGNATURE		0x04034b50
+#define ZIP_CENTRAL_SIGNATURE	0x02014b50
+#define ZIP_END_SIGNATURE		0x06054b50
+#define ZIP_LOCAL_SIZE			30
+#define ZIP_CENTRAL_SIZE		46
+#define ZIP_END_SIZE			22
+#define ZIP_MAX_COMMENT			0xffff
+#define ZIP_ENCRYPTED			0x0001
+#define ZIP_STORED				0
+#define ZIP_DEFLATED			8
+
+#define INFLATE_WINDOW			32768	// The furthest back deflate can refer
+#define INFLATE_INPUT			8192
+
+static inline u32 Read16(const u8* bytes)
+{
+	return bytes[0] | (bytes[1] << 8);
+}
+
+static inline u32 Read32(const u8* bytes)
+{
+	return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | ((u32)bytes[3] << 24);
+}
+
+static bool ReadAt(FIL* fp, FSIZE_t offset, void* buffer, UINT length)
+{
+	UINT bytesRead;
+	return f_lseek(fp, offset) == FR_OK && f_read(fp, buffer, length, &bytesRead) == FR_OK && bytesRead == length;
+}
+
+static u32 crcTable[256];
+
+static void Crc32Init()
+{
+	for (u32 index = 0; index < 256; ++index)
+	{
+		u32 crc = index;
+		for (int bit = 0; bit < 8; ++bit)
+			crc = (crc & 1) ? (crc >> 1) ^ 0xedb88320 : crc >> 1;
+		crcTable[index] = crc;
+	}
+}
+
+static u32 Crc32(u32 crc, const u8* data, unsigned length)
+{
+	crc = ~crc;
+	while (length--)
+		crc = crcTable[(crc ^ *data++) & 0xff] ^ (crc >> 8);
+	return ~crc;
+}
+
+static const u16 lengthBase[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const u8 lengthExtra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const u16 distanceBase[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+static const u8 distanceExtra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+static const u8 codeLengthOrder[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+// Decodes one member (RFC 1951), pulling its compressed bytes from the archive a buffer at a time
+// and writing the output whenever the window fills.
+class Inflater
+{
+public:
+	Inflater()
+	{
+		u8 lengths[288 + 30];
+		unsigned symbol;
+
+		Crc32Init();
+		for (symbol = 0; symbol < 144; ++symbol)
+			lengths[symbol] = 8;
+		for (; symbol < 256; ++symbol)
+			lengths[symbol] = 9;
+		for (; symbol < 280; ++symbol)
+			lengths[symbol] = 7;
+		for (; symbol < 288; ++symbol)
+			lengths[symbol] = 8;
+		Build(fixedLengths, lengths, 288);
+		memset(lengths, 5, 30);
+		Build(fixedDistances, lengths, 30);
+	}
+
+	void Begin(FIL* in, FIL* out, u32 compressedSize)
+	{
+		this->in = in;
+		this->out = out;
+		remaining = compressedSize;
+		inPos = inEnd = input;
+		inError = false;
+		bitBuffer = 0;
+		bitCount = 0;
+		windowPos = 0;
+		crc = 0;
+		written = 0;
+		writeFailed = false;
+	}
+
+	bool Stored()
+	{
+		while (remaining && !writeFailed)
+		{
+			if (!Refill())
+				return false;
+			Write(input, inEnd - input);
+			inPos = inEnd;
+		}
+		return !writeFailed;
+	}
+
+	bool Inflate()
+	{
+		bool ok;
+		u32 last;
+		do
+		{
+			last = Bits(1);
+			switch (Bits(2))
+			{
+				case 0:
+					ok = StoredBlock();
+				break;
+				case 1:
+					ok = Codes(fixedLengths, fixedDistances);
+				break;
+				case 2:
+					ok = DynamicBlock();
+				break;
+				default:
+					ok = false;
+				break;
+			}
+		}
+		while (ok && !last);
+		return Flush() && ok && !inError;
+	}
+
+	u32 crc;
+	u32 written;
+	bool writeFailed;
+
+private:
+	struct Huffman
+	{
+		u16 counts[16];		// Number of codes of each length
+		u16 symbols[288];	// Symbols ordered by code
+	};
+
+	bool Refill()
+	{
+		UINT bytesRead;
+		UINT length = remaining < INFLATE_INPUT ? remaining : INFLATE_INPUT;
+		if (length == 0 || f_read(in, input, length, &bytesRead) != FR_OK || bytesRead != length)
+			return false;
+		remaining -= length;
+		inPos = input;
+		inEnd = input + length;
+		return true;
+	}
+
+	inline u32 NextByte()
+	{
+		if (inPos == inEnd && !Refill())
+		{
+			inError = true;
+			return 0;
+		}
+		return *inPos++;
+	}
+
+	inline u32 Bits(unsigned count)
+	{
+		while (bitCount < count)
+		{
+			bitBuffer |= NextByte() << bitCount;
+			bitCount += 8;
+		}
+		u32 value = bitBuffer & ((1 << count) - 1);
+		bitBuffer >>= count;
+		bitCount -= count;
+		return value;
+	}
+
+	// Canonical codes are consecutive within a length, so a bit at a time is enough to find the symbol.
+	int Decode(const Huffman& huffman)
+	{
+		int code = 0;
+		int first = 0;
+		int index = 0;
+		for (int length = 1; length < 16; ++length)
+		{
+			code |= Bits(1);
+			int count = huffman.counts[length];
+			if (code - count < first)
+				return huffman.symbols[index + (code - first)];
+			index += count;
+			first = (first + count) << 1;
+			code <<= 1;
+		}
+		return -1;
+	}
+
+	static bool Build(Huffman& huffman, const u8* lengths, unsigned count)
+	{
+		u16 offsets[16];
+		unsigned symbol;
+		int length;
+		int left = 1;
+
+		memset(huffman.counts, 0, sizeof(huffman.counts));
+		for (symbol = 0; symbol < count; ++symbol)
+			huffman.counts[lengths[symbol]]++;
+		for (length = 1; length < 16; ++length)
+		{
+			left = (left << 1) - huffman.counts[length];
+			if (left < 0)
+				return false;	// Over-subscribed
+		}
+		offsets[1] = 0;
+		for (length = 1; length < 15; ++length)
+			offsets[length + 1] = offsets[length] + huffman.counts[length];
+		for (symbol = 0; symbol < count; ++symbol)
+		{
+			if (lengths[symbol])
+				huffman.symbols[offsets[lengths[symbol]]++] = symbol;
+		}
+		return true;
+	}
+
+	inline void Put(u8 value)
+	{
+		window[windowPos++] = value;
+		if (windowPos == INFLATE_WINDOW)
+			Flush();
+	}
+
+	void Write(const u8* data, unsigned length)
+	{
+		UINT bytesWritten;
+		crc = Crc32(crc, data, length);
+		written += length;
+		if (!writeFailed && (f_write(out, data, length, &bytesWritten) != FR_OK || bytesWritten != length))
+			writeFailed = true;
+	}
+
+	bool Flush()
+	{
+		Write(window, windowPos);
+		windowPos = 0;
+		return !writeFailed;
+	}
+
+	bool StoredBlock()
+	{
+		bitBuffer = 0;
+		bitCount = 0;
+		u32 length = NextByte();
+		length |= NextByte() << 8;
+		u32 check = NextByte();
+		check |= NextByte() << 8;
+		if (length != (~check & 0xffff))
+			return false;
+		while (length-- && !inError)
+			Put(NextByte());
+		return !inError && !writeFailed;
+	}
+
+	bool DynamicBlock()
+	{
+		u8 lengths[286 + 30];
+		unsigned index;
+
+		unsigned lengthCount = Bits(5) + 257;
+		unsigned distanceCount = Bits(5) + 1;
+		unsigned codeCount = Bits(4) + 4;
+		if (lengthCount > 286 || distanceCount > 30)
+			return false;
+
+		for (index = 0; index < 19; ++index)
+			lengths[codeLengthOrder[index]] = index < codeCount ? Bits(3) : 0;
+		if (!Build(lengthCodes, lengths, 19))
+			return false;
+
+		index = 0;
+		while (index < lengthCount + distanceCount)
+		{
+			int symbol = Decode(lengthCodes);
+			if (symbol < 0 || inError)
+				return false;
+			if (symbol < 16)
+			{
+				lengths[index++] = symbol;
+				continue;
+			}
+			u8 length = 0;
+			unsigned repeat;
+			if (symbol == 16)
+			{
+				if (index == 0)
+					return false;
+				length = lengths[index - 1];
+				repeat = 3 + Bits(2);
+			}
+			else if (symbol == 17)
+				repeat = 3 + Bits(3);
+			else
+				repeat = 11 + Bits(7);
+			if (index + repeat > lengthCount + distanceCount)
+				return false;
+			while (repeat--)
+				lengths[index++] = length;
+		}
+		if (lengths[256] == 0)
+			return false;	// No end of block code
+		if (!Build(dynamicLengths, lengths, lengthCount) || !Build(dynamicDistances, lengths + lengthCount, distanceCount))
+			return false;
+		return Codes(dynamicLengths, dynamicDistances);
+	}
+
+	bool Codes(const Huffman& lengths, const Huffman& distances)
+	{
+		while (!inError && !writeFailed)
+		{
+			int symbol = Decode(lengths);
+			if (symbol < 256)
+			{
+				if (symbol < 0)
+					return false;
+				Put(symbol);
+				continue;
+			}
+			if (symbol == 256)
+				return true;
+
+			symbol -= 257;
+			if (symbol >= 29)
+				return false;
+			u32 length = lengthBase[symbol] + Bits(lengthExtra[symbol]);
+			symbol = Decode(distances);
+			if (symbol < 0 || symbol >= 30)
+				return false;
+			u32 distance = distanceBase[symbol] + Bits(distanceExtra[symbol]);
+			if (distance > written + windowPos)
+				return false;
+			u32 from = (windowPos - distance) & (INFLATE_WINDOW - 1);
+			while (length--)
+			{
+				Put(window[from]);
+				from = (from + 1) & (INFLATE_WINDOW - 1);
+			}
+		}
+		return false;
+	}
+
+	FIL* in;
+	FIL* out;
+	u32 remaining;			// Compressed bytes not yet read
+	const u8* inPos;
+	const u8* inEnd;
+	bool inError;
+	u32 bitBuffer;
+	unsigned bitCount;
+	unsigned windowPos;
+	Huffman fixedLengths;
+	Huffman fixedDistances;
+	Huffman lengthCodes;
+	Huffman dynamicLengths;
+	Huffman dynamicDistances;
+	u8 input[INFLATE_INPUT];
+	u8 window[INFLATE_WINDOW];
+};
+
+// The end of central directory record is the last thing in the archive, followed only by a comment of up to 64KB.
+static bool FindCentralDirectory(FIL* zip, u8* buffer, unsigned bufferSize, u32& entries, u32& offset)
+{
+	FSIZE_t size = f_size(zip);
+	FSIZE_t limit = size > ZIP_END_SIZE + ZIP_MAX_COMMENT ? size - (ZIP_END_SIZE + ZIP_MAX_COMMENT) : 0;
+	FSIZE_t end = size;
+
+	while (end - limit >= ZIP_END_SIZE)
+	{
+		FSIZE_t start = end - limit > bufferSize ? end - bufferSize : limit;
+		if (!ReadAt(zip, start, buffer, end - start))
+			return false;
+		for (int index = end - start - ZIP_END_SIZE; index >= 0; --index)
+		{
+			const u8* record = buffer + index;
+			if (Read32(record) == ZIP_END_SIGNATURE && start + index + ZIP_END_SIZE + Read16(record + 20) == size)
+			{
+				if (Read16(record + 4) != 0 || Read16(record + 6) != 0)
+					return false;	// Spanned across several disks
+				entries = Read16(record + 10);
+				offset = Read32(record + 16);
+				return entries != 0xffff && offset != 0xffffffff;	// Or ZIP64
+			}
+		}
+		if (start == limit)
+			break;
+		end = start + ZIP_END_SIZE - 1;
+	}
+	return false;
+}
+
+static ZipArchive::Result ExtractMember(FIL* zip, Inflater* inflater, const u8* central, const char* target)
+{
+	u8 local[ZIP_LOCAL_SIZE];
+	u32 offset = Read32(central + 42);
+
+	if (!ReadAt(zip, offset, local, ZIP_LOCAL_SIZE) || Read32(local) != ZIP_LOCAL_SIGNATURE)
+		return ZipArchive::CORRUPT;
+	if (f_lseek(zip, offset + ZIP_LOCAL_SIZE + Read16(local + 26) + Read16(local + 28)) != FR_OK)
+		return ZipArchive::CORRUPT;
+
+	// Never over an existing file, be it one from before or an earlier member of the same name from another folder
+	FIL out;
+	FRESULT res = f_open(&out, target, FA_CREATE_NEW | FA_WRITE);
+	if (res == FR_EXIST)
+		return ZipArchive::EXISTS;
+	if (res != FR_OK)
+		return ZipArchive::WRITE_FAILED;
+
+	// The sizes and CRC in the local header may be left 0 and follow the data instead; the central directory always has them.
+	inflater->Begin(zip, &out, Read32(central + 20));
+	bool ok = Read16(central + 10) == ZIP_STORED ? inflater->Stored() : inflater->Inflate();
+
+	ZipArchive::Result result = ZipArchive::EXTRACTED;
+	if (inflater->writeFailed)
+		result = ZipArchive::WRITE_FAILED;
+	else if (!ok || inflater->written != Read32(central + 24) || inflater->crc != Read32(central + 16))
+		result = ZipArchive::CORRUPT;
+	if (f_close(&out) != FR_OK && result == ZipArchive::EXTRACTED)
+		result = ZipArchive::WRITE_FAILED;
+	if (result != ZipArchive::EXTRACTED)
+		f_unlink(target);
+	return result;
+}
+
+int ZipArchive::Extract(const char* archive, const char* folder, Progress progress, void* context)
+{
+	FIL zip;
+	u8 header[ZIP_CENTRAL_SIZE];
+	char name[256];
+	u32 entries;
+	u32 offset;
+	int extracted = 0;
+
+	if (f_open(&zip, archive, FA_READ) != FR_OK)
+		return -1;
+
+	u8* buffer = new u8[INFLATE_INPUT];
+	bool found = FindCentralDirectory(&zip, buffer, INFLATE_INPUT, entries, offset);
+	delete[] buffer;
+	if (!found)
+	{
+		f_close(&zip);
+		return -1;
+	}
+
+	Inflater* inflater = new Inflater();
+	FSIZE_t central = offset;
+	for (u32 entry = 0; entry < entries; ++entry)
+	{
+		if (!ReadAt(&zip, central, header, ZIP_CENTRAL_SIZE) || Read32(header) != ZIP_CENTRAL_SIGNATURE)
+		{
+			extracted = -1;
+			break;
+		}
+		u32 nameLength = Read16(header + 28);
+		FSIZE_t next = central + ZIP_CENTRAL_SIZE + nameLength + Read16(header + 30) + Read16(header + 32);
+		if (nameLength >= sizeof(name) || !ReadAt(&zip, central + ZIP_CENTRAL_SIZE, name, nameLength))
+		{
+			central = next;
+			continue;
+		}
+		name[nameLength] = 0;
+		central = next;
+		if (nameLength == 0 || name[nameLength - 1] == '/')
+			continue;	// A folder
+
+		const char* fileName = name;
+		for (const char* at = name; *at; ++at)
+		{
+			if (*at == '/' || *at == '\\')
+				fileName = at + 1;
+		}
+
+		u32 method = Read16(header + 10);
+		Result result;
+		if (fileName[0] == '.' || !DiskImage::IsDiskImageExtention(fileName))
+			result = SKIPPED;
+		else if ((Read16(header + 8) & ZIP_ENCRYPTED) || (method != ZIP_STORED && method != ZIP_DEFLATED))
+			result = UNSUPPORTED;
+		else
+			result = ExtractMember(&zip, inflater, header, (std::string(folder) + "/" + fileName).c_str());
+		if (result == EXTRACTED)
+			extracted++;
+		if (progress)
+			progress(context, fileName, Read32(header + 24), result);
+	}
+	delete inflater;
+	f_close(&zip);
+	return extracted;
+}
+
+const char* ZipArchive::ResultText(Result result)
+{
+	switch (result)
+	{
+		case EXTRACTED:
+			return "extracted";
+		case SKIPPED:
+			return "skipped";
+		case UNSUPPORTED:
+			return "unsupported compression or encryption";
+		case CORRUPT:
+			return "corrupt";
+		case WRITE_FAILED:
+			return "write failed";
+		case EXISTS:
+			return "already exists, not overwritten";
+	}
+	return "";
+}
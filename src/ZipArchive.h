@@ -0,0 +1,52 @@
+// Pi1541 - A Commodore 1541 disk drive emulator
+// Copyright(C) 2018 Stephen White
+//
+// This file is part of Pi1541.
+//
+// Pi1541 is free software : you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Pi1541 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Pi1541. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef ZIPARCHIVE_H
+#define ZIPARCHIVE_H
+
+#include "types.h"
+#include "ff.h"
+
+// Extracts the disk images held in a .zip archive on the SD card.
+// The archive is read through its central directory and each member is inflated straight into its file,
+// so neither the archive nor a member is ever held in RAM; only a 32KB window and the read buffer are.
+class ZipArchive
+{
+public:
+	enum Result
+	{
+		EXTRACTED,
+		SKIPPED,		// Not a disk image
+		UNSUPPORTED,	// Encrypted, or compressed with something other than deflate
+		CORRUPT,		// Bad deflate data, or the size or CRC doesn't match
+		WRITE_FAILED,
+		EXISTS			// The folder already has a file of that name, maybe from another member
+	};
+
+	// Called once per member, after it has been dealt with
+	typedef void (*Progress)(void* context, const char* name, u32 size, Result result);
+
+	// Members are extracted into folder without the path they had in the archive, so two of the same name
+	// in different folders collide; the second, like one whose name is already taken in folder, is left out.
+	// Returns the number of images extracted or -1 if the archive itself can't be read.
+	static int Extract(const char* archive, const char* folder, Progress progress = 0, void* context = 0);
+
+	static const char* ResultText(Result result);
+};
+
+#endif
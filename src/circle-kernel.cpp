@@ -493,6 +493,7 @@ void CKernel::run_webserver(bool isWifi)
 		}
 		DEBUG_LOG("%s: launching webserver with: maxContentSize = %dkb, maxMultipartSize = %dkb", __FUNCTION__, max_cs, max_mps);
 		CWebServer CWebServer(m_Net, &m_ActLED, 0, max_cs * 1024, max_mps * 1024);
+		CStreamServer StreamServer(m_Net);
 		int temp_period = 0;
 		logger.finished_booting("network core");
 		while (1)
@@ -509,6 +510,8 @@ void CKernel::run_webserver(bool isWifi)
 			{
 				log("%s: rebooting now...", __FUNCTION__);
 				DisplayMessage(0, 24, true, "Rebooting.......", 0xffffff, 0x0);
+				for (unsigned wait = 0; DiskImage::WriteBacksPending() && wait < 100; ++wait)
+					mScheduler.MsSleep(100);	// The browser saves the ejected images
 				mScheduler.MsSleep(20);
 				reboot_now();
 			}
@@ -604,6 +607,18 @@ int CKernel::usb_massstorage_available(void)
 	return num;
 }
 
+// Waits for ms milliseconds, converting disk images to GCR meanwhile if backgroundGCR is enabled
+// and packing the caddy images swapped out of the drive.
+static void idle_core(unsigned ms)
+{
+	unsigned start = Kernel.get_clock_ticks();
+	while (Kernel.get_clock_ticks() - start < ms * (CLOCKHZ / 1000))
+	{
+		if (!DiskImage::EncodeInBackground() && !DiskImage::PackInBackground())
+			MsDelay(10);
+	}
+}
+
 void CKernel::run_tempmonitor(bool run)
 {
 #if 0	
@@ -615,7 +630,7 @@ void CKernel::run_tempmonitor(bool run)
 	do {
 		if (CPUThrottle.SetOnTemperature() == false)
 			log("temperature monitor failed...");
-		MsDelay(5 * 1000);
+		idle_core(5 * 1000);
 		if (!CPUThrottle.Update())
 			log("CPUThrottle Update failed");
 		log("Temp %dC (max=%dC), dynamic adaption%spossible, current freq = %dMHz (max=%dMHz)", 
@@ -720,8 +735,17 @@ void Pi1541Cores::Run(unsigned int core)			/* Virtual method */
 		break;
 	case 3:	/* health monitoring */
 		logger.finished_booting("system monitor core");
+		if (options.GetBackgroundGCR())
+		{
+			Kernel.log("converting disk images to GCR in the background on core %d", core);
+			DiskImage::SetBackgroundEncoding(true);
+		}
 		if (options.GetHealthMonitor() == 1)
+		{
 			Kernel.log("disabling health monitoring on core %d", core);
+			while (options.GetBackgroundGCR() || options.GetCompressCaddy())
+				idle_core(5 * 1000);
+		}
 		else
 		{
 			Kernel.log("launching system monitoring on core %d", core);
@@ -126,6 +126,7 @@ extern int gap_match_length;
 int find_sync(BYTE ** gcr_pptr, BYTE * gcr_end);
 void convert_4bytes_to_GCR(BYTE * buffer, BYTE * ptr);
 int convert_4bytes_from_GCR(BYTE * gcr, BYTE * plain);
+void convert_GCR_bits_to_bytes(BYTE * gcr, int shift, BYTE * plain, int groups);
 int extract_id(BYTE * gcr_track, BYTE * id);
 int extract_cosmetic_id(BYTE * gcr_track, BYTE * id);
 size_t find_track_cycle(BYTE ** cycle_start, BYTE ** cycle_stop, int cap_min,
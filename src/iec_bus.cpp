@@ -287,6 +287,8 @@ void __not_in_flash_func(IEC_Bus::ReadBrowseMode)(void)
 		gplev0 |= (gpio_get_level((gpio_num_t)PIGPIO_CLOCK) << PIGPIO_CLOCK);
 	gplev0 |= (gpio_get_level((gpio_num_t)PIGPIO_RESET) << PIGPIO_RESET);
 	//printf("%s: - gplev0 = %08x\n", __FUNCTION__, gplev0);
+#elif defined(__HOST__)
+	gplev0 = host_gplev0;
 #else
 #if !defined (CIRCLE_GPIO)	
 	gplev0 = read32(ARM_GPIO_GPLEV0);
@@ -352,6 +354,8 @@ void __not_in_flash_func(IEC_Bus::ReadEmulationMode1541)(void)
 		gplev0 |= (gpio_get_level((gpio_num_t)PIGPIO_CLOCK) << PIGPIO_CLOCK);
 	gplev0 |= (gpio_get_level((gpio_num_t)PIGPIO_RESET) << PIGPIO_RESET);
 	//printf("%s: - gplev0 = %04x\n", __FUNCTION__, gplev0);
+#elif defined(__HOST__)
+	gplev0 = host_gplev0;
 #else
 #if !defined (CIRCLE_GPIO)	
 	gplev0 = read32(ARM_GPIO_GPLEV0);
@@ -25,7 +25,7 @@
 #include "m8520.h"
 
 #include "rpi-gpio.h"
-#if !defined(__CIRCLE__) && !defined(__PICO2__)
+#if !defined(__CIRCLE__) && !defined(__PICO2__) && !defined(__HOST__)
 #include "rpiHardware.h"
 #endif
 #if defined(__PICO2__)
@@ -364,7 +364,7 @@ public:
 	{
 		volatile int index; // Force a real delay in the loop below.
 		// Clear all outputs to 0
-#if !defined(__PICO2__)	&& !defined(ESP32)
+#if !defined(__PICO2__)	&& !defined(ESP32) && !defined(__HOST__)
 		write32(ARM_GPIO_GPCLR0, 0xFFFFFFFF);	
 #endif		
 		//CGPIOPin::WriteAll(0xffffffff, 0xffffffff);
@@ -373,7 +373,7 @@ public:
 			// This means that when any pin is turn to output it will output a 0 and pull lines low (ie an activation state on the IEC bus)
 			// Note: on the IEC bus you never output a 1 you simply tri state and it will be pulled up to a 1 (ie inactive state on the IEC bus) if no one else is pulling it low.
 
-#if !defined(__PICO2__)	&& !defined(ESP32)
+#if !defined(__PICO2__)	&& !defined(ESP32) && !defined(__HOST__)
 			myOutsGPFSEL0 = read32(ARM_GPIO_GPFSEL0);
 			myOutsGPFSEL1 = read32(ARM_GPIO_GPFSEL1);
 #endif
@@ -475,6 +475,8 @@ public:
 			not_implemented(__FUNCTION__);
 #elif defined(ESP32)
 			not_implemented(__FUNCTION__);
+#elif defined(__HOST__)
+			// nothing to configure, the lines are driven through host_gplev0
 #else
 			RPI_SetGpioPinFunction((rpi_gpio_pin_t)PIGPIO_IN_BUTTON4, FS_INPUT);
 			RPI_SetGpioPinFunction((rpi_gpio_pin_t)PIGPIO_IN_BUTTON5, FS_INPUT);
@@ -501,7 +503,7 @@ public:
 		}
 	
 #if not defined(EXPERIMENTALZERO)
-#if !defined (__CIRCLE__)
+#if !defined (__CIRCLE__) && !defined(__HOST__)
 		// Set up audio.
 		write32(CM_PWMDIV, CM_PASSWORD + 0x2000);
 		write32(CM_PWMCTL, CM_PASSWORD + CM_ENAB + CM_SRC_OSCILLATOR);	// Use Default 100MHz Clock
@@ -520,7 +522,7 @@ public:
 			inputRepeat[index] = 0;
 			inputRepeatPrev[index] = 0;
 		}
-#if !defined(__CIRCLE__) && !defined(__PICO2__) && !defined(ESP32)
+#if !defined(__CIRCLE__) && !defined(__PICO2__) && !defined(ESP32) && !defined(__HOST__)
 		// Enable the internal pullups for the input button pins using the method described in BCM2835-ARM-Peripherals manual.
 		RPI_GpioBase->GPPUD = 2;
 		for (index = 0; index < 150; ++index)
@@ -628,6 +630,8 @@ public:
 			gplev0 = gpio_get_all();
 #elif defined(ESP32)
 			gplev0 = (gpio_get_level((gpio_num_t)PIGPIO_RESET) << PIGPIO_RESET);
+#elif defined(__HOST__)
+			gplev0 = host_gplev0;
 #else
 			gplev0 = read32(ARM_GPIO_GPLEV0);
 #endif	
@@ -645,7 +649,7 @@ public:
 	// Out going
 	static void PortB_OnPortOut(void* pUserData, unsigned char status);
 
-#if defined(__PICO2__) || defined(ESP32)
+#if defined(__PICO2__) || defined(ESP32) || defined(__HOST__)
 	static void RefreshOuts1541(void);
 	static void RefreshOutLED(void);
 	static void RefreshOutSound(void);
@@ -760,7 +764,7 @@ public:
 	}
 #endif 	/* CIRCLE_GPIO */
 
-#endif /* __PICO2__ || ESP32 */
+#endif /* __PICO2__ || ESP32 || __HOST__ */
 
 #if defined(PI1581SUPPORT)
 	static inline void RefreshOuts1581(void)
@@ -834,7 +838,7 @@ public:
 	static void WaitMicroSeconds(u32 amount)
 	{
 		u32 count;
-#if defined (__CIRCLE__) || defined(__PICO2__) || defined(ESP32)	
+#if defined (__CIRCLE__) || defined(__PICO2__) || defined(ESP32) || defined(__HOST__)
 		usDelay(amount); 
 		return;
 #else
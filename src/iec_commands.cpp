@@ -218,6 +218,8 @@ void IEC_Commands::Channel::Close()
 			}
 		}
 		f_close(&file);
+		if (writing)
+			FileBrowser::InvalidateFolderListings();
 		open = false;
 	}
 	cursor = 0;
@@ -718,6 +720,7 @@ static bool CopyFile(char* filenameNew, char* filenameOld, bool concatenate)
 			} while (bytes != 0);
 
 			f_close(&fpOut);
+			FileBrowser::InvalidateFolderListings();
 		}
 		f_close(&fpIn);
 	}
@@ -1106,6 +1109,7 @@ void IEC_Commands::MKDir(int partition, char* filename)
 	}
 
 	f_mkdir(filenameEdited);
+	FileBrowser::InvalidateFolderListings();
 
 	// Force the FileBrowser to refresh incase it just heppeded to be in the folder that they are looking at
 	updateAction = REFRESH;
@@ -1131,6 +1135,7 @@ void IEC_Commands::RMDir(void)
 			{
 				DEBUG_LOG("rmdir %s\r\n", filInfo.fname);
 				f_unlink(filInfo.fname);
+				FileBrowser::InvalidateFolderListings();
 				updateAction = REFRESH;
 			}
 		}
@@ -1429,6 +1434,7 @@ void IEC_Commands::Rename(void)
 				// Rename folders too.
 				//DEBUG_LOG("Renaming %s to %s\r\n", filenameOld, filenameNew);
 				f_rename(filenameOld, filenameNew);
+				FileBrowser::InvalidateFolderListings();
 			}
 			else
 			{
@@ -1495,6 +1501,7 @@ void IEC_Commands::Scratch(void)
 			{
 				DEBUG_LOG("Scratching %s\r\n", filInfo.fname);
 				f_unlink(filInfo.fname);
+				FileBrowser::InvalidateFolderListings();
 			}
 			res = f_findnext(&dir, &filInfo);
 			updateAction = REFRESH;
@@ -2080,27 +2087,8 @@ void IEC_Commands::AddDirectoryEntry(Channel& channel, const char* name, u16 blo
 	channel.cursor += dirEntryLength;
 }
 
-struct greater
-{
-	bool operator()(const FileBrowser::BrowsableList::Entry& lhs, const FileBrowser::BrowsableList::Entry& rhs) const
-	{
-		if (strcasecmp(lhs.filImage.fname, "..") == 0)
-			return true;
-		else if (strcasecmp(rhs.filImage.fname, "..") == 0)
-			return false;
-		else if (((lhs.filImage.fattrib & AM_DIR) && (rhs.filImage.fattrib & AM_DIR)) || (!(lhs.filImage.fattrib & AM_DIR) && !(rhs.filImage.fattrib & AM_DIR)))
-			return strcasecmp(lhs.filImage.fname, rhs.filImage.fname) < 0;
-		else if ((lhs.filImage.fattrib & AM_DIR) && !(rhs.filImage.fattrib & AM_DIR))
-			return true;
-		else
-			return false;
-	}
-};
-
 void IEC_Commands::LoadDirectory()
 {
-	DIR dir;
-	char* ext;
 	FRESULT res;
 
 	Channel& channel = channels[0];
@@ -2110,40 +2098,29 @@ void IEC_Commands::LoadDirectory()
 
 	//DEBUG_LOG("%s: $\r\n", __FUNCTION__);
 
-	FileBrowser::BrowsableList::Entry entry;
-	std::vector<FileBrowser::BrowsableList::Entry> entries;
 	if (displayingDevices)
 	{
-		FileBrowser::RefreshDevicesEntries(entries, true);
-	}
-	else
-	{
-		res = f_opendir(&dir, ".");
-		if (res == FR_OK)
+		std::vector<FileBrowser::BrowsableList::Entry> devices;
+		FileBrowser::RefreshDevicesEntries(devices, true);
+		for (u32 i = 0; i < devices.size(); ++i)
 		{
-			do
-			{
-				res = f_readdir(&dir, &entry.filImage);
-				ext = strrchr(entry.filImage.fname, '.');
-				if (res == FR_OK && entry.filImage.fname[0] != 0 && !(ext && strcasecmp(ext, ".png") == 0) && (entry.filImage.fname[0] != '.'))
-					entries.push_back(entry);
-			} while (res == FR_OK && entry.filImage.fname[0] != 0);
-			f_closedir(&dir);
-
-			std::sort(entries.begin(), entries.end(), greater());
+			if (!channel.CanFit(DIRECTORY_ENTRY_SIZE))
+				SendBuffer(channel, false);
+			AddDirectoryEntry(channel, devices[i].filImage.fname, 0, 6);
 		}
 	}
-
-	for (u32 i = 0; i < entries.size(); ++i)
+	else if (const FileBrowser::FolderIndex* folderIndex = FileBrowser::FolderListing())
 	{
-		FILINFO* filInfo = &entries[i].filImage;
-		const char* fileName = filInfo->fname;
+		for (u32 i = 0; i < folderIndex->records.size(); ++i)
+		{
+			const FileBrowser::FolderIndex::Record& record = folderIndex->records[i];
 
-		if (!channel.CanFit(DIRECTORY_ENTRY_SIZE))
-			SendBuffer(channel, false);
+			if (!channel.CanFit(DIRECTORY_ENTRY_SIZE))
+				SendBuffer(channel, false);
 
-		if (filInfo->fattrib & AM_DIR) AddDirectoryEntry(channel, fileName, 0, 6);
-		else AddDirectoryEntry(channel, fileName, filInfo->fsize / 256 + 1, 2);
+			if (record.attrib & AM_DIR) AddDirectoryEntry(channel, folderIndex->Name(i), 0, 6);
+			else AddDirectoryEntry(channel, folderIndex->Name(i), record.size / 256 + 1, 2);
+		}
 	}
 	SendBuffer(channel, false);
 
@@ -2473,6 +2450,7 @@ int IEC_Commands::WriteNewDiskInRAM(char* filenameNew, bool automount, unsigned
 	{
 		DiskImage diskImage;
 
+		FileBrowser::InvalidateFolderListings();
 		switch (newDiskType)
 		{
 			case DiskImage::D64:
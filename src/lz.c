@@ -493,6 +493,135 @@ int LZ_CompressFast( unsigned char *in, unsigned char *out, unsigned int insize)
 }
 
 
+/*************************************************************************
+* LZ_CompressHash() - Compress a block of data using an LZ77 coder that
+* only looks at the last occurrence of each (hashed) four byte string.
+* Much faster than LZ_CompressFast() and needs no allocation, but does not
+* compress as well. The output is read back with LZ_Uncompress().
+*  in     - Input (uncompressed) buffer.
+*  out    - Output (compressed) buffer. This buffer must be 0.4% larger
+*           than the input buffer, plus one byte.
+*  insize - Number of input bytes.
+*  work   - Work area of LZ_HASH_SIZE unsigned ints.
+* The function returns the size of the compressed data.
+*************************************************************************/
+
+#define LZ_HASH( p ) ((((unsigned int)(p)[0] << 24 | (unsigned int)(p)[1] << 16 | \
+	(unsigned int)(p)[2] << 8 | (unsigned int)(p)[3]) * 2654435761u) >> 20)
+
+int LZ_CompressHash( unsigned char *in, unsigned char *out, unsigned int insize,
+	unsigned int *work )
+{
+	unsigned char marker, symbol;
+	unsigned int  inpos, outpos, bytesleft, i, hash;
+	unsigned int  offset, length, candidate;
+	unsigned int  histogram[ 256 ];
+
+	/* Do we have anything to compress? */
+	if( insize < 1 )
+	{
+		return 0;
+	}
+
+	/* Find the least common byte, and use it as the marker symbol */
+	for( i = 0; i < 256; ++ i )
+	{
+		histogram[ i ] = 0;
+	}
+	for( i = 0; i < insize; ++ i )
+	{
+		++ histogram[ in[ i ] ];
+	}
+	marker = 0;
+	for( i = 1; i < 256; ++ i )
+	{
+		if( histogram[ i ] < histogram[ marker ] )
+		{
+			marker = (unsigned char) i;
+		}
+	}
+
+	/* Remember the marker symbol for the decoder */
+	out[ 0 ] = marker;
+
+	/* work[hash] is one past the last position with that hash (0 = none) */
+	for( i = 0; i < LZ_HASH_SIZE; ++ i )
+	{
+		work[ i ] = 0;
+	}
+
+	/* Start of compression */
+	inpos = 0;
+	outpos = 1;
+
+	/* Main compression loop */
+	bytesleft = insize;
+	while( bytesleft > 3 )
+	{
+		hash = LZ_HASH( &in[ inpos ] );
+		candidate = work[ hash ];
+		work[ hash ] = inpos + 1;
+
+		/* The decoder copies a byte at a time so a match may overlap itself */
+		length = 0;
+		offset = 0;
+		if( candidate )
+		{
+			offset = inpos + 1 - candidate;
+			length = _LZ_StringCompare( &in[ inpos ], &in[ candidate - 1 ], 0, bytesleft );
+		}
+
+		/* Was there a good enough match? */
+		if( (length >= 8) ||
+			((length == 4) && (offset <= 0x0000007f)) ||
+			((length == 5) && (offset <= 0x00003fff)) ||
+			((length == 6) && (offset <= 0x001fffff)) ||
+			((length == 7) && (offset <= 0x0fffffff)) )
+		{
+			out[ outpos ++ ] = (unsigned char) marker;
+			outpos += _LZ_WriteVarSize( length, &out[ outpos ] );
+			outpos += _LZ_WriteVarSize( offset, &out[ outpos ] );
+			bytesleft -= length;
+
+			/* Remember the strings inside the match too */
+			for( ++ inpos, -- length; length && bytesleft + length > 3; ++ inpos, -- length )
+			{
+				work[ LZ_HASH( &in[ inpos ] ) ] = inpos + 1;
+			}
+			inpos += length;
+		}
+		else
+		{
+			/* Output single byte (or two bytes if marker byte) */
+			symbol = in[ inpos ++ ];
+			out[ outpos ++ ] = symbol;
+			if( symbol == marker )
+			{
+				out[ outpos ++ ] = 0;
+			}
+			-- bytesleft;
+		}
+	}
+
+	/* Dump remaining bytes, if any */
+	while( inpos < insize )
+	{
+		if( in[ inpos ] == marker )
+		{
+			out[ outpos ++ ] = marker;
+			out[ outpos ++ ] = 0;
+		}
+		else
+		{
+			out[ outpos ++ ] = in[ inpos ];
+		}
+		++ inpos;
+	}
+
+	return outpos;
+}
+
+
 /*************************************************************************
 * LZ_Uncompress() - Uncompress a block of data using an LZ77 decoder.
 *  in      - Input (compressed) buffer.
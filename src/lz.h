@@ -37,12 +37,17 @@ extern "C" {
 #endif
 
 
+/* Number of unsigned ints of work area LZ_CompressHash() needs */
+#define LZ_HASH_SIZE 4096
+
+
 /*************************************************************************
 * Function prototypes
 *************************************************************************/
 
 int LZ_Compress( unsigned char *in, unsigned char *out, unsigned int insize );
 int LZ_CompressFast( unsigned char *in, unsigned char *out, unsigned int insize);
+int LZ_CompressHash( unsigned char *in, unsigned char *out, unsigned int insize, unsigned int *work );
 int LZ_Uncompress( unsigned char *in, unsigned char *out, unsigned int insize );
 
 
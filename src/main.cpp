@@ -61,6 +61,10 @@ extern "C"
 #include "diskio.h"
 #include "Pi1541.h"
 #include "Pi1581.h"
+#include "EmulationTiming.h"
+#if defined(__CIRCLE__)
+#include "Mailbox.h"
+#endif
 
 #include "FileBrowser.h"
 #include "ScreenLCD.h"
@@ -129,6 +133,12 @@ Pi1541 pi1541;
 #if defined(PI1581SUPPORT)
 Pi1581 pi1581;
 #endif
+EmulationTiming emulationTiming;
+#if defined(__CIRCLE__)
+EmulatorCommandMailbox emulatorCommands;	// Network core to emulator core
+EmulatorStatusMailbox emulatorStatus;		// Emulator core to network core
+EmulatorCaddySnapshot emulatorCaddy;		// Emulator core to network core
+#endif
 #if !defined(__CIRCLE__) && !defined(__PICO2__) && !defined(ESP32)
 CEMMCDevice	m_EMMC;
 #else
@@ -276,9 +286,7 @@ DWORD get_fattime() { return 0; }	// If you have hardware RTC return a correct v
 #endif
 
 extern u8 read6502(u16 address);
-extern u8 read6502ExtraRAM(u16 address);
 extern void write6502(u16 address, const u8 value);
-extern void write6502ExtraRAM(u16 address, const u8 value);
 extern u8 read6502_1581(u16 address);
 extern void write6502_1581(u16 address, const u8 value);
 
@@ -896,6 +904,222 @@ void CheckAutoMountImage(EXIT_TYPE reset_reason , FileBrowser* fileBrowser)
 
 void DisplayMessage(int x, int y, bool LCD, const char* message, u32 textColour, u32 backgroundColour);
 
+#if defined(__CIRCLE__)
+// How often (in emulated microseconds) the emulation loops look for commands from the web server.
+static const int EMULATOR_COMMAND_INTERVAL = 1000;
+
+// Commands drained from emulatorCommands that have yet to be acted on.
+// Only the emulator core touches these.
+static EmulatorCommand webMount;			// MOUNT_IMAGE or MOUNT_LST
+static bool webMountPending = false;
+static bool webAutoLoad = false;
+static bool webExit = false;
+static bool webReset = false;
+static bool webPurgeTrackCache = false;	// Deleting files mid emulation would stall the drive so this waits for the browser
+static bool optionsChanged = false;
+static u32 statusSequence = 0;
+
+// Rebuilds the caddy listing for the web server. The emulation loops never call this; the caddy only changes while browsing.
+static void PublishEmulatorCaddy()
+{
+	static EmulatorCaddy caddy;
+	unsigned used = 0;
+	for (unsigned index = 0; index < diskCaddy.GetNumberOfImages(); ++index)
+	{
+		const char* name = diskCaddy.GetImage(index)->GetName();
+		unsigned length = strlen(name);
+		if (used + length + 1 >= sizeof(caddy.names))
+			break;
+		memcpy(caddy.names + used, name, length);
+		caddy.names[used + length] = '\n';
+		used += length + 1;
+	}
+	caddy.names[used] = 0;
+	emulatorCaddy.Write(caddy);
+}
+
+// Runs in the emulation loops so only reads what is at hand.
+static void PostEmulatorStatus()
+{
+	EmulatorStatus status;
+
+	if (emulating == IEC_COMMANDS)
+		PublishEmulatorCaddy();
+	status.sequence = ++statusSequence;
+	status.emulating = emulating;
+	status.deviceID = deviceID;
+	status.halfTrack = 0;
+	status.motor = false;
+	status.LED = false;
+	status.optionsChanged = optionsChanged;
+	status.selectedIndex = diskCaddy.GetSelectedIndex();
+	status.numberOfImages = diskCaddy.GetNumberOfImages();
+	status.diskInserted = false;
+	if (emulating == EMULATING_1541)
+	{
+		status.halfTrack = pi1541.drive.Track();
+		status.motor = pi1541.drive.IsMotorOn();
+		status.LED = pi1541.drive.IsLEDOn();
+		status.diskInserted = pi1541.drive.GetDiskImage() != 0;
+	}
+#if defined(PI1581SUPPORT)
+	else if (emulating == EMULATING_1581)
+	{
+		status.halfTrack = pi1581.wd177x.GetCurrentTrack() * 2;
+		status.motor = pi1581.IsMotorOn();
+		status.LED = pi1581.IsLEDOn();
+		status.diskInserted = pi1581.GetDiskImage() != 0;
+	}
+#endif
+	if (!emulatorStatus.Post(status))
+		DEBUG_LOG("%s: status mailbox full", __FUNCTION__);
+}
+
+// Web swaps can reach every image in the caddy, not just the first 10 the buttons can, and on every build.
+static void SwapToImage(int index)
+{
+	if (emulating == IEC_COMMANDS || index < 0 || (unsigned)index >= diskCaddy.GetNumberOfImages())
+	{
+		DEBUG_LOG("%s: cannot swap to image %d", __FUNCTION__, index);
+		return;
+	}
+	DiskImage* diskImage = diskCaddy.SelectImage(index);
+	if (!diskImage)
+		return;	// Already in the drive
+	if (emulating == EMULATING_1541)
+		pi1541.drive.Insert(diskImage);
+#if defined(PI1581SUPPORT)
+	else
+		pi1581.Insert(diskImage);
+#endif
+	if (options.GetHeadLess())
+		diskCaddy.Update();
+}
+
+static void DrainEmulatorCommands()
+{
+	EmulatorCommand command;
+
+	while (emulatorCommands.Receive(command))
+	{
+		switch (command.type)
+		{
+			case EmulatorCommand::MOUNT_IMAGE:
+			case EmulatorCommand::MOUNT_LST:
+				webMount = command;
+				webMountPending = true;
+				break;
+			case EmulatorCommand::AUTOLOAD:
+				webAutoLoad = true;
+				break;
+			case EmulatorCommand::SWAP_DISK:
+				SwapToImage(command.index);
+				break;
+			case EmulatorCommand::EXIT:
+				webExit = true;
+				break;
+			case EmulatorCommand::OPTIONS_CHANGED:
+				optionsChanged = true;
+				break;
+			case EmulatorCommand::STATUS_REQUEST:
+				PostEmulatorStatus();
+				break;
+			case EmulatorCommand::PURGE_TRACK_CACHE:
+				webPurgeTrackCache = true;
+				break;
+			case EmulatorCommand::RESET:
+				webReset = true;
+				break;
+		}
+	}
+}
+
+// Called by the emulation loops every EMULATOR_COMMAND_INTERVAL cycles.
+static void CheckEmulatorCommands(bool& exitEmulation, bool& exitDoAutoLoad, int& resetCount)
+{
+	if (!emulatorCommands.IsEmpty())
+		DrainEmulatorCommands();
+	if (webReset)
+	{
+		DEBUG_LOG("%s: webserver requests a reset", __FUNCTION__);
+		webReset = false;
+		resetCount = 11;	// As long as the bus has to be held in reset to leave
+	}
+	if (webAutoLoad)
+	{
+		DEBUG_LOG("%s: webserver upload done.", __FUNCTION__);
+		webAutoLoad = false;
+		exitDoAutoLoad = true;
+	}
+	if (webMountPending || webExit)
+	{
+		DEBUG_LOG("%s: mount_img = '%s'", __FUNCTION__, webMountPending ? webMount.image : "");
+		webExit = false;
+		emulating = IEC_COMMANDS;
+		exitEmulation = true;	// The browser then mounts webMount
+	}
+}
+#endif
+
+// Timing is collected per mount.
+static void ResetEmulationTiming(EmulationTiming::Device device)
+{
+#if defined(RPI2)
+	emulationTiming.Reset(device, clockCycles1MHz);
+#else
+	emulationTiming.Reset(device, 1);	// Microsecond timers
+#endif
+}
+
+static void LogEmulationTiming()
+{
+	if (emulationTiming.overruns)
+	{
+		const EmulationTiming::Overrun* last = emulationTiming.GetOverrun(0);
+		DEBUG_LOG("Emulation lost %llu cycles in %u overruns of %llu (longest run %u, last at pc %04x track %d)",
+			(unsigned long long)emulationTiming.cyclesLost, (unsigned)emulationTiming.overruns, (unsigned long long)emulationTiming.passes,
+			(unsigned)emulationTiming.longestOverrunRun, last->pc, (last->halfTrack >> 1) + 1);
+	}
+}
+
+// Images that only load with refreshOutsAfterCPUStep off.
+// They were identified by the FNV-1a hash of the G64 file (legacyHash) before images got an ImageHash.
+// host-1541/benchhash prints both for a file; fill in hash and the legacy one can go once every entry has it.
+static const struct
+{
+	u64 hash;
+	u32 legacyHash;
+	const char* name;
+} noRefreshOutsImages[] =
+{
+	{ 0, 0x42c02586, "maniac_mansion_s1[lucasfilm_1989](ntsc).g64" },
+	{ 0, 0x18651422, "aliens[electric_dreams_1987].g64" },
+	{ 0, 0x2a7f4b77, "zak_mckracken_boot[activision_1988](manual)(!).g64" },
+	{ 0, 0x778fecda, "zak_mckracken_boot (german version).g64" },
+	{ 0, 0x6ab92e00, "zak_mckracken_boot (german version).g64" },
+	{ 0, 0x97732c3e, "maniac_mansion_s1[activision_1987](!).g64" },
+	{ 0, 0x63f809d2, "4x4_offroad_racing_s1[epyx_1988](ntsc)(!).g64" },
+	{ 0, 0x3adb56b7, "(unnamed).g64" },
+};
+
+static bool RefreshOutsAfterCPUStep(const DiskImage* diskImage)
+{
+	if (!diskImage)
+		return true;
+
+	u64 hash = diskImage->GetHash();
+	u32 legacyHash = diskImage->GetLegacyHash();
+	for (unsigned index = 0; index < sizeof(noRefreshOutsImages) / sizeof(noRefreshOutsImages[0]); ++index)
+	{
+		if ((hash && noRefreshOutsImages[index].hash == hash) || (legacyHash && noRefreshOutsImages[index].legacyHash == legacyHash))
+		{
+			DEBUG_LOG("%s: %s, refreshOutsAfterCPUStep = false", __FUNCTION__, noRefreshOutsImages[index].name);
+			return false;
+		}
+	}
+	return true;
+}
+
 EXIT_TYPE __not_in_flash_func(Emulate1541) (FileBrowser* fileBrowser)
 {
 	EXIT_TYPE exitReason = EXIT_UNKNOWN;
@@ -916,10 +1140,15 @@ EXIT_TYPE __not_in_flash_func(Emulate1541) (FileBrowser* fileBrowser)
 	unsigned numberOfImages = diskCaddy.GetNumberOfImages();
 	unsigned numberOfImagesMax = numberOfImages;
 	int exitCyclesRemaining = 0;
+#if defined(__CIRCLE__)
+	int commandCountdown = EMULATOR_COMMAND_INTERVAL;
+#endif
 
 	if (numberOfImagesMax > 10)
 		numberOfImagesMax = 10;
 
+	ResetEmulationTiming(EmulationTiming::DEVICE_1541);
+
 #if not defined(EXPERIMENTALZERO)
 	core0RefreshingScreen.Acquire();
 #endif
@@ -932,10 +1161,8 @@ EXIT_TYPE __not_in_flash_func(Emulate1541) (FileBrowser* fileBrowser)
 	// Force an update on all the buttons now before we start emulation mode. 
 	IEC_Bus::ReadBrowseMode();
 
-	bool extraRAM = options.GetExtraRAM();
-	DataBusReadFn dataBusRead = extraRAM ? read6502ExtraRAM : read6502;
-	DataBusWriteFn dataBusWrite = extraRAM ? write6502ExtraRAM : write6502;
-	pi1541.m6502.SetBusFunctions(dataBusRead, dataBusWrite);
+	pi1541.ConfigureDataBus();
+	pi1541.m6502.SetBusFunctions(read6502, write6502);
 
 	IEC_Bus::VIA = &pi1541.VIA[0];
 	IEC_Bus::port = pi1541.VIA[0].GetPortB();
@@ -946,34 +1173,33 @@ EXIT_TYPE __not_in_flash_func(Emulate1541) (FileBrowser* fileBrowser)
 	//resetWhileEmulating = false;
 	selectedViaIECCommands = false;
 
-	u32 hash = pi1541.drive.GetDiskImage()->GetHash();
-	// 0x42c02586 = maniac_mansion_s1[lucasfilm_1989](ntsc).g64
-	// 0x18651422 = aliens[electric_dreams_1987].g64
-	// 0x2a7f4b77 = zak_mckracken_boot[activision_1988](manual)(!).g64, 0x778fecda, 0x6ab92e00 (german version)
-	// 0x97732c3e = maniac_mansion_s1[activision_1987](!).g64
-	// 0x63f809d2 = 4x4_offroad_racing_s1[epyx_1988](ntsc)(!).g64
-	if (hash == 0x42c02586 || hash == 0x18651422 || hash == 0x2a7f4b77 || hash == 0x97732c3e || 
-		hash == 0x63f809d2 || hash == 0x778fecda || hash == 0x6ab92e00 || hash == 0x3adb56b7)
-	{
-		refreshOutsAfterCPUStep = false;
-		DEBUG_LOG("%s: .g64 hash = %x, refreshOutsAfterCPUStep = false", __FUNCTION__, hash);
-	}
+	refreshOutsAfterCPUStep = RefreshOutsAfterCPUStep(pi1541.drive.GetDiskImage());
 
 	// Quickly get through 1541's self test code.
 	// This will make the emulated 1541 responsive to commands asap.
 	// During this time we don't need to set outputs.
-
-	while (cycleCount < FAST_BOOT_CYCLES)
+	// The self test always ends in the same state so after the first time it is restored rather than run.
+	if (!pi1541.RestoreBootState(roms.GetHash()))
 	{
-		IEC_Bus::ReadEmulationMode1541();
+		bool atnDuringBoot = false;
 
-		pi1541.m6502.SYNC();
+		while (cycleCount < FAST_BOOT_CYCLES)
+		{
+			IEC_Bus::ReadEmulationMode1541();
+			atnDuringBoot |= IEC_Bus::IsAtnAsserted();
 
-		pi1541.m6502.Step();
+			pi1541.m6502.SYNC();
 
-		pi1541.Update();
+			pi1541.m6502.Step();
+
+			pi1541.Update();
+
+			cycleCount++;
+		}
 
-		cycleCount++;
+		// If the computer talked to us or the disk was spun up the state depends on more than the ROM.
+		if (!atnDuringBoot && !pi1541.drive.IsMotorOn())
+			pi1541.SaveBootState(roms.GetHash());
 	}
 #if defined(__PICO2__)	
 	overclock(312000);
@@ -1083,25 +1309,15 @@ EXIT_TYPE __not_in_flash_func(Emulate1541) (FileBrowser* fileBrowser)
 		else
 			resetCount = 0;
 #if defined(__CIRCLE__)
-extern bool webserver_upload;
-		if (webserver_upload)
+		if (--commandCountdown == 0)
 		{
-			DEBUG_LOG("%s: webserver upload done.", __FUNCTION__);
-			webserver_upload = false;
-			exitDoAutoLoad = true;
+			commandCountdown = EMULATOR_COMMAND_INTERVAL;
+			CheckEmulatorCommands(exitEmulation, exitDoAutoLoad, resetCount);
 		}
-extern char mount_img[256];
-extern int mount_new;
-		if (mount_new)
-		{
-			DEBUG_LOG("%s: mount_img = '%s'", __FUNCTION__, mount_img);
-			emulating = IEC_COMMANDS;
-			exitEmulation = true;
-		}
-#endif		
+#endif
 		if ((emulating == IEC_COMMANDS) || (resetCount > 10) || exitEmulation || exitDoAutoLoad)
 		{
-			if (reset)
+			if (reset || resetCount > 10)
 				exitReason = EXIT_RESET;
 			if (exitEmulation)
 				exitReason = EXIT_KEYBOARD;
@@ -1139,6 +1355,8 @@ extern int mount_new;
 			}
 		} while (ctAfter == ctBefore);
 #endif
+		if (!emulationTiming.RecordPass(ctAfter - ctBefore))
+			emulationTiming.RecordOverrun(pi1541.m6502.GetPC(), pi1541.drive.Track());
 		ctBefore = ctAfter;
 		
 		if (!refreshOutsAfterCPUStep)
@@ -1208,6 +1426,7 @@ extern int mount_new;
 #endif
 		}
 	}
+	LogEmulationTiming();
 	return exitReason;
 }
 
@@ -1225,12 +1444,17 @@ EXIT_TYPE Emulate1581(FileBrowser* fileBrowser)
 	unsigned int oldTrack = 0;
 	int resetCount = 0;
 	int exitCyclesRemaining = 0;
+#if defined(__CIRCLE__)
+	int commandCountdown = EMULATOR_COMMAND_INTERVAL;
+#endif
 
 	unsigned numberOfImages = diskCaddy.GetNumberOfImages();
 	unsigned numberOfImagesMax = numberOfImages;
 	if (numberOfImagesMax > 10)
 		numberOfImagesMax = 10;
 
+	ResetEmulationTiming(EmulationTiming::DEVICE_1581);
+
 #if not defined(EXPERIMENTALZERO)
 	core0RefreshingScreen.Acquire();
 #endif
@@ -1243,9 +1467,8 @@ EXIT_TYPE Emulate1581(FileBrowser* fileBrowser)
 	// Force an update on all the buttons now before we start emulation mode. 
 	IEC_Bus::ReadBrowseMode();
 
-	DataBusReadFn dataBusRead = read6502_1581;
-	DataBusWriteFn dataBusWrite = write6502_1581;
-	pi1581.m6502.SetBusFunctions(dataBusRead, dataBusWrite);
+	pi1581.ConfigureDataBus();
+	pi1581.m6502.SetBusFunctions(read6502_1581, write6502_1581);
 
 	IEC_Bus::CIA = &pi1581.CIA;
 	IEC_Bus::port = pi1581.CIA.GetPortB();
@@ -1347,25 +1570,15 @@ EXIT_TYPE Emulate1581(FileBrowser* fileBrowser)
 		else
 			resetCount = 0;
 #if defined(__CIRCLE__)
-		extern bool webserver_upload;
-		if (webserver_upload)
-		{
-			DEBUG_LOG("%s: webserver upload done.", __FUNCTION__);
-			webserver_upload = false;
-			exitDoAutoLoad = true;
-		}
-		extern char mount_img[256];
-		extern int mount_new;
-		if (mount_new)
+		if (--commandCountdown == 0)
 		{
-			DEBUG_LOG("%s: mount_img = '%s'", __FUNCTION__, mount_img);
-			emulating = IEC_COMMANDS;
-			exitEmulation = true;
+			commandCountdown = EMULATOR_COMMAND_INTERVAL;
+			CheckEmulatorCommands(exitEmulation, exitDoAutoLoad, resetCount);
 		}
 #endif
 		if ((emulating == IEC_COMMANDS) || (resetCount > 10) || exitEmulation || exitDoAutoLoad)
 		{
-			if (reset)
+			if (reset || resetCount > 10)
 				exitReason = EXIT_RESET;
 			if (exitEmulation)
 				exitReason = EXIT_KEYBOARD;
@@ -1395,6 +1608,8 @@ EXIT_TYPE Emulate1581(FileBrowser* fileBrowser)
 			}
 		} while (ctAfter == ctBefore);
 #endif
+		if (!emulationTiming.RecordPass(ctAfter - ctBefore))
+			emulationTiming.RecordOverrun(pi1581.m6502.GetPC(), pi1581.wd177x.GetCurrentTrack() * 2);
 		ctBefore = ctAfter;
 
 		if ((playsound > 0) && headSoundCounter > 0)
@@ -1459,6 +1674,7 @@ EXIT_TYPE Emulate1581(FileBrowser* fileBrowser)
 		}
 
 	}
+	LogEmulationTiming();
 	return exitReason;
 }
 #endif
@@ -1473,6 +1689,8 @@ void __not_in_flash_func(emulator)(void)
 
 	roms.lastManualSelectedROMIndex = 0;
 	diskCaddy.SetScreen(screen, screenLCD, &roms);
+	diskCaddy.SetCompression(options.GetCompressCaddy());
+	DiskImage::SetTrackCache("SD:/1541/trackcache", (options.GetTrackCache() < 4096 ? options.GetTrackCache() : 4095) << 20);
 	fileBrowser = new FileBrowser(inputMappings, &diskCaddy, &roms, &deviceID, options.DisplayPNGIcons(), screen, screenLCD, options.ScrollHighlightRate());
 	pi1541.Initialise();
 
@@ -1543,6 +1761,9 @@ void __not_in_flash_func(emulator)(void)
 							CheckAutoMountImage(EXIT_UNKNOWN, fileBrowser);
 							break;
 						case IEC_Commands::NONE:
+#if defined(__CIRCLE__)
+							DiskImage::WriteBackNext();	// One ejected image at a time, in between IEC commands
+#endif
 							fileBrowser->Update();
 							// Check selections made via FileBrowser
 							if (fileBrowser->SelectionsMade())
@@ -1616,48 +1837,56 @@ void __not_in_flash_func(emulator)(void)
 							break;
 					}
 #if defined(__CIRCLE__)
-extern char mount_img[256];
-extern char mount_path[256];
-extern int mount_new;
 					FILINFO fi;
-					if (mount_new)
+					if (!emulatorCommands.IsEmpty())
 					{
-						DEBUG_LOG("%s: webserver requests to mount in dir '%s' img '%s'", __FUNCTION__, mount_path, mount_img);
-						char *t = strchr(mount_path, ':');
+						DrainEmulatorCommands();
+						webExit = false;	// Already browsing
+						webReset = false;
+					}
+					if (webPurgeTrackCache)
+					{
+						DiskImage::PurgeTrackCache();
+						webPurgeTrackCache = false;
+					}
+					if (webMountPending)
+					{
+						DEBUG_LOG("%s: webserver requests to mount in dir '%s' img '%s'", __FUNCTION__, webMount.path, webMount.image);
+						char *t = strchr(webMount.path, ':');
 						if (t)
 						{
 							int r;
 							char tt;
 							t++;
 							tt = *t;
-							if ((r = f_chdrive(mount_path)) != FR_OK)
-								DEBUG_LOG("%s: f_chdrive to '%s' failed with %d", __FUNCTION__, mount_path, r);
+							if ((r = f_chdrive(webMount.path)) != FR_OK)
+								DEBUG_LOG("%s: f_chdrive to '%s' failed with %d", __FUNCTION__, webMount.path, r);
 							*t = tt;
 						}
 						else
 						{
-							DEBUG_LOG("%s: mount_path '%s' has no drive specifier!", __FUNCTION__, mount_path);
+							DEBUG_LOG("%s: mount path '%s' has no drive specifier!", __FUNCTION__, webMount.path);
 						}	
-						if (f_chdir(mount_path) != FR_OK)
-							DEBUG_LOG("%s: chdir to '%s' failed", __FUNCTION__, mount_path);
-						else if (mount_new == 1)
+						if (f_chdir(webMount.path) != FR_OK)
+							DEBUG_LOG("%s: chdir to '%s' failed", __FUNCTION__, webMount.path);
+						else if (webMount.type == EmulatorCommand::MOUNT_IMAGE)
 						{
 
 							fileBrowser->FolderChanged();
-							strncpy(fi.fname, mount_img, 255);
+							strncpy(fi.fname, webMount.image, 255);
 							if (diskCaddy.Insert(&fi, false)) 
 							{
 								fileBrowser->Update();
-								emulating = BeginEmulating(fileBrowser, mount_img);
+								emulating = BeginEmulating(fileBrowser, webMount.image);
 							}
 						}
-						else if (mount_new == 2)/* .LST */
+						else if (webMount.type == EmulatorCommand::MOUNT_LST)/* .LST */
 						{
 							fileBrowser->FolderChanged();
-							if (fileBrowser->SelectLST(mount_img))
+							if (fileBrowser->SelectLST(webMount.image))
 								fileBrowser->SetSelectionsMade(true);
 						}
-						mount_new = 0;
+						webMountPending = false;
 					}
 #endif
 					usDelay(1);
@@ -1668,50 +1897,59 @@ extern int mount_new;
 				while (emulating == IEC_COMMANDS)
 				{
 #if defined(__CIRCLE__)
-extern char mount_img[256];
-extern char mount_path[256];
-extern int mount_new;
 					FILINFO fi;
-					if (mount_new)
+					if (!emulatorCommands.IsEmpty())
+					{
+						DrainEmulatorCommands();
+						webExit = false;	// Already browsing
+						webReset = false;
+					}
+					if (webPurgeTrackCache)
+					{
+						DiskImage::PurgeTrackCache();
+						webPurgeTrackCache = false;
+					}
+					if (webMountPending)
 					{
-						DEBUG_LOG("%s: webserver requests to mount in dir '%s' img '%s'", __FUNCTION__, mount_path, mount_img);
-						char *t = strchr(mount_path, ':');
+						DEBUG_LOG("%s: webserver requests to mount in dir '%s' img '%s'", __FUNCTION__, webMount.path, webMount.image);
+						char *t = strchr(webMount.path, ':');
 						if (t)
 						{
 							int r;
 							char tt;
 							t++;
 							tt = *t;
-							if ((r = f_chdrive(mount_path)) != FR_OK)
-								DEBUG_LOG("%s: f_chdrive to '%s' failed with %d", __FUNCTION__, mount_path, r);
+							if ((r = f_chdrive(webMount.path)) != FR_OK)
+								DEBUG_LOG("%s: f_chdrive to '%s' failed with %d", __FUNCTION__, webMount.path, r);
 							*t = tt;
 						}
 						else
 						{
-							DEBUG_LOG("%s: mount_path '%s' has no drive specifier!", __FUNCTION__, mount_path);
+							DEBUG_LOG("%s: mount path '%s' has no drive specifier!", __FUNCTION__, webMount.path);
 						}	
-						if (f_chdir(mount_path) != FR_OK)
-							DEBUG_LOG("%s: chdir to '%s' failed", __FUNCTION__, mount_path);
-						else if (mount_new == 1)
+						if (f_chdir(webMount.path) != FR_OK)
+							DEBUG_LOG("%s: chdir to '%s' failed", __FUNCTION__, webMount.path);
+						else if (webMount.type == EmulatorCommand::MOUNT_IMAGE)
 						{
 
 							fileBrowser->FolderChanged();
-							strncpy(fi.fname, mount_img, 255);
+							strncpy(fi.fname, webMount.image, 255);
 							if (diskCaddy.Insert(&fi, false))
 							{
 								fileBrowser->Update();
-								emulating = BeginEmulating(fileBrowser, mount_img);
+								emulating = BeginEmulating(fileBrowser, webMount.image);
 							}
 						}
-						else if (mount_new == 2)/* .LST */
+						else if (webMount.type == EmulatorCommand::MOUNT_LST)/* .LST */
 						{
 							fileBrowser->FolderChanged();
-							fileBrowser->SelectLST(mount_img);
-							if (fileBrowser->SelectLST(mount_img))
+							fileBrowser->SelectLST(webMount.image);
+							if (fileBrowser->SelectLST(webMount.image))
 								fileBrowser->SetSelectionsMade(true);
 						}
-						mount_new = 0;						
+						webMountPending = false;						
 					}
+					DiskImage::WriteBackNext();
 #endif
 					fileBrowser->Update();
 					if (fileBrowser->SelectionsMade())
@@ -1722,6 +1960,9 @@ extern int mount_new;
 		}
 		else
 		{
+#if defined(__CIRCLE__)
+			PublishEmulatorCaddy();
+#endif
 			if (emulating == EMULATING_1541)
 				exitReason = Emulate1541(fileBrowser);
 #if defined(PI1581SUPPORT)
@@ -1740,7 +1981,10 @@ extern int mount_new;
 			core0RefreshingScreen.Acquire();
 #endif
 			if (diskCaddy.Empty())
+			{
+				FileBrowser::InvalidateFolderListings();	// Saving a G64 or NIB can change its size
 				IEC_Bus::WaitMicroSeconds(2 * 1000000);
+			}
 			IEC_Bus::WaitUntilReset();
 			emulating = IEC_COMMANDS;
 	
@@ -2043,6 +2287,9 @@ static void CheckOptions()
 
 void Reboot_Pi()
 {
+#if defined(__CIRCLE__)
+	DiskImage::FlushWriteBacks();
+#endif
 #if !defined(__PICO2__)	&& !defined(ESP32)
 	if (screenLCD)
 		screenLCD->ClearInit(0);
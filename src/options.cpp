@@ -164,12 +164,15 @@ Options::Options(void)
 	, rotaryEncoderEnable(0) //ROTARY:
 	, rotaryEncoderInvert(0) //ROTARY:
 	, headLess(0)
+	, compressCaddy(0)
+	, trackCache(0)
 #if defined(__CIRCLE__)	
 	, netWifi(0)
 	, netEthernet(0)
 	, maxContentSize(1000)
 	, maxMultipartSize(20000)
 	, noHealthMonitor(1)
+	, backgroundGCR(0)
 	, useDHCP(1)
 	, TZ(2.0)
 #endif	
@@ -270,12 +273,15 @@ void Options::Process(char* buffer)
 		ELSE_CHECK_DECIMAL_OPTION(rotaryEncoderEnable) //ROTARY:
 		ELSE_CHECK_DECIMAL_OPTION(rotaryEncoderInvert) //ROTARY:
 		ELSE_CHECK_DECIMAL_OPTION(headLess)
+		ELSE_CHECK_DECIMAL_OPTION(compressCaddy)
+		ELSE_CHECK_DECIMAL_OPTION(trackCache)
 #if defined(__CIRCLE__)
 		ELSE_CHECK_DECIMAL_OPTION(netWifi)
 		ELSE_CHECK_DECIMAL_OPTION(netEthernet)
 		ELSE_CHECK_DECIMAL_OPTION(maxContentSize)
 		ELSE_CHECK_DECIMAL_OPTION(maxMultipartSize)
 		ELSE_CHECK_DECIMAL_OPTION(noHealthMonitor)
+		ELSE_CHECK_DECIMAL_OPTION(backgroundGCR)
 		ELSE_CHECK_DECIMAL_OPTION(useDHCP)
 		ELSE_CHECK_FLOAT_OPTION(TZ)
 #endif		
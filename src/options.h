@@ -117,6 +117,8 @@ public:
 	inline unsigned int RotaryEncoderInvert() const { return rotaryEncoderInvert; }
 
 	inline unsigned int GetHeadLess() const { return headLess; }
+	inline unsigned int GetCompressCaddy() const { return compressCaddy; }
+	inline unsigned int GetTrackCache() const { return trackCache; }
 #if defined(__CIRCLE__)
 	inline unsigned int GetNetWifi() const { return netWifi; }
 	inline unsigned int GetNetEthernet() const { return netEthernet; }
@@ -124,6 +126,7 @@ public:
 	inline unsigned GetMaxMultipartSize() const { return maxMultipartSize; }
 	inline void SetHeadLess(unsigned int h) { headLess = h; }
 	inline unsigned int GetHealthMonitor() const { return noHealthMonitor; }
+	inline unsigned int GetBackgroundGCR() const { return backgroundGCR; }
 	inline unsigned int GetDHCP() const { return useDHCP; }
 	inline float GetTZ() const { return TZ; }
 #endif	
@@ -217,6 +220,10 @@ private:
 	unsigned int rotaryEncoderInvert;
 	// headless
 	unsigned int headLess;
+	// Keep only this many caddy images expanded and the rest LZ compressed, default is 0 (off)
+	unsigned int compressCaddy;
+	// Size in MB of the cache of converted NIB/NBZ tracks on the SD card, default is 0 (off)
+	unsigned int trackCache;
 
 #if defined (__CIRCLE__)
 	// WiFi & Networking
@@ -230,6 +237,9 @@ private:
 	// Healthmonitor Console, default is off
 	unsigned int noHealthMonitor;
 
+	// Convert the tracks of mounted D64/D71 images to GCR on core 3 before the drive needs them, default is off
+	unsigned int backgroundGCR;
+
 	// use DHCP
 	unsigned int useDHCP;
 
@@ -13,6 +13,10 @@
 
 #include "esp32.h"
 
+#elif defined(__HOST__)
+
+#include "host.h"
+
 #else
 
 #include <stddef.h>
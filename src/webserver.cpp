@@ -23,6 +23,9 @@
 #include <circle/util.h>
 #include <circle/memory.h>
 #include <circle/timer.h>
+#include <circle/net/in.h>
+#include <circle/net/ipaddress.h>
+#include <circle/sched/scheduler.h>
 #include <assert.h>
 #include "circle-kernel.h"
 #include "options.h"
@@ -37,14 +40,18 @@
 #include "Petscii.h"
 #include "iec_commands.h"
 #include "logger.h"
+#include "EmulationTiming.h"
+#include "Mailbox.h"
+#include "ZipArchive.h"
+#include "ImageHash.h"
 using namespace std;
 
 extern Options options;
-bool webserver_upload = false;
-char mount_img[256] = { 0 };
-char mount_path[256] = { 0 };
-int mount_new = 0;
 extern IEC_Commands *_m_IEC_Commands;
+extern EmulationTiming emulationTiming;
+extern EmulatorCommandMailbox emulatorCommands;
+extern EmulatorStatusMailbox emulatorStatus;
+extern EmulatorCaddySnapshot emulatorCaddy;
 static string def_prefix = "SD:/1541";
 #define MAX_ICON_SIZE (512 * 1024)
 static char icon_buf[MAX_ICON_SIZE];
@@ -84,6 +91,11 @@ static const u8 s_Style[] =
 #include "webcontent/style.h"
 ;
 
+static const u8 s_StyleGz[] =
+{
+#include "webcontent/style.gz.h"
+};
+
 static const u8 s_Favicon[] =
 {
 #include "webcontent/favicon.h"
@@ -99,11 +111,91 @@ static const u8 s_font[] =
 #include "webcontent/C64_Pro_Mono-STYLE.h"
 };
 
+static const u8 s_fontGz[] =
+{
+#include "webcontent/C64_Pro_Mono-STYLE.gz.h"
+};
+
+// The pages' static assets, served with an ETag and Cache-Control so that the browser keeps them
+struct static_asset
+{
+	const char *path;
+	const char *type;
+	const u8 *content;
+	unsigned length;
+	const u8 *gz;		// 0 where compressing doesn't pay
+	unsigned gzLength;
+};
+
+static const static_asset s_assets[] =
+{
+	{ "/style.css", "text/css", s_Style, sizeof s_Style - 1, s_StyleGz, sizeof s_StyleGz },
+	{ "/pi1541-logo.png", "image/png", s_logo, sizeof s_logo, 0, 0 },
+	{ "/favicon.ico", "image/x-icon", s_Favicon, sizeof s_Favicon, 0, 0 },
+	{ "/web/C64_Pro_Mono.ttf", "font/ttf", s_font, sizeof s_font, s_fontGz, sizeof s_fontGz },
+};
+
+static const static_asset *find_asset(const char *path)
+{
+	for (unsigned index = 0; index < sizeof s_assets / sizeof s_assets[0]; ++index)
+	{
+		if (strcmp(path, s_assets[index].path) == 0)
+			return &s_assets[index];
+	}
+	return 0;
+}
+
+// A strong ETag per representation, so the gzip'ed copy has its own
+static string asset_etag(const static_asset *asset, bool gzip)
+{
+	static u64 hashes[sizeof s_assets / sizeof s_assets[0]];
+	unsigned index = asset - s_assets;
+	char etag[24];
+
+	if (hashes[index] == 0)
+		hashes[index] = ImageHash::Hash(asset->content, asset->length);
+	snprintf(etag, sizeof etag, "\"%016llx%s\"", (unsigned long long)hashes[index], gzip ? "-gz" : "");
+	return etag;
+}
+
+static string header_value(const string &header, const char *name)
+{
+	string lower = header;
+	std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+	size_t start = lower.find(string("\r\n") + name + ":");
+	if (start == string::npos)
+		return "";
+	start += strlen(name) + 3;
+	size_t end = header.find("\r\n", start);
+	start = header.find_first_not_of(" \t", start);
+	if (start == string::npos || start > end)
+		return "";
+	return header.substr(start, end - start);
+}
+
+#define STREAM_SEND_SIZE	1460		// A TCP segment
+
+// Sends all of it a segment at a time.
+static bool send_all(CSocket *pSocket, const void *pBuffer, unsigned nLength)
+{
+	const u8 *p = (const u8 *)pBuffer;
+	while (nLength > 0)
+	{
+		int nResult = pSocket->Send (p, nLength < STREAM_SEND_SIZE ? nLength : STREAM_SEND_SIZE, 0);
+		if (nResult <= 0)
+			return false;
+		p += nResult;
+		nLength -= nResult;
+	}
+	return true;
+}
+
 static const char FromWebServer[] = "webserver";
 
 CWebServer::CWebServer (CNetSubSystem *pNetSubSystem, CActLED *pActLED, CSocket *pSocket, 
 	unsigned max_content_size, unsigned max_multipart_size)
 :	CHTTPDaemon (pNetSubSystem, pSocket, max_content_size, 80, max_multipart_size),
+	m_pConnection ((CWebConnection *) pSocket),	// Workers are only made by CreateWorker()
 	m_nMaxContentSize(max_content_size),
 	m_nMaxMultipartSize(max_multipart_size),
 	m_pActLED (pActLED)
@@ -118,7 +210,83 @@ CWebServer::~CWebServer (void)
 
 CHTTPDaemon *CWebServer::CreateWorker (CNetSubSystem *pNetSubSystem, CSocket *pSocket)
 {
-	return new CWebServer (pNetSubSystem, m_pActLED, pSocket, m_nMaxContentSize, m_nMaxMultipartSize);
+	return new CWebServer (pNetSubSystem, m_pActLED, new CWebConnection (pNetSubSystem, pSocket), m_nMaxContentSize, m_nMaxMultipartSize);
+}
+
+CWebConnection::CWebConnection (CNetSubSystem *pNetSubSystem, CSocket *pSocket)
+:	CSocket (pNetSubSystem, IPPROTO_TCP),
+	m_pSocket (pSocket),
+	m_bNotModified (false),
+	m_bHeaderSent (false)
+{
+}
+
+CWebConnection::~CWebConnection (void)
+{
+	delete m_pSocket;
+}
+
+int CWebConnection::Receive (void *pBuffer, unsigned nLength, int nFlags)
+{
+	int nResult = m_pSocket->Receive (pBuffer, nLength, nFlags);
+	if (nResult > 0 && m_Request.find("\r\n\r\n") == string::npos && m_Request.length() < 8192)
+		m_Request.append((const char *)pBuffer, nResult);
+	return nResult;
+}
+
+const u8 *CWebConnection::GetForeignIP (void) const
+{
+	return m_pSocket->GetForeignIP ();
+}
+
+string CWebConnection::GetHeader (const char *pName) const
+{
+	return header_value(m_Request.substr(0, m_Request.find("\r\n\r\n") + 2), pName);
+}
+
+void CWebConnection::AddHeader (const string &header)
+{
+	m_Headers += header + "\r\n";
+}
+
+void CWebConnection::NotModified (void)
+{
+	m_bNotModified = true;
+}
+
+// Holds the daemon's response back until its headers are complete, then sends them with ours after the status line.
+// A 304 goes without Content-Type, Content-Length or the content itself.
+int CWebConnection::Send (const void *pBuffer, unsigned nLength, int nFlags)
+{
+	if (m_bHeaderSent)
+		return m_bNotModified ? (int)nLength : m_pSocket->Send (pBuffer, nLength, nFlags);
+
+	m_Response.append((const char *)pBuffer, nLength);
+	size_t headerEnd = m_Response.find("\r\n\r\n");
+	if (headerEnd == string::npos)
+		return nLength;
+	m_bHeaderSent = true;
+
+	size_t statusEnd = m_Response.find("\r\n");
+	string response;
+	if (!m_bNotModified)
+		response = m_Response.substr(0, statusEnd + 2) + m_Headers + m_Response.substr(statusEnd + 2);
+	else
+	{
+		response = m_Response.substr(0, m_Response.find(' ')) + " 304 Not Modified\r\n" + m_Headers;
+		for (size_t start = statusEnd + 2; start < headerEnd + 2; )
+		{
+			size_t end = m_Response.find("\r\n", start) + 2;
+			string line = m_Response.substr(start, end - start);
+			std::transform(line.begin(), line.end(), line.begin(), ::tolower);
+			if (line.compare(0, 13, "content-type:") != 0 && line.compare(0, 15, "content-length:") != 0)
+				response += m_Response.substr(start, end - start);
+			start = end;
+		}
+		response += "\r\n";
+	}
+	m_Response.clear();
+	return send_all(m_pSocket, response.c_str(), response.length()) ? (int)nLength : -1;
 }
 
 static std::string urlEncode(const std::string& value) {
@@ -274,7 +442,8 @@ static int direntry_table(const string header, string &res, string &path, string
 					"<button type=\"button\" class=\"btb btn-success\" onClick=\"return delConfirm(event)\">Delete</button></a>";
 				if (type_filter != AM_DIR)
 				{
-					res += string("<a href=") + page + "?[DIR]&"+ urlEncode(path) + "&[DOWNLOAD]&" + urlEncode(it.fname) + " download=\"" + it.fname + "\">"
+					res += string("<a href=") + page + "?[DIR]&"+ urlEncode(path) + "&[DOWNLOAD]&" + urlEncode(it.fname) +
+						" data-port=" + to_string(STREAM_PORT) + " data-path=" + urlEncode(path + sep + it.fname) + " download=\"" + it.fname + "\">"
 					"<button type=\"button\" class=\"btb btn-success\" onClick=\"return delConfirm(event)\">Download</button></a>";
 				}
 				res += string("</td>");
@@ -354,13 +523,13 @@ static bool write_file(const char *fn, const u8 *pPartData, unsigned nPartLength
 		ret = true;
 	}
 	f_close(&fp);
+	FileBrowser::InvalidateFolderListings();
 	return ret;
 }
 
-static bool write_image(string fn, char *extension, const u8 *pPartData, unsigned nPartLength, string &msg)
+static bool upload_allowed(const char *extension)
 {
-	bool ret = false;
-	if ((strcmp(extension, "d64") == 0) ||
+	return ((strcmp(extension, "d64") == 0) ||
 		(strcmp(extension, "g64") == 0) ||
 		(strcmp(extension, "d81") == 0) ||
 		(strcmp(extension, "nib") == 0) ||
@@ -371,7 +540,57 @@ static bool write_image(string fn, char *extension, const u8 *pPartData, unsigne
 		(strcmp(extension, "txt") == 0) ||
 		(strcmp(extension, "nfo") == 0) ||
 		(strcmp(extension, "zip") == 0) ||
-		(strcmp(extension, "prg") == 0))
+		(strcmp(extension, "prg") == 0));
+}
+
+struct zip_report
+{
+	string *msg;
+	unsigned failed;
+	unsigned skipped;
+};
+
+static void zip_progress(void *context, const char *name, u32 size, ZipArchive::Result result)
+{
+	zip_report *report = (zip_report *)context;
+	if (result == ZipArchive::SKIPPED)
+	{
+		report->skipped++;
+		return;
+	}
+	if (result != ZipArchive::EXTRACTED)
+	{
+		Kernel.log("%s: '%s' %s", __FUNCTION__, name, ZipArchive::ResultText(result));
+		report->failed++;
+	}
+	*report->msg += (string("&nbsp;&nbsp;<i>") + name + "</i> (" + to_string(size) + " bytes) " + ZipArchive::ResultText(result) + "<br />");
+	CScheduler::Get()->Yield(); // an archive can hold hundreds of images
+}
+
+// Extracts the images of an uploaded archive next to it. The archive only goes when every member came out,
+// so nothing that isn't an image, and no image that failed or whose name was taken, is lost with it.
+static void extract_zip(const string &archive, string &msg)
+{
+	zip_report report = { &msg, 0, 0 };
+	string folder = archive.substr(0, archive.rfind('/'));
+	int extracted = ZipArchive::Extract(archive.c_str(), folder.c_str(), zip_progress, &report);
+	if (extracted < 0)
+		msg += (string("cannot read archive <i>") + archive + "</i>, kept as it is<br />");
+	else
+	{
+		msg += (to_string(extracted) + " images extracted from <i>" + archive + "</i><br />");
+		if (extracted > 0 && report.failed == 0 && report.skipped == 0)
+			f_unlink(archive.c_str());
+		else if (extracted > 0)
+			msg += (string("<i>") + archive + "</i> kept, as it holds more than what was extracted<br />");
+	}
+	FileBrowser::InvalidateFolderListings();
+}
+
+static bool write_image(string fn, char *extension, const u8 *pPartData, unsigned nPartLength, string &msg)
+{
+	bool ret = false;
+	if (upload_allowed(extension))
 	{
 		DEBUG_LOG("%s: received %d bytes.", __FUNCTION__, nPartLength);
 		FILINFO fi;
@@ -380,6 +599,8 @@ static bool write_image(string fn, char *extension, const u8 *pPartData, unsigne
 		if (write_file(_x.c_str(), pPartData, nPartLength))
 		{
 			msg += (string ("successfully wrote <i>") + _x + "</i><br />");
+			if (strcmp(extension, "zip") == 0)
+				extract_zip(_x, msg);
 			ret = true;
 		}
 		else
@@ -600,7 +821,10 @@ static FRESULT f_mkdir_full(const char *path, string &msg)
 				break;
 			}
 			else
+			{
 				msg += (string("created <i>") + ndir + "</i><br />");
+				FileBrowser::InvalidateFolderListings();
+			}
 
 	} while (!done);
 	return ret;
@@ -645,15 +869,16 @@ static FRESULT f_unlink_full(string path, string &msg)
 		res = f_unlink(path.c_str());
 	}
 	f_closedir(&dir);
+	FileBrowser::InvalidateFolderListings();
 	return res;
 }
 
 static unsigned char img_buf[READBUFFER_SIZE];
 extern FileBrowser *fileBrowser;
 
-FRESULT download_file(string &fullndir, const u8 *&pContent, unsigned &nLength, string &msg)
+// Reads the whole file into the page buffer; larger files are only served by CStreamServer.
+FRESULT download_file(string &fullndir, u8 *pBuffer, unsigned nMaxLength, const u8 *&pContent, unsigned &nLength, string &msg)
 {
-	FILINFO fileinfo;
 	FIL fp;
 	FRESULT res = FR_OK;
 	UINT bytesRead;
@@ -662,15 +887,23 @@ FRESULT download_file(string &fullndir, const u8 *&pContent, unsigned &nLength,
 		msg = "Open of " + fullndir + " failed (" + to_string(res) + ")";
 	else
 	{
-		SetACTLed(true);
-		if ((res = f_read(&fp, img_buf, READBUFFER_SIZE, &bytesRead)) != FR_OK)
-			msg = "Read failed for " + fullndir + " (" + to_string(res) + ")";
-		SetACTLed(false);
+		if (f_size(&fp) > nMaxLength)
+		{
+			msg = fullndir + " is too large to download here, use port " + to_string(STREAM_PORT);
+			res = FR_DENIED;
+		}
+		else
+		{
+			SetACTLed(true);
+			if ((res = f_read(&fp, pBuffer, f_size(&fp), &bytesRead)) != FR_OK)
+				msg = "Read failed for " + fullndir + " (" + to_string(res) + ")";
+			SetACTLed(false);
+		}
 		f_close(&fp);
 	}
 	if (res == FR_OK)
 	{
-		pContent = img_buf;
+		pContent = pBuffer;
 		nLength = bytesRead;
 	}
 	else
@@ -769,6 +1002,294 @@ out:
 	return ret;
 }
 
+static string u64_string(u64 value)
+{
+	char buf[24];
+	char *p = buf + sizeof(buf);
+	*--p = '\0';
+	do
+	{
+		*--p = '0' + value % 10;
+		value /= 10;
+	} while (value);
+	return string(p);
+}
+
+static string timing_track(unsigned halfTrack)
+{
+	string track = to_string((halfTrack >> 1) + 1);
+	if (halfTrack & 1)
+		track += ".5";
+	return track;
+}
+
+// Hand a command to the emulator core. Fails if the emulator has not caught up with the previous ones yet.
+static bool post_command(EmulatorCommand::Type type, const string &path = "", const string &image = "", int index = 0)
+{
+	EmulatorCommand command;
+	command.type = type;
+	command.index = index;
+	strncpy(command.path, path.c_str(), sizeof(command.path) - 1);
+	command.path[sizeof(command.path) - 1] = 0;
+	strncpy(command.image, image.c_str(), sizeof(command.image) - 1);
+	command.image[sizeof(command.image) - 1] = 0;
+	if (!emulatorCommands.Post(command))
+	{
+		DEBUG_LOG("%s: emulator command mailbox full, dropping command %d", __FUNCTION__, type);
+		return false;
+	}
+	return true;
+}
+
+// The emulator's reply to the previous request (the emulator answers within a millisecond or so, after this page has gone).
+// Returns 0 until there has been a reply.
+static const EmulatorStatus *latest_emulator_status(void)
+{
+	static EmulatorStatus last;
+	static bool have_status = false;
+	EmulatorStatus status;
+
+	while (emulatorStatus.Receive(status))
+	{
+		last = status;
+		have_status = true;
+	}
+	post_command(EmulatorCommand::STATUS_REQUEST);
+	return have_status ? &last : 0;
+}
+
+// The caddy's image names as the emulator last published them.
+static vector<string> emulator_caddy(void)
+{
+	EmulatorCaddy caddy;
+	vector<string> names;
+
+	emulatorCaddy.Read(caddy);
+	const char *name = caddy.names;
+	for (const char *end; (end = strchr(name, '\n')) != 0; name = end + 1)
+		names.push_back(string(name, end - name));
+	return names;
+}
+
+// The name of the image in the drive, or "" when there is none.
+static string emulator_image(const EmulatorStatus &status, const vector<string> &caddy)
+{
+	return status.diskInserted && status.selectedIndex < caddy.size() ? caddy[status.selectedIndex] : string();
+}
+
+static void emulator_status_html(string &html)
+{
+	const EmulatorStatus *status = latest_emulator_status();
+	if (!status)
+		return;
+	const EmulatorStatus &last = *status;
+
+	if (last.emulating == IEC_COMMANDS)
+		html += "<br />Drive: <i>browsing</i>";
+	else
+	{
+		char drive[64];
+		snprintf(drive, sizeof(drive), "%s image %u/%u, track %s, motor %s, LED %s",
+			last.emulating == EMULATING_1581 ? "1581" : "1541", (unsigned)last.selectedIndex + 1, (unsigned)last.numberOfImages,
+			timing_track(last.halfTrack).c_str(), last.motor ? "on" : "off", last.LED ? "on" : "off");
+		html += string("<br />Drive: <i>") + drive + " <b>" + emulator_image(last, emulator_caddy()) + "</b></i>";
+	}
+	if (last.optionsChanged)
+		html += "<br />Options: <i>changed, restart to apply</i>";
+
+	unsigned pending = DiskImage::WriteBacksPending();
+	html += "<br />Write-back: <i>" + (pending ? to_string(pending) + " image(s) saving, " : string())
+		+ to_string(DiskImage::WriteBacksFlushed()) + " saved since boot</i>";
+
+	unsigned packedBytes = DiskImage::PackedBytes();
+	if (packedBytes)
+	{
+		unsigned ratio = (unsigned)((u64)DiskImage::PackedTrackBytes() * 10 / packedBytes);
+		unsigned expanded = DiskImage::TracksExpanded();
+		html += "<br />Caddy compression: <i>" + to_string(DiskImage::PackedTrackBytes() >> 10) + "KB of tracks in "
+			+ to_string(packedBytes >> 10) + "KB (" + to_string(ratio / 10) + "." + to_string(ratio % 10) + ":1), "
+			+ to_string(expanded) + " tracks expanded"
+			+ (expanded ? ", " + to_string(DiskImage::ExpandTicks() / expanded) + "us each" : string()) + "</i>";
+		unsigned swaps = DiskCaddy::Swaps();
+		if (swaps)
+			html += "<br />Caddy swaps: <i>" + to_string(swaps) + ", " + to_string(DiskCaddy::SwapMicroseconds() / swaps)
+				+ "us on average, " + to_string(DiskCaddy::MaxSwapMicroseconds()) + "us at most (plus expanding the track under the head)</i>";
+	}
+
+	if (DiskImage::TrackCacheMaxBytes())
+	{
+		html += "<br />Track cache: <i>" + to_string(DiskImage::TrackCacheImages()) + " images, "
+			+ to_string(DiskImage::TrackCacheBytes() >> 10) + "KB of " + to_string(DiskImage::TrackCacheMaxBytes() >> 10) + "KB, "
+			+ to_string(DiskImage::TrackCacheHits()) + " hits, " + to_string(DiskImage::TrackCacheMisses()) + " misses</i>"
+			+ " <a href=\"purgecache.html\" onClick=\"return delConfirm(event)\">[purge]</a>";
+	}
+}
+
+// Loop timing of the current (or last) mount for /pistats.html
+static void timing_html(string &html)
+{
+	const EmulationTiming &t = emulationTiming;
+	if (t.device == EmulationTiming::DEVICE_NONE)
+		return;
+
+	html += "<br />Emulation: <i>" + string(t.device == EmulationTiming::DEVICE_1581 ? "1581" : "1541") + ", "
+		+ to_string(t.overruns) + " overruns, " + u64_string(t.cyclesLost) + " cycles lost, longest run "
+		+ to_string(t.longestOverrunRun) + "</i>";
+	html += "<br />Loop (us): <i>";
+	for (unsigned bin = 0; bin < EmulationTiming::HISTOGRAM_BINS; ++bin)
+	{
+		string name = EmulationTiming::GetBinName(bin);
+		replaceAll(name, "<", "&lt;");
+		html += string(bin ? " " : "") + name + ":" + u64_string(t.histogram[bin]);
+	}
+	html += "</i>";
+	const EmulationTiming::Overrun *overrun = t.GetOverrun(0);
+	if (overrun)
+	{
+		char last[64];
+		snprintf(last, sizeof(last), "$%04X track %s (%uus)", overrun->pc, timing_track(overrun->halfTrack).c_str(), overrun->budgets);
+		html += string("<br />Last overrun: <i>") + last + "</i>";
+	}
+}
+
+// The page is Latin-1 like the file names, so anything outside ASCII goes as \u00XX.
+static string json_string(const char *value)
+{
+	string json = "\"";
+	for (const unsigned char *c = (const unsigned char *)value; *c; ++c)
+	{
+		if (*c == '"' || *c == '\\')
+		{
+			json += '\\';
+			json += *c;
+		}
+		else if (*c < 0x20 || *c >= 0x80)
+		{
+			char escaped[8];
+			snprintf(escaped, sizeof(escaped), "\\u%04x", *c);
+			json += escaped;
+		}
+		else
+			json += *c;
+	}
+	return json + "\"";
+}
+
+// For /status.json, which monitoring polls, so only what is at hand without touching the SD card.
+static void status_json(string &json)
+{
+	unsigned int temp;
+	GetTemperature(temp);
+	const EmulationTiming &t = emulationTiming;
+	const EmulatorStatus *status = latest_emulator_status();
+
+	json = "{\"deviceID\":" + to_string(_m_IEC_Commands->GetDeviceId()) + ",\"temperature\":" + to_string(temp / 1000)
+		+ ",\"emulator\":";
+	if (!status)
+		json += "null";
+	else
+	{
+		const char *mode = status->emulating == EMULATING_1541 ? "1541" : status->emulating == EMULATING_1581 ? "1581" : "browse";
+		vector<string> caddy = emulator_caddy();
+		json += string("{\"sequence\":") + to_string(status->sequence) + ",\"mode\":\"" + mode + "\",\"image\":"
+			+ json_string(emulator_image(*status, caddy).c_str()) + ",\"selectedIndex\":" + to_string(status->selectedIndex) + ",\"caddy\":[";
+		for (unsigned index = 0; index < caddy.size(); ++index)
+			json += (index ? "," : "") + json_string(caddy[index].c_str());
+		json += string("],\"track\":") + (status->emulating == IEC_COMMANDS ? "null" : timing_track(status->halfTrack))
+			+ ",\"motor\":" + (status->motor ? "true" : "false") + ",\"led\":" + (status->LED ? "true" : "false")
+			+ ",\"optionsChanged\":" + (status->optionsChanged ? "true" : "false") + "}";
+	}
+	json += ",\"overruns\":" + to_string(t.overruns) + ",\"cyclesLost\":" + u64_string(t.cyclesLost)
+		+ ",\"longestOverrunRun\":" + to_string(t.longestOverrunRun)
+		+ ",\"writeBacksPending\":" + to_string(DiskImage::WriteBacksPending()) + "}";
+}
+
+// POST /control.json with action=mount&image=<path>, action=swap&index=<n>, action=eject or action=reset.
+static void control_json(const char *pFormData, string &json)
+{
+	string action, image, index;
+	string form = pFormData;
+	size_t start = 0;
+	while (start < form.length())
+	{
+		size_t end = form.find('&', start);
+		if (end == string::npos)
+			end = form.length();
+		string pair = form.substr(start, end - start);
+		size_t equals = pair.find('=');
+		string value = equals == string::npos ? "" : urlDecode(pair.substr(equals + 1));
+		pair = pair.substr(0, equals);
+		if (pair == "action")
+			action = value;
+		else if (pair == "image")
+			image = value;
+		else if (pair == "index")
+			index = value;
+		start = end + 1;
+	}
+
+	string error;
+	bool posted = false;
+	if (action == "mount")
+	{
+		FILINFO fi;
+		size_t slash = image.rfind('/');
+		string dir = slash == string::npos ? "" : image.substr(0, slash);
+		string name = image.substr(slash == string::npos ? 0 : slash + 1);
+		if (f_stat((def_prefix + image).c_str(), &fi) != FR_OK || (fi.fattrib & AM_DIR))
+			error = "no such image";
+		else if (DiskImage::IsLSTExtention(name.c_str()))
+			posted = post_command(EmulatorCommand::MOUNT_LST, def_prefix + dir, name);
+		else if (DiskImage::IsDiskImageExtention(name.c_str()))
+			posted = post_command(EmulatorCommand::MOUNT_IMAGE, def_prefix + dir, name);
+		else
+			error = "not a disk image";
+	}
+	else if (action == "swap")
+	{
+		const EmulatorStatus *status = latest_emulator_status();
+		if (index.empty() || index.find_first_not_of("0123456789") != string::npos)
+			error = "index missing";
+		else if (!status)
+			error = "emulator status not known yet, try again";
+		else if (status->emulating == IEC_COMMANDS)
+			error = "not emulating";
+		else if (index.length() > 3 || atoi(index.c_str()) >= status->numberOfImages)
+			error = "no such image in the caddy";
+		else
+			posted = post_command(EmulatorCommand::SWAP_DISK, "", "", atoi(index.c_str()));
+	}
+	else if (action == "eject")
+		posted = post_command(EmulatorCommand::EXIT);
+	else if (action == "reset")
+		posted = post_command(EmulatorCommand::RESET);
+	else
+		error = pFormData[0] ? "unknown action" : "use POST";
+	if (error.empty() && !posted)
+		error = "emulator busy";
+
+	json = "{\"ok\":" + string(error.empty() ? "true" : "false") + ",\"action\":" + json_string(action.c_str())
+		+ (error.empty() ? "" : ",\"error\":" + json_string(error.c_str())) + "}";
+}
+
+static void timing_json(string &json)
+{
+	const EmulationTiming &t = emulationTiming;
+	const char *device = t.device == EmulationTiming::DEVICE_1541 ? "1541" : t.device == EmulationTiming::DEVICE_1581 ? "1581" : "none";
+
+	json = string("{\"device\":\"") + device + "\",\"passes\":" + u64_string(t.passes) + ",\"histogram\":{";
+	for (unsigned bin = 0; bin < EmulationTiming::HISTOGRAM_BINS; ++bin)
+		json += string(bin ? "," : "") + "\"" + EmulationTiming::GetBinName(bin) + "\":" + u64_string(t.histogram[bin]);
+	json += "},\"overruns\":" + to_string(t.overruns) + ",\"cyclesLost\":" + u64_string(t.cyclesLost)
+		+ ",\"longestOverrunRun\":" + to_string(t.longestOverrunRun) + ",\"recentOverruns\":[";
+	for (unsigned index = 0; const EmulationTiming::Overrun *overrun = t.GetOverrun(index); ++index)
+	{
+		json += string(index ? "," : "") + "{\"pass\":" + u64_string(overrun->pass) + ",\"pc\":" + to_string(overrun->pc)
+			+ ",\"track\":" + timing_track(overrun->halfTrack) + ",\"us\":" + to_string(overrun->budgets) + "}";
+	}
+	json += "]}";
+}
+
 void drives_html(string &drives)
 {
 	extern const char* VolumeStr[];
@@ -872,7 +1393,10 @@ THTTPStatus CWebServer::GetContent (const char  *pPath,
 			if ((ret = f_mkdir(fullndir.c_str())) != FR_OK)
 				snprintf(msg_str, 1023,"Failed to create <i>%s</i> (%d)", fullndir.c_str(), ret);
 			else
+			{
 				snprintf(msg_str, 1023,"Successfully created <i>%s</i>", fullndir.c_str());
+				FileBrowser::InvalidateFolderListings();
+			}
 			DEBUG_LOG("%s: mkdir '%s' returned %d", __FUNCTION__, fullndir.c_str(), ret);
 			msg = msg_str;
 		}
@@ -939,7 +1463,7 @@ THTTPStatus CWebServer::GetContent (const char  *pPath,
 			ndir = urlDecode(ndir);
 			string fullndir = def_prefix + curr_path + "/" + ndir;
 			DEBUG_LOG("%s: download file '%s'", __FUNCTION__, fullndir.c_str());
-			download_file(fullndir, pContent, nLength, msg);
+			download_file(fullndir, pBuffer, *pLength, pContent, nLength, msg);
 			*ppContentType = "application/octet-stream";
 			goto out;
 		}
@@ -1036,15 +1560,15 @@ THTTPStatus CWebServer::GetContent (const char  *pPath,
 					DEBUG_LOG("%s: going to write '%s'", __FUNCTION__, targetfn.c_str());
 					write_image(targetfn, extension, pPartDataCB, nPartLengthCB, msg);
 	
-					if (do_remount)
-						webserver_upload = true; // this re-mounts the automount image
+					if (do_remount && !post_command(EmulatorCommand::AUTOLOAD)) // this re-mounts the automount image
+						msg += "emulator busy, not remounted<br />";
 					break;
 				}
 			}
 		}
 		direntry_table(header_NT, curr_dir, curr_path, page, AM_DIR, true);
 		direntry_table(header_NTD, files, curr_path, page, ~AM_DIR, true);
-		String.Format(s_Index, drives.c_str(), msg.c_str(), curr_path.c_str(), (
+		String.Format(s_Index, drives.c_str(), msg.c_str(), STREAM_PORT, curr_path.c_str(), (
 			"<I>" + def_prefix + curr_path + "</i>").c_str(), curr_dir.c_str(), files.c_str(),
 			Kernel.get_version(), mem.c_str(), 
 			curr_path.c_str(), // mkdir script
@@ -1061,16 +1585,42 @@ THTTPStatus CWebServer::GetContent (const char  *pPath,
 		unsigned int temp;
 		GetTemperature(temp);
 		CString *t = Kernel.get_timer()->GetTimeString();
-		String.Format("DeviceID: <i>%d</i><br />Pi Temp: <i>%dC @%ldMHz</i><br />Time: <i>%s</i>",
+		string drive, timing;
+		emulator_status_html(drive);
+		timing_html(timing);
+		String.Format("DeviceID: <i>%d</i><br />Pi Temp: <i>%dC @%ldMHz</i><br />Time: <i>%s</i>%s%s",
 				 _m_IEC_Commands->GetDeviceId(),
 				 temp / 1000,
 				 CPUThrottle.GetClockRate() / 1000000L,
-				 t->c_str());
+				 t->c_str(),
+				 drive.c_str(),
+				 timing.c_str());
 		delete t;
 		pContent = (const u8 *)(const char *)String;
 		nLength = String.GetLength();
 		*ppContentType = "text/html; charset=iso-8859-1";
 	}
+	else if (strcmp(pPath, "/status.json") == 0 || strcmp(pPath, "/control.json") == 0)
+	{
+		string json;
+		if (pPath[1] == 's')
+			status_json(json);
+		else
+			control_json(pFormData, json);
+		String = json.c_str();
+		pContent = (const u8 *)(const char *)String;
+		nLength = String.GetLength();
+		*ppContentType = "application/json";
+	}
+	else if (strcmp(pPath, "/timing.json") == 0)
+	{
+		string json;
+		timing_json(json);
+		String = json.c_str();
+		pContent = (const u8 *)(const char *)String;
+		nLength = String.GetLength();
+		*ppContentType = "application/json";
+	}
 	else if (strcmp(pPath, "/getindex.html") == 0)
 	{
 		string index;
@@ -1135,7 +1685,10 @@ THTTPStatus CWebServer::GetContent (const char  *pPath,
 			{
 				string dfn = string("SD:/") + filename;
 				if (write_file(dfn.c_str(), pPartData, nPartLength))
+				{
 					msg = string("Successfully wrote <i>") + dfn + "</i>";
+					post_command(EmulatorCommand::OPTIONS_CHANGED);
+				}
 				else
 					msg = string("Failed to write <i>") + dfn + "</i>";
 			}
@@ -1160,7 +1713,10 @@ THTTPStatus CWebServer::GetContent (const char  *pPath,
 			f_unlink((dfn + ".BAK").c_str());	// unconditionally remove backup
 			f_rename(dfn.c_str(), (dfn + ".BAK").c_str());
 			if (write_file(dfn.c_str(), pPartData, nPartLength))
+			{
 				msg = string("Successfully wrote <i>") + dfn + "</i><br />";
+				post_command(EmulatorCommand::OPTIONS_CHANGED);
+			}
 			else
 				msg = string("Failed to write <i>") + dfn + "</i><br />";
 		}
@@ -1343,6 +1899,7 @@ THTTPStatus CWebServer::GetContent (const char  *pPath,
 					else
 					{
 						msg = "Successfully renamed <i>" + oldname + "</i> to <i>" + newname + "</i>";
+						FileBrowser::InvalidateFolderListings();
 						DEBUG_LOG("%s: successfully renamed '%s' to '%s'", __FUNCTION__, oldname.c_str(), newname.c_str());
 						curr_path = newname;
 					}
@@ -1390,17 +1947,14 @@ THTTPStatus CWebServer::GetContent (const char  *pPath,
 				else
 				{
 					//DEBUG_LOG("%s: DOWNLOAD of '%s'", __FUNCTION__, fullname.c_str());
-					download_file(fullname, pContent, nLength, msg);
+					download_file(fullname, pBuffer, *pLength, pContent, nLength, msg);
 					*ppContentType = "application/octet-stream";
 				}
 				goto out;
 			}
 			if (type == "[FILE]")
 			{
-				// store for main emulation
-				strncpy(mount_path, (def_prefix + cwd).c_str(), 255);
-				strncpy(mount_img, img.c_str(), 255);
-				//DEBUG_LOG("%s: mount_img = '%s'", __FUNCTION__, fullname.c_str());
+				const char *mount_img = img.c_str();
 				content = "";
 				// check if it's really an image
 				if (DiskImage::IsPicFileExtention(mount_img))
@@ -1417,8 +1971,10 @@ THTTPStatus CWebServer::GetContent (const char  *pPath,
 					content = curr_path + ":<br /><br />" + content;
 					if (mount_it && DiskImage::IsLSTExtention(mount_img))
 					{
-						msg = "Mounted <i>" + def_prefix + curr_path + "</i><br />";
-						mount_new = 2; /* indicate .lst mount */
+						if (post_command(EmulatorCommand::MOUNT_LST, def_prefix + cwd, img))
+							msg = "Mounted <i>" + def_prefix + curr_path + "</i><br />";
+						else
+							msg = "Emulator busy, nothing mounted<br />";
 					}
 					else
 						msg = "Selected <i>" + def_prefix + curr_path + "</i><br />";	
@@ -1448,8 +2004,10 @@ THTTPStatus CWebServer::GetContent (const char  *pPath,
 					}
 					if (mount_it)
 					{
-						msg = "Mounted <i>" + def_prefix + curr_path + "</i><br />";
-						mount_new = 1;	/* indicate image mount */
+						if (post_command(EmulatorCommand::MOUNT_IMAGE, def_prefix + cwd, img))
+							msg = "Mounted <i>" + def_prefix + curr_path + "</i><br />";
+						else
+							msg = "Emulator busy, nothing mounted<br />";
 					}
 					else
 						msg = "Selected <i>" + def_prefix + curr_path + "</i><br />";						
@@ -1475,7 +2033,7 @@ THTTPStatus CWebServer::GetContent (const char  *pPath,
 					_t, // Mount
 					_t, // Edit
 					_t, // Delete
-					_t, img.c_str(), // Download
+					_t, STREAM_PORT, _t, img.c_str(), // Download
 					(is_dir ? "-->" : ""),
 					curr_dir.c_str(), files.c_str(), content.c_str(),
 					Kernel.get_version(), mem.c_str(),
@@ -1512,17 +2070,33 @@ extern int reboot_req;
 		nLength = String.GetLength();
 		*ppContentType = "text/html; charset=iso-8859-1";
 	}
-	else if (strcmp(pPath, "/style.css") == 0)
+	else if (strcmp(pPath, "/purgecache.html") == 0)
 	{
-		pContent = s_Style;
-		nLength = sizeof s_Style-1;
-		*ppContentType = "text/css";
-	}	
-	else if (strcmp (pPath, "/pi1541-logo.png") == 0)
+		string msg;
+		if (post_command(EmulatorCommand::PURGE_TRACK_CACHE))
+			msg = "Track cache purge requested, it is emptied once the drive is back in the browser.";
+		else
+			msg = "Emulator busy, try again.";
+		String.Format(s_status, msg.c_str(), Kernel.get_version(), mem.c_str());
+		pContent = (const u8 *)(const char *)String;
+		nLength = String.GetLength();
+		*ppContentType = "text/html; charset=iso-8859-1";
+	}
+	else if (const static_asset *asset = find_asset(pPath))
 	{
-		pContent = s_logo;
-		nLength = sizeof s_logo;
-		*ppContentType = "image/x-icon";
+		bool gzip = asset->gz && m_pConnection->GetHeader("accept-encoding").find("gzip") != string::npos;
+		string etag = asset_etag(asset, gzip);
+		string match = m_pConnection->GetHeader("if-none-match");
+		m_pConnection->AddHeader("ETag: " + etag);
+		m_pConnection->AddHeader("Cache-Control: public, max-age=86400");
+		m_pConnection->AddHeader("Vary: Accept-Encoding");
+		if (gzip)
+			m_pConnection->AddHeader("Content-Encoding: gzip");
+		if (match == "*" || match.find(etag) != string::npos)
+			m_pConnection->NotModified();
+		pContent = gzip ? asset->gz : asset->content;
+		nLength = gzip ? asset->gzLength : asset->length;
+		*ppContentType = asset->type;
 	}
 	else if ((endsWith(string(pPath), ".png")) || (endsWith(string(pPath), ".jpg")))
 	{
@@ -1548,18 +2122,6 @@ extern int reboot_req;
 			*ppContentType = "image/x-icon";
 		}
 	}
-	else if (strcmp (pPath, "/favicon.ico") == 0)
-	{
-		pContent = s_Favicon;
-		nLength = sizeof s_Favicon;
-		*ppContentType = "image/x-icon";
-	}
-	else if (strcmp (pPath, "/web/C64_Pro_Mono.ttf") == 0)
-	{
-		pContent = s_font;
-		nLength = sizeof s_font;
-		*ppContentType = "font/ttf";
-	}
 	else
 	{
 		return HTTPNotFound;
@@ -1579,8 +2141,534 @@ out:
 	assert (pBuffer != 0);
 	assert (pContent != 0);
 	assert (nLength > 0);
-	memcpy (pBuffer, pContent, nLength);
+	if (pContent != pBuffer)
+		memcpy (pBuffer, pContent, nLength);
 
 	*pLength = nLength;
 	return HTTPOK;
 }
+
+// Streaming uploads and downloads
+
+#define UPLOAD_RECEIVE_SIZE	2048		// At least a frame, as CSocket::Receive() requires
+#define UPLOAD_MAX_HEADER	4096
+#define UPLOAD_CHUNK_SIZE	(64 * 1024)	// Rounded down to whole clusters
+#define DOWNLOAD_CHUNK_SIZE	(16 * 1024)
+
+// Numbers the temporary files of all uploads, so that two at once into the same folder don't share one.
+// The stream server's tasks all run on the one core and only switch when they yield, so a plain counter will do.
+static unsigned uploadSerial = 0;
+
+// A multipart/form-data body fed in whatever pieces the network delivers. Each file goes to a hidden temporary file
+// in its target folder, written whole clusters at a time; only once the entire body has arrived are they renamed.
+class StreamingUpload
+{
+public:
+	StreamingUpload(const string &boundary)
+		: delimiter("\r\n--" + boundary)
+		, state(PREAMBLE)
+		, fileOpen(false)
+		, chunk(0)
+		, chunkSize(0)
+		, chunkUsed(0)
+		, automount(false)
+	{
+		// The first boundary has no CRLF in front of it
+		pending.insert(pending.end(), '\r');
+		pending.insert(pending.end(), '\n');
+	}
+
+	~StreamingUpload()
+	{
+		if (fileOpen)
+			f_close(&file);
+		for (unsigned index = 0; index < uploads.size(); ++index)
+			f_unlink(uploads[index].temp.c_str());
+		delete [] chunk;
+	}
+
+	// Returns false if the body is malformed or a file could not be written.
+	bool Feed(const u8 *data, unsigned length)
+	{
+		pending.insert(pending.end(), data, data + length);
+		while (state != DONE)
+		{
+			int found;
+			switch (state)
+			{
+				case PREAMBLE:
+				case DATA:
+					found = Find(delimiter.c_str(), delimiter.length());
+					if (found < 0)
+					{
+						// Keep what could be the start of a delimiter split across pieces
+						if (pending.size() < delimiter.length())
+							return true;
+						unsigned safe = pending.size() - delimiter.length() + 1;
+						if (state == DATA && !PartData(&pending[0], safe))
+							return false;
+						pending.erase(pending.begin(), pending.begin() + safe);
+						return true;
+					}
+					if (state == DATA && (!PartData(&pending[0], found) || !EndPart()))
+						return false;
+					pending.erase(pending.begin(), pending.begin() + found + delimiter.length());
+					state = DELIMITER;
+				break;
+				case DELIMITER:
+					if (pending.size() < 2)
+						return true;
+					if (pending[0] == '-' && pending[1] == '-')
+					{
+						state = DONE;
+						return true;
+					}
+					if (pending[0] != '\r' || pending[1] != '\n')
+						return false;
+					pending.erase(pending.begin(), pending.begin() + 2);
+					state = HEADERS;
+				break;
+				case HEADERS:
+					found = Find("\r\n\r\n", 4);
+					if (found < 0)
+						return pending.size() < UPLOAD_MAX_HEADER;
+					partHeader.assign((const char *)&pending[0], found);
+					pending.erase(pending.begin(), pending.begin() + found + 4);
+					if (!BeginPart())
+						return false;
+					state = DATA;
+				break;
+				case DONE:
+				break;
+			}
+		}
+		return true;
+	}
+
+	bool Finished() const { return state == DONE; }
+	const string &Path() const { return xpath; }
+
+	// Moves every file into place once the whole body has arrived.
+	void Commit(string &msg)
+	{
+		bool do_remount = false;
+		for (unsigned index = 0; index < uploads.size(); ++index)
+		{
+			Upload &upload = uploads[index];
+			if (upload.image && automount)
+			{
+				const char *_t = options.GetAutoMountImageName();
+				if (_t && (_t = strrchr(_t, '.')) && (strcasecmp(_t + 1, upload.extension.c_str()) == 0))
+				{
+					Kernel.log("%s: image '%s' shall be used as automount image", __FUNCTION__, upload.target.c_str());
+					upload.target = def_prefix + "/" + options.GetAutoMountImageName();
+					do_remount = true;
+					msg += "automounting<br />";
+				}
+				else
+					msg += (string("automount extension mismatch, uploading image <i>") + upload.target + "</i><br />");
+			}
+			// The file it replaces is only moved aside until the new one is in place, and comes back if that fails
+			FILINFO fi;
+			string aside = upload.temp + ".old";
+			bool replacing = f_stat(upload.target.c_str(), &fi) == FR_OK;
+			f_unlink(aside.c_str());	// Left by an earlier boot with the same serial
+			if (replacing && f_rename(upload.target.c_str(), aside.c_str()) != FR_OK)
+				msg += (string("cannot replace <i>") + upload.target + "</i>, upload kept as <i>" + upload.temp + "</i><br />");
+			else if (f_rename(upload.temp.c_str(), upload.target.c_str()) == FR_OK)
+			{
+				if (replacing)
+					f_unlink(aside.c_str());
+				msg += (string ("successfully wrote <i>") + upload.target + "</i> (" + to_string(upload.size) + " bytes)<br />");
+				if (upload.extension == "zip")
+					extract_zip(upload.target, msg);
+			}
+			else
+			{
+				if (replacing)
+					f_rename(aside.c_str(), upload.target.c_str());
+				msg += (string("file operation failed for <i>") + upload.target + "</i>, upload kept as <i>" + upload.temp + "</i><br />");
+			}
+		}
+		uploads.clear();
+		FileBrowser::InvalidateFolderListings();
+
+		if (do_remount && !post_command(EmulatorCommand::AUTOLOAD)) // this re-mounts the automount image
+			msg += "emulator busy, not remounted<br />";
+	}
+
+	string msg;
+
+private:
+	enum State { PREAMBLE, DELIMITER, HEADERS, DATA, DONE };
+
+	struct Upload
+	{
+		string temp;
+		string target;
+		string extension;
+		bool image;
+		unsigned size;
+	};
+
+	int Find(const char *needle, unsigned length) const
+	{
+		if (pending.size() < length)
+			return -1;
+		const u8 *start = &pending[0];
+		const u8 *last = start + pending.size() - length;
+		for (const u8 *at = start; at <= last; ++at)
+		{
+			at = (const u8 *)memchr(at, needle[0], last - at + 1);
+			if (!at)
+				break;
+			if (memcmp(at, needle, length) == 0)
+				return at - start;
+		}
+		return -1;
+	}
+
+	bool BeginPart()
+	{
+		char name[255];
+		char filename[255];
+		char extension[10] = "";
+
+		extract_field(" name=\"", partHeader.c_str(), name);
+		extract_field("filename=\"", partHeader.c_str(), filename, extension);
+		field = name;
+		value.clear();
+		if (!filename[0] || (field != "diskimage" && field != "directory"))
+			return true;
+		if (!upload_allowed(extension))
+		{
+			Kernel.log("%s: invalid filetype: '.%s'...", __FUNCTION__, extension);
+			msg += (string("invalid filetype for <i>") + filename + "</i><br />");
+			return true;
+		}
+
+		string dir = xpath + "/";
+		string fn = filename;
+		char *fp = strrchr(filename, '/');
+		if (field == "directory" && fp)
+		{
+			*fp = '\0';
+			fn = string(fp + 1);
+			dir = xpath + "/" + string(filename) + "/";
+			f_mkdir_full(dir.c_str(), msg);
+		}
+
+		Upload upload;
+		upload.temp = def_prefix + dir + ".upload" + to_string(++uploadSerial) + ".tmp";
+		upload.target = def_prefix + dir + fn;
+		upload.extension = extension;
+		upload.image = field == "diskimage";
+		upload.size = 0;
+		if (f_open(&file, upload.temp.c_str(), FA_CREATE_ALWAYS | FA_WRITE) != FR_OK)
+		{
+			msg += (string("file operation failed for <i>") + upload.target + "</i><br />");
+			return false;
+		}
+		fileOpen = true;
+		uploads.push_back(upload);
+		DEBUG_LOG("%s: streaming '%s'", __FUNCTION__, upload.target.c_str());
+
+		if (!chunk)
+		{
+			FATFS *fs = file.obj.fs;
+#if FF_MAX_SS != FF_MIN_SS
+			unsigned clusterSize = fs->csize * fs->ssize;
+#else
+			unsigned clusterSize = fs->csize * FF_MAX_SS;
+#endif
+			chunkSize = clusterSize < UPLOAD_CHUNK_SIZE ? UPLOAD_CHUNK_SIZE - UPLOAD_CHUNK_SIZE % clusterSize : clusterSize;
+			chunk = new u8[chunkSize];
+		}
+		chunkUsed = 0;
+		return true;
+	}
+
+	bool PartData(const u8 *data, unsigned length)
+	{
+		if (!fileOpen)
+		{
+			if (value.length() + length < 256)
+				value.append((const char *)data, length);
+			return true;
+		}
+		uploads.back().size += length;
+		while (length)
+		{
+			unsigned take = chunkSize - chunkUsed < length ? chunkSize - chunkUsed : length;
+			memcpy(chunk + chunkUsed, data, take);
+			chunkUsed += take;
+			data += take;
+			length -= take;
+			if (chunkUsed == chunkSize && !Flush())
+				return false;
+		}
+		return true;
+	}
+
+	bool EndPart()
+	{
+		if (fileOpen)
+		{
+			bool ok = Flush();
+			fileOpen = false;
+			if (f_close(&file) != FR_OK || !ok)
+			{
+				msg += (string("file operation failed for <i>") + uploads.back().target + "</i><br />");
+				return false;
+			}
+			if (uploads.back().size == 0)	// No file chosen
+			{
+				f_unlink(uploads.back().temp.c_str());
+				uploads.pop_back();
+			}
+		}
+		else if (field == "xpath")
+			xpath = value;
+		else if (field == "am-cb1")
+			automount = value.length() && value[0] == '1';
+		return true;
+	}
+
+	bool Flush()
+	{
+		UINT bw;
+		bool ok = chunkUsed == 0 || (f_write(&file, chunk, chunkUsed, &bw) == FR_OK && bw == chunkUsed);
+		chunkUsed = 0;
+		return ok;
+	}
+
+	string delimiter;
+	std::vector<u8> pending;
+	State state;
+	string partHeader;
+	string field;
+	string value;
+	FIL file;
+	bool fileOpen;
+	u8 *chunk;
+	unsigned chunkSize;
+	unsigned chunkUsed;
+	std::vector<Upload> uploads;
+	string xpath;
+	bool automount;
+};
+
+// A single "bytes=first-last", "bytes=first-" or "bytes=-suffix" range. Returns false when it can't be satisfied;
+// a list of ranges, or anything else, is answered with the whole file.
+static bool parse_range(const string &range, u32 size, u32 &first, u32 &last, bool &partial)
+{
+	partial = false;
+	if (range.compare(0, 6, "bytes=") != 0 || range.find(',') != string::npos)
+		return true;
+	const char *spec = range.c_str() + 6;
+	char *end;
+	if (*spec == '-')
+	{
+		u32 suffix = strtoul(spec + 1, &end, 10);
+		if (end == spec + 1 || *end)
+			return true;
+		if (suffix == 0 || size == 0)
+			return false;
+		first = suffix < size ? size - suffix : 0;
+		last = size - 1;
+	}
+	else
+	{
+		first = strtoul(spec, &end, 10);
+		if (end == spec || *end != '-')
+			return true;
+		spec = end + 1;
+		last = *spec ? strtoul(spec, &end, 10) : size - 1;
+		if (*spec && *end)
+			return true;
+		if (first >= size || last < first)
+			return false;
+		if (last >= size)
+			last = size - 1;
+	}
+	partial = true;
+	return true;
+}
+
+CStreamServer::CStreamServer (CNetSubSystem *pNetSubSystem, CSocket *pSocket)
+:	m_pNetSubSystem (pNetSubSystem),
+	m_pSocket (pSocket)
+{
+}
+
+CStreamServer::~CStreamServer (void)
+{
+	delete m_pSocket;
+	m_pSocket = 0;
+}
+
+void CStreamServer::Run (void)
+{
+	if (m_pSocket == 0)
+		Listener ();
+	else
+		Worker ();
+}
+
+void CStreamServer::Listener (void)
+{
+	m_pSocket = new CSocket (m_pNetSubSystem, IPPROTO_TCP);
+	if (m_pSocket->Bind (STREAM_PORT) < 0 || m_pSocket->Listen () < 0)
+	{
+		Kernel.log("%s: cannot listen on port %u, streaming uploads and downloads disabled", __FUNCTION__, STREAM_PORT);
+		while (1)
+			CScheduler::Get ()->Sleep (60);
+	}
+
+	while (1)
+	{
+		CIPAddress ForeignIP;
+		u16 nForeignPort;
+		CSocket *pConnection = m_pSocket->Accept (&ForeignIP, &nForeignPort);
+		if (pConnection == 0)
+		{
+			CScheduler::Get ()->Yield ();
+			continue;
+		}
+		new CStreamServer (m_pNetSubSystem, pConnection);
+	}
+}
+
+void CStreamServer::Worker (void)
+{
+	u8 *buffer = new u8[UPLOAD_RECEIVE_SIZE];
+	string header;
+	size_t headerEnd;
+	int nBytes;
+
+	while ((headerEnd = header.find("\r\n\r\n")) == string::npos)
+	{
+		if (header.length() > UPLOAD_MAX_HEADER || (nBytes = m_pSocket->Receive (buffer, UPLOAD_RECEIVE_SIZE, 0)) <= 0)
+		{
+			delete [] buffer;
+			return;
+		}
+		header.append((const char *)buffer, nBytes);
+	}
+
+	if (header.compare(0, 13, "POST /upload ") == 0)
+		Upload (header, headerEnd + 4, buffer);
+	else if (header.compare(0, 14, "GET /download?") == 0)
+		Download (header, header.substr(14, header.find(' ', 14) - 14), false);
+	else if (header.compare(0, 15, "HEAD /download?") == 0)
+		Download (header, header.substr(15, header.find(' ', 15) - 15), true);
+	else
+		Respond ("400 Bad Request", "Expected an upload or a download");
+	delete [] buffer;
+}
+
+void CStreamServer::Upload (string &header, size_t bodyStart, u8 *buffer)
+{
+	int nBytes;
+	string contentType = header_value(header, "content-type");
+	size_t boundary = contentType.find("boundary=");
+	if (boundary == string::npos)
+	{
+		Respond("400 Bad Request", "Expected a multipart upload");
+		return;
+	}
+	string delimiter = contentType.substr(boundary + 9);
+	delimiter = delimiter.substr(0, delimiter.find(';'));
+	if (delimiter.length() > 1 && delimiter[0] == '"')
+		delimiter = delimiter.substr(1, delimiter.length() - 2);
+
+	if (strcasecmp(header_value(header, "expect").c_str(), "100-continue") == 0)
+		m_pSocket->Send ("HTTP/1.1 100 Continue\r\n\r\n", 25, 0);
+
+	// Back to the main web server once done, so the host without this port
+	string host = header_value(header, "host");
+	host = host.substr(0, host.find(':'));
+
+	StreamingUpload upload(delimiter);
+	bool ok = upload.Feed((const u8 *)header.data() + bodyStart, header.length() - bodyStart);
+	header.clear();
+	while (ok && !upload.Finished() && (nBytes = m_pSocket->Receive (buffer, UPLOAD_RECEIVE_SIZE, 0)) > 0)
+		ok = upload.Feed(buffer, nBytes);
+
+	string msg = "Uploading...<br />" + upload.msg;
+	if (ok && upload.Finished())
+		upload.Commit(msg);
+	else
+		msg += "upload incomplete, nothing written<br />";
+	DEBUG_LOG("%s: %s", __FUNCTION__, msg.c_str());
+
+	string back = "http://" + host + "/index.html?[DIR]&" + urlEncode(upload.Path());
+	Respond("200 OK", "<html><head><meta http-equiv=\"refresh\" content=\"3; url=" + back + "\"></head><body>" +
+		msg + "<br /><a href=\"" + back + "\">back</a></body></html>");
+}
+
+void CStreamServer::Download (const string &header, const string &request, bool bHead)
+{
+	string path = urlDecode(request);
+	if (path.find("..") != string::npos)
+	{
+		Respond("403 Forbidden", "Refusing <i>" + path + "</i>");
+		return;
+	}
+	string fullname = def_prefix + path;
+	FIL fp;
+	if (f_open(&fp, fullname.c_str(), FA_READ) != FR_OK)
+	{
+		Respond("404 Not Found", "Can't open <i>" + fullname + "</i>");
+		return;
+	}
+
+	u32 size = f_size(&fp);
+	u32 first = 0;
+	u32 last = size - 1;
+	bool partial;
+	if (!parse_range(header_value(header, "range"), size, first, last, partial))
+	{
+		f_close(&fp);
+		string response = "HTTP/1.1 416 Range Not Satisfiable\r\nContent-Range: bytes */" + to_string(size) +
+			"\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+		send_all(m_pSocket, response.c_str(), response.length());
+		return;
+	}
+	u32 remaining = size ? last - first + 1 : 0;
+	DEBUG_LOG("%s: '%s' %u-%u/%u", __FUNCTION__, fullname.c_str(), first, last, size);
+
+	string response = string("HTTP/1.1 ") + (partial ? "206 Partial Content" : "200 OK") +
+		"\r\nContent-Type: application/octet-stream\r\nContent-Disposition: attachment; filename=\"" +
+		path.substr(path.rfind('/') + 1) + "\"\r\nAccept-Ranges: bytes\r\nContent-Length: " + to_string(remaining) +
+		(partial ? "\r\nContent-Range: bytes " + to_string(first) + "-" + to_string(last) + "/" + to_string(size) : "") +
+		"\r\nConnection: close\r\n\r\n";
+	if (!send_all(m_pSocket, response.c_str(), response.length()) || bHead || f_lseek(&fp, first) != FR_OK)
+		remaining = 0;
+
+	u8 *buffer = remaining ? new u8[DOWNLOAD_CHUNK_SIZE] : 0;
+	while (remaining)
+	{
+		UINT bytesRead;
+		SetACTLed(true);
+		FRESULT res = f_read(&fp, buffer, remaining < DOWNLOAD_CHUNK_SIZE ? remaining : DOWNLOAD_CHUNK_SIZE, &bytesRead);
+		SetACTLed(false);
+		if (res != FR_OK || bytesRead == 0)
+		{
+			Kernel.log("%s: read of '%s' failed with %u bytes left", __FUNCTION__, fullname.c_str(), remaining);
+			break;
+		}
+		if (!send_all(m_pSocket, buffer, bytesRead))
+			break;	// The client went away, perhaps to resume later
+		remaining -= bytesRead;
+	}
+	delete [] buffer;
+	f_close(&fp);
+}
+
+void CStreamServer::Respond (const char *pStatus, const string &body)
+{
+	string response = string("HTTP/1.1 ") + pStatus + "\r\nContent-Type: text/html; charset=iso-8859-1\r\nContent-Length: " +
+		to_string(body.length()) + "\r\nConnection: close\r\n\r\n" + body;
+	send_all(m_pSocket, response.c_str(), response.length());
+}
@@ -21,7 +21,38 @@
 #define _webserver_h
 
 #include <circle/net/httpdaemon.h>
+#include <circle/net/socket.h>
+#include <circle/sched/task.h>
 #include <circle/actled.h>
+#include <string>
+
+#define STREAM_PORT		8080
+
+// The connection a CWebServer worker talks through. It passes everything on to the accepted socket, keeping the
+// request's headers for GetContent() and adding headers to the response or turning it into a 304 on its way out,
+// none of which CHTTPDaemon has a way to do.
+class CWebConnection : public CSocket
+{
+public:
+	CWebConnection (CNetSubSystem *pNetSubSystem, CSocket *pSocket);
+	~CWebConnection (void);
+
+	int Send (const void *pBuffer, unsigned nLength, int nFlags) override;
+	int Receive (void *pBuffer, unsigned nLength, int nFlags) override;
+	const u8 *GetForeignIP (void) const override;
+
+	std::string GetHeader (const char *pName) const;	// lower case name, "" if the request doesn't have it
+	void AddHeader (const std::string &header);		// "Name: value"
+	void NotModified (void);				// answer 304 and drop the content
+
+private:
+	CSocket *m_pSocket;
+	std::string m_Request;		// up to the end of its headers
+	std::string m_Headers;		// to add, each followed by CRLF
+	std::string m_Response;		// the daemon's headers until they are complete
+	bool m_bNotModified;
+	bool m_bHeaderSent;
+};
 
 class CWebServer : public CHTTPDaemon
 {
@@ -44,9 +75,33 @@ public:
 				const char **ppContentType);	// set this if not "text/html"
 
 private:
+	CWebConnection *m_pConnection;		// 0 for the listener
 	const size_t m_nMaxContentSize;
 	const size_t m_nMaxMultipartSize;
 	CActLED *m_pActLED;
 };
 
+// Takes the index page's uploads and serves downloads on STREAM_PORT. An upload's multipart body is parsed as it arrives
+// and each file written straight to the SD card; a download is read and sent a chunk at a time, from the start of
+// a Range if one is asked for. So unlike CWebServer neither needs the RAM for the whole file nor has a size limit.
+class CStreamServer : public CTask
+{
+public:
+	CStreamServer (CNetSubSystem *pNetSubSystem,
+		       CSocket	     *pSocket = 0);		// is 0 for 1st created instance (listener)
+	~CStreamServer (void);
+
+	void Run (void);
+
+private:
+	void Listener (void);
+	void Worker (void);
+	void Upload (std::string &header, size_t bodyStart, u8 *buffer);
+	void Download (const std::string &header, const std::string &request, bool bHead);
+	void Respond (const char *pStatus, const std::string &body);
+
+	CNetSubSystem *m_pNetSubSystem;
+	CSocket	      *m_pSocket;
+};
+
 #endif